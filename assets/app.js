@@ -12,6 +12,7 @@
   const chatScroll=document.getElementById('chatScroll');
   const cid=document.getElementById('client_id');
   const themeToggle=document.getElementById('themeToggle');
+  const live=typeof EventSource!=='undefined';
 
   function setTheme(mode){
     root.classList.toggle('dark',mode==='dark');
@@ -62,14 +63,82 @@
     return chatScroll.scrollHeight-chatScroll.scrollTop-chatScroll.clientHeight<threshold;
   }
 
-  async function refreshMessages(){
+  // Rows are kept in id order, so the newest is always the last one.
+  function latestMessageId(){
+    const last=list.lastElementChild;
+    return last&&last.dataset.id?Number(last.dataset.id):0;
+  }
+
+  // Appends server-rendered <li> rows, skipping ids already on the page.
+  function appendMessages(html){
+    const tmpl=document.createElement('template');
+    tmpl.innerHTML=html;
+    const latest=latestMessageId();
+    const rows=Array.from(tmpl.content.querySelectorAll('li[data-id]')).filter(function(li){
+      return Number(li.dataset.id)>latest;
+    });
+    if(!rows.length){return;}
+    const keepPinned=isNearBottom();
+    if(!list.querySelector('li[data-id]')){list.innerHTML='';}
+    rows.forEach(function(li){list.appendChild(li);});
+    if(keepPinned){scrollMessagesToBottom();}
+  }
+
+  async function replaceMessages(){
     const keepPinned=isNearBottom();
     const res=await fetch('/messages',{headers:{'X-Requested-With':'fetch'}});
     if(!res.ok){throw new Error('Failed to fetch messages');}
     list.innerHTML=await res.text();
+    olderExhausted=false;
     if(keepPinned){scrollMessagesToBottom();}
   }
 
+  let loadingOlder=false;
+  let olderExhausted=false;
+
+  function oldestMessageId(){
+    const first=list.firstElementChild;
+    return first&&first.dataset.id?Number(first.dataset.id):0;
+  }
+
+  // Keyset pagination: each page is the rows just before the oldest one
+  // shown, so history depth never changes the cost of a page.
+  async function loadOlderMessages(){
+    const before=oldestMessageId();
+    if(loadingOlder||olderExhausted||!before){return;}
+    loadingOlder=true;
+    try{
+      const res=await fetch('/messages?before='+before,{headers:{'X-Requested-With':'fetch'}});
+      if(!res.ok){throw new Error('Failed to fetch older messages');}
+      olderExhausted=res.headers.get('X-Message-More')!=='1';
+      const html=await res.text();
+      if(html&&oldestMessageId()===before){
+        const prevHeight=chatScroll.scrollHeight;
+        list.insertAdjacentHTML('afterbegin',html);
+        chatScroll.scrollTop+=chatScroll.scrollHeight-prevHeight;
+      }
+    }finally{
+      loadingOlder=false;
+    }
+  }
+
+  chatScroll.addEventListener('scroll',function(){
+    if(chatScroll.scrollTop<80){
+      loadOlderMessages().catch(()=>{});
+    }
+  });
+
+  // Fetches only rows newer than the newest one on the page. A gap bigger
+  // than one page is cheaper to replace than to walk.
+  async function refreshMessages(){
+    const since=latestMessageId();
+    if(!since){return replaceMessages();}
+    const res=await fetch('/messages?since='+since,{headers:{'X-Requested-With':'fetch'}});
+    if(!res.ok){throw new Error('Failed to fetch messages');}
+    if(res.headers.get('X-Message-More')==='1'){return replaceMessages();}
+    appendMessages(await res.text());
+  }
+
   form.addEventListener('submit', async function(e){
     e.preventDefault();
     statusEl.textContent='Posting...';
@@ -82,7 +151,7 @@
       });
       if(!res.ok){throw new Error('Post failed');}
       msg.value='';
-      await refreshMessages();
+      if(!live){await refreshMessages();}
       scrollMessagesToBottom();
       statusEl.textContent='Posted.';
     }catch(err){
@@ -90,10 +159,20 @@
     }
   });
 
-  if(typeof EventSource!=='undefined'){
-    const events=new EventSource('/events');
-    events.addEventListener('message', function(){
-      refreshMessages().catch(()=>{});
+  if(live){
+    // Reconnects resume from the browser's Last-Event-ID; the first connect
+    // resumes from the newest message rendered into the page.
+    const events=new EventSource('/events?last_event_id='+latestMessageId());
+    events.addEventListener('message', function(e){
+      try{
+        const data=JSON.parse(e.data);
+        appendMessages(data.html);
+      }catch(err){
+        refreshMessages().catch(()=>{});
+      }
+    });
+    events.addEventListener('reset', function(){
+      replaceMessages().catch(()=>{});
     });
     events.onerror=function(){
       // Browser will auto-reconnect SSE. Keep quiet unless needed.
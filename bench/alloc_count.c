@@ -0,0 +1,57 @@
+#include "alloc_count.h"
+
+#include <stddef.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+char *__real_strdup(const char *s);
+
+static struct AllocCount counts;
+
+void *__wrap_malloc(size_t size)
+{
+    counts.allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    counts.allocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        counts.allocs++;
+    } else {
+        counts.reallocs++;
+    }
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr != NULL) {
+        counts.frees++;
+    }
+    __real_free(ptr);
+}
+
+char *__wrap_strdup(const char *s)
+{
+    counts.allocs++;
+    return __real_strdup(s);
+}
+
+void alloc_count_get(struct AllocCount *out)
+{
+    *out = counts;
+}
+
+unsigned long long alloc_count_calls(void)
+{
+    return counts.allocs + counts.reallocs;
+}
@@ -0,0 +1,20 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+/*
+ * Heap calls made by our code. Benchmarks using this link with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free,--wrap=strdup,
+ * so calls inside SQLite and libc are not counted. Counters are not atomic:
+ * read them from single-threaded benchmarks only.
+ */
+struct AllocCount {
+    unsigned long long allocs;
+    unsigned long long reallocs;
+    unsigned long long frees;
+};
+
+void alloc_count_get(struct AllocCount *out);
+/* allocs + reallocs so far, for bench_timer_start and bench_report. */
+unsigned long long alloc_count_calls(void);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * Counts heap calls made by our code on each render path of a request.
+ * Linked with --wrap for malloc/calloc/realloc/free/strdup, so calls inside
+ * SQLite and libc are not counted:
+ *   messages_html  newest page as HTML (a /messages cache miss)
+ *   messages_json  newest page as JSON (a /messages.json cache miss)
+ *   home           full page around the HTML list (a / cache miss)
+ *   before_json    a keyset page (/messages.json?before=)
+ * Prints one key=value line per path, averaged over --iters calls.
+ *
+ * usage: bench_allocs [--rows=500] [--iters=200]
+ */
+#include "alloc_count.h"
+#include "arena.h"
+#include "assets.h"
+#include "bench_common.h"
+#include "config.h"
+#include "db.h"
+#include "render.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char *path_messages_html(void)
+{
+    return db_render_messages_html();
+}
+
+static char *path_messages_json(void)
+{
+    return db_render_messages_json();
+}
+
+static char *path_home(void)
+{
+    char *messages = db_render_messages_html();
+    char *page = messages != NULL ? render_home_page(messages) : NULL;
+    free(messages);
+    return page;
+}
+
+static char *path_before_json(void)
+{
+    struct MessagePage page;
+    return db_render_messages_before_json(db_latest_message_id() - 100, MESSAGE_PAGE_SIZE, &page);
+}
+
+static void run_path(const char *name, char *(*render)(void), int iters)
+{
+    free(render());
+    arena_thread_reset();
+
+    struct AllocCount before;
+    struct AllocCount after;
+    alloc_count_get(&before);
+    for (int i = 0; i < iters; ++i) {
+        free(render());
+        arena_thread_reset();
+    }
+    alloc_count_get(&after);
+    printf("path=%s arena=%s allocs=%.1f reallocs=%.1f frees=%.1f build=%s\n",
+           name,
+           arena_enabled() ? "on" : "off",
+           (double)(after.allocs - before.allocs) / iters,
+           (double)(after.reallocs - before.reallocs) / iters,
+           (double)(after.frees - before.frees) / iters, bench_build());
+    fflush(stdout);
+}
+
+static void run_all(int iters)
+{
+    run_path("messages_html", path_messages_html, iters);
+    run_path("messages_json", path_messages_json, iters);
+    run_path("home", path_home, iters);
+    run_path("before_json", path_before_json, iters);
+}
+
+int main(int argc, char **argv)
+{
+    int rows = 500;
+    int iters = 200;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--rows=", 7) == 0) {
+            rows = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--iters=", 8) == 0) {
+            iters = atoi(argv[i] + 8);
+        } else {
+            fprintf(stderr, "usage: %s [--rows=N] [--iters=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (rows <= 0 || iters <= 0) {
+        fprintf(stderr, "rows and iters must be > 0\n");
+        return 2;
+    }
+
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        return 1;
+    }
+    char dir[] = "/tmp/mb-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    int rc = 0;
+    if (db_init(1) != 0 || bench_seed(0, rows) != 0) {
+        fprintf(stderr, "seed failed\n");
+        rc = 1;
+    } else if (chdir(cwd) != 0 || assets_init() != 0 || render_init() != 0) {
+        fprintf(stderr, "asset loading failed (run from the repo root)\n");
+        rc = 1;
+    } else {
+        arena_set_enabled(0);
+        run_all(iters);
+        arena_set_enabled(1);
+        run_all(iters);
+    }
+
+    render_free();
+    assets_free();
+    db_close();
+    if (chdir(dir) == 0) {
+        unlink("messages.db");
+    }
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return rc;
+}
@@ -0,0 +1,181 @@
+#include "bench_common.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+enum { SEED_BATCH = 256 };
+
+#ifndef BENCH_BUILD_TYPE
+#define BENCH_BUILD_TYPE ""
+#endif
+
+const char *bench_build(void)
+{
+    return BENCH_BUILD_TYPE[0] != '\0' ? BENCH_BUILD_TYPE : "none";
+}
+
+static unsigned long long clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+unsigned long long bench_now_ns(void)
+{
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+unsigned long long bench_cpu_ns(void)
+{
+    return clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+double bench_now_us(void)
+{
+    return (double)bench_now_ns() / 1e3;
+}
+
+double bench_cpu_us(void)
+{
+    return (double)bench_cpu_ns() / 1e3;
+}
+
+void bench_timer_start(struct BenchTimer *t, unsigned long long allocs)
+{
+    t->allocs = allocs;
+    t->start_ns = bench_now_ns();
+}
+
+void bench_report(const struct BenchTimer *t, const char *labels, long ops, unsigned long long allocs, size_t bytes)
+{
+    double elapsed_ns = (double)(bench_now_ns() - t->start_ns);
+    double ns_per_op = elapsed_ns / (double)ops;
+    printf("bench=%s ops=%ld ns_per_op=%.1f allocs_per_op=%.3f ops_per_sec=%.0f",
+           labels,
+           ops,
+           ns_per_op,
+           (double)(allocs - t->allocs) / (double)ops,
+           1e9 / ns_per_op);
+    if (bytes > 0) {
+        printf(" mb_per_sec=%.1f", (double)bytes * 1e3 / elapsed_ns);
+    }
+    printf(" build=%s\n", bench_build());
+    fflush(stdout);
+}
+
+char *bench_make_text(size_t len, size_t special_every)
+{
+    static const char prose[] = "the quick brown fox jumps over the lazy dog, again and again. ";
+    static const char specials[] = "<>&\"\\\n\t\x01";
+    char *text = malloc(len + 1);
+    if (text == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        text[i] = prose[i % (sizeof(prose) - 1)];
+        if (special_every > 0 && i % special_every == special_every - 1) {
+            text[i] = specials[(i / special_every) % (sizeof(specials) - 1)];
+        }
+    }
+    text[len] = '\0';
+    return text;
+}
+
+void bench_fill_batch(struct MessageInsert *batch, char (*client_ids)[32], int n, long long first)
+{
+    static const char *nicknames[] = {"alice", "bob", "carol", "dave"};
+    static const char *contents[] = {
+        "short one",
+        "a message with <b>markup</b> & \"quotes\", long enough to span a few vector widths",
+        "a longer post that goes on for a while about nothing in particular, the kind of thing people write "
+        "when they have a minute and a keyboard, with a link https://example.com/?a=1&b=2 for good measure",
+    };
+    for (int i = 0; i < n; ++i) {
+        long long k = first + i;
+        snprintf(client_ids[i], sizeof(client_ids[i]), "client-%lld", k % 997);
+        batch[i].nickname = nicknames[k % 4];
+        batch[i].client_id = client_ids[i];
+        batch[i].content = contents[k % 3];
+    }
+}
+
+int bench_seed(long long from, long long to)
+{
+    struct MessageInsert batch[SEED_BATCH];
+    char client_ids[SEED_BATCH][32];
+    while (from < to) {
+        int n = to - from < SEED_BATCH ? (int)(to - from) : SEED_BATCH;
+        bench_fill_batch(batch, client_ids, n, from);
+        if (db_insert_messages(batch, (size_t)n) != n) {
+            return -1;
+        }
+        from += n;
+    }
+    return 0;
+}
+
+int bench_connect_local(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+int bench_send_all(int fd, const char *s)
+{
+    size_t len = strlen(s);
+    while (len > 0) {
+        ssize_t n = send(fd, s, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        s += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int bench_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void bench_raise_fd_limit(void)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
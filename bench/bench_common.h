@@ -0,0 +1,53 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include "db.h"
+
+#include <stddef.h>
+
+/* Shared by the benchmarks: clocks, key=value reporting, inputs and seeding. */
+
+/* CMAKE_BUILD_TYPE the benchmarks were compiled with, for a build= field. */
+const char *bench_build(void);
+
+/* Monotonic wall time and this process's CPU time. */
+unsigned long long bench_now_ns(void);
+unsigned long long bench_cpu_ns(void);
+double bench_now_us(void);
+double bench_cpu_us(void);
+
+/* allocs is a running count of heap calls (alloc_count_calls), or 0 when not counted. */
+struct BenchTimer {
+    unsigned long long start_ns;
+    unsigned long long allocs;
+};
+
+void bench_timer_start(struct BenchTimer *t, unsigned long long allocs);
+/*
+ * One line: bench=<labels> ops= ns_per_op= allocs_per_op= ops_per_sec=
+ * [mb_per_sec=] build=. bytes is the total output over all ops, or 0 to leave
+ * out mb_per_sec.
+ */
+void bench_report(const struct BenchTimer *t, const char *labels, long ops, unsigned long long allocs, size_t bytes);
+
+/* len bytes of prose; every `special_every` bytes one of the escaped characters. */
+char *bench_make_text(size_t len, size_t special_every);
+
+/*
+ * Fills n inserts numbered from `first`: four nicknames, 997 client ids and
+ * three message lengths, some with markup. client_ids backs the client_id
+ * strings and must outlive the batch.
+ */
+void bench_fill_batch(struct MessageInsert *batch, char (*client_ids)[32], int n, long long first);
+/* Inserts rows numbered from..to-1 through db_insert_messages, 256 per batch. */
+int bench_seed(long long from, long long to);
+
+/* Blocking TCP connection to 127.0.0.1:port with Nagle off, or -1. */
+int bench_connect_local(int port);
+int bench_send_all(int fd, const char *s);
+/* qsort comparator for doubles. */
+int bench_cmp_double(const void *a, const void *b);
+/* Lifts the soft open-file limit to the hard one, for many-connection tools. */
+void bench_raise_fd_limit(void);
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * Fetches each path from a running server with and without
+ * Accept-Encoding: gzip and reports, per request, bytes on the wire
+ * (headers included), the server's CPU time from /proc/PID/stat and client
+ * latency. Prints one key=value line per path and encoding.
+ *
+ * usage: bench_compression --pid=PID [--port=8888] [--requests=2000]
+ *                          [--paths=/,/messages,/messages.json,/assets/app.js]
+ */
+#include "bench_common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Returns the number of response bytes received, or -1. */
+static long fetch_once(int port, const char *path, const char *accept_encoding)
+{
+    int fd = bench_connect_local(port);
+    if (fd < 0) {
+        return -1;
+    }
+
+    char req[512];
+    snprintf(req,
+             sizeof(req),
+             "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n%s%s%sConnection: close\r\n\r\n",
+             path,
+             accept_encoding != NULL ? "Accept-Encoding: " : "",
+             accept_encoding != NULL ? accept_encoding : "",
+             accept_encoding != NULL ? "\r\n" : "");
+    if (bench_send_all(fd, req) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    char buf[16384];
+    ssize_t n;
+    long total = 0;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        total += (long)n;
+    }
+    close(fd);
+    return total > 0 ? total : -1;
+}
+
+/* utime + stime of the process, in microseconds. */
+static double proc_cpu_us(int pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char line[1024];
+    char *ok = fgets(line, sizeof(line), f);
+    fclose(f);
+    char *p = ok != NULL ? strrchr(line, ')') : NULL;
+    if (p == NULL) {
+        return -1;
+    }
+
+    /* Fields after the command name start at 3 (state); utime/stime are 14/15. */
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+        return -1;
+    }
+    return (double)(utime + stime) * 1e6 / (double)sysconf(_SC_CLK_TCK);
+}
+
+static void run_case(int pid, int port, const char *path, const char *accept_encoding, int requests, double *lat)
+{
+    /* Warm the server's cache so every timed request is steady state. */
+    fetch_once(port, path, accept_encoding);
+
+    long bytes = 0;
+    int failed = 0;
+    double cpu_start = proc_cpu_us(pid);
+    for (int i = 0; i < requests; ++i) {
+        double start = bench_now_us();
+        long n = fetch_once(port, path, accept_encoding);
+        lat[i] = bench_now_us() - start;
+        if (n < 0) {
+            failed++;
+        } else {
+            bytes += n;
+        }
+    }
+    double cpu_us = proc_cpu_us(pid) - cpu_start;
+    qsort(lat, (size_t)requests, sizeof(*lat), bench_cmp_double);
+
+    printf("path=%s encoding=%s requests=%d failed=%d bytes_per_req=%ld server_cpu_us_per_req=%.1f p50_us=%.0f p99_us=%.0f build=%s\n",
+           path,
+           accept_encoding != NULL ? accept_encoding : "identity",
+           requests,
+           failed,
+           requests > failed ? bytes / (requests - failed) : 0,
+           cpu_start >= 0 ? cpu_us / requests : -1.0,
+           lat[requests / 2],
+           lat[(requests * 99) / 100 < requests ? (requests * 99) / 100 : requests - 1], bench_build());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int port = 8888;
+    int requests = 2000;
+    int pid = 0;
+    const char *paths_arg = "/,/messages,/messages.json,/assets/app.js";
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--port=", 7) == 0) {
+            port = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--requests=", 11) == 0) {
+            requests = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--pid=", 6) == 0) {
+            pid = atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "--paths=", 8) == 0) {
+            paths_arg = argv[i] + 8;
+        } else {
+            fprintf(stderr, "usage: %s --pid=PID [--port=N] [--requests=N] [--paths=a,b,c]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (pid <= 0 || requests <= 0) {
+        fprintf(stderr, "--pid is required and requests must be > 0\n");
+        return 2;
+    }
+
+    double *lat = calloc((size_t)requests, sizeof(*lat));
+    char *paths = strdup(paths_arg);
+    if (lat == NULL || paths == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    char *saveptr = NULL;
+    for (char *path = strtok_r(paths, ",", &saveptr); path != NULL; path = strtok_r(NULL, ",", &saveptr)) {
+        run_case(pid, port, path, NULL, requests, lat);
+        run_case(pid, port, path, "gzip", requests, lat);
+    }
+
+    free(paths);
+    free(lat);
+    return 0;
+}
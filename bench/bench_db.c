@@ -0,0 +1,270 @@
+/*
+ * Times the database paths against one table grown to each --rows size:
+ *   db_render_html    db_render_messages_html, the newest page
+ *   db_render_json    db_render_messages_json, the newest page
+ *   db_render_before  a /messages.json?before= page from the table's middle
+ * then, at the largest size:
+ *   db_insert         db_insert_messages throughput, one post per
+ *                     transaction and --batch per transaction
+ *   db_tags_assign    db_tags_get_or_assign for --clients new clients per
+ *                     nickname, in writer-sized transactions
+ *   db_tags_lookup    the same pairs again, now all known: no SQL
+ * Prints one key=value line per case:
+ *   bench= rows= ops= ns_per_op= allocs_per_op= ops_per_sec= [mb_per_sec=]
+ * Allocations are our own heap calls (see alloc_count.h); SQLite's are not
+ * counted. The database lives in a temporary directory.
+ *
+ * usage: bench_db [--rows=1000,100000,1000000] [--iters=200] [--inserts=5000]
+ *                 [--batch=256] [--clients=5000] [--nicknames=4]
+ */
+#include "alloc_count.h"
+#include "arena.h"
+#include "assets.h"
+#include "bench_common.h"
+#include "config.h"
+#include "db.h"
+#include "db_tags.h"
+#include "logging.h"
+#include "render.h"
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum { ROW_SIZES_MAX = 8 };
+
+static long long seeded;
+static char db_path[64];
+
+/* --rows is ascending, so each size only adds rows. */
+static int seed_to(long long rows)
+{
+    if (bench_seed(seeded, rows) != 0) {
+        return -1;
+    }
+    seeded = rows;
+    return 0;
+}
+
+static char *render_before(void)
+{
+    struct MessagePage page;
+    return db_render_messages_before_json(seeded / 2, MESSAGE_PAGE_SIZE, &page);
+}
+
+static int run_render(const char *bench, char *(*render)(void), int iters)
+{
+    free(render());
+    arena_thread_reset();
+
+    size_t bytes = 0;
+    struct BenchTimer t;
+    bench_timer_start(&t, alloc_count_calls());
+    for (int i = 0; i < iters; ++i) {
+        char *body = render();
+        if (body == NULL) {
+            fprintf(stderr, "bench=%s failed\n", bench);
+            return -1;
+        }
+        bytes += strlen(body);
+        free(body);
+        arena_thread_reset();
+    }
+    char labels[64];
+    snprintf(labels, sizeof(labels), "%s rows=%lld", bench, seeded);
+    bench_report(&t, labels, iters, alloc_count_calls(), bytes);
+    return 0;
+}
+
+static int run_inserts(int inserts, int batch_size)
+{
+    struct MessageInsert *batch = calloc((size_t)batch_size, sizeof(*batch));
+    char (*client_ids)[32] = calloc((size_t)batch_size, sizeof(*client_ids));
+    if (batch == NULL || client_ids == NULL) {
+        free(batch);
+        free(client_ids);
+        return -1;
+    }
+
+    long long rows = seeded;
+    int rc = 0;
+    struct BenchTimer t;
+    bench_timer_start(&t, alloc_count_calls());
+    for (int done = 0; rc == 0 && done < inserts;) {
+        int n = inserts - done < batch_size ? inserts - done : batch_size;
+        bench_fill_batch(batch, client_ids, n, seeded);
+        if (db_insert_messages(batch, (size_t)n) != n) {
+            rc = -1;
+        }
+        seeded += n;
+        done += n;
+    }
+    if (rc == 0) {
+        char labels[64];
+        snprintf(labels, sizeof(labels), "db_insert batch=%d rows=%lld", batch_size, rows);
+        bench_report(&t, labels, inserts, alloc_count_calls(), 0);
+    }
+    free(batch);
+    free(client_ids);
+    return rc;
+}
+
+/*
+ * A connection of our own, as tags are assigned on the writer's. New pairs
+ * are written through inside BEGIN/COMMIT every `batch` assigns, as a
+ * writer transaction would.
+ */
+static int run_tags(int nicknames, int clients, int batch)
+{
+    struct DbConn conn = {0};
+    if (sqlite3_open(db_path, &conn.handle) != SQLITE_OK) {
+        sqlite3_close(conn.handle);
+        return -1;
+    }
+    sqlite3_busy_timeout(conn.handle, DB_BUSY_TIMEOUT_MS);
+
+    int rc = 0;
+    long ops = (long)nicknames * clients;
+    for (int pass = 0; rc == 0 && pass < 2; ++pass) {
+        struct BenchTimer t;
+        bench_timer_start(&t, alloc_count_calls());
+        long done = 0;
+        int writes = pass == 0;
+        for (int n = 0; rc == 0 && n < nicknames; ++n) {
+            char nickname[32];
+            snprintf(nickname, sizeof(nickname), "tags-%d", n);
+            for (int c = 0; rc == 0 && c < clients; ++c) {
+                char client_id[32];
+                snprintf(client_id, sizeof(client_id), "client-%d-%d", n, c);
+                if (writes && done % batch == 0) {
+                    rc |= sqlite3_exec(conn.handle, "BEGIN IMMEDIATE", NULL, NULL, NULL) != SQLITE_OK;
+                }
+                int tag = 0;
+                rc |= db_tags_get_or_assign(&conn, nickname, client_id, &tag);
+                done++;
+                if (writes && (done % batch == 0 || done == ops)) {
+                    rc |= sqlite3_exec(conn.handle, "COMMIT", NULL, NULL, NULL) != SQLITE_OK;
+                    db_tags_commit();
+                }
+            }
+        }
+        if (rc == 0) {
+            char labels[96];
+            snprintf(labels,
+                     sizeof(labels),
+                     "%s nicknames=%d clients=%d rows=%lld",
+                     pass == 0 ? "db_tags_assign" : "db_tags_lookup",
+                     nicknames,
+                     clients,
+                     seeded);
+            bench_report(&t, labels, ops, alloc_count_calls(), 0);
+        }
+    }
+
+    db_stmt_finalize_all(&conn);
+    sqlite3_close(conn.handle);
+    return rc;
+}
+
+static int parse_rows(const char *s, long long *rows, int *count)
+{
+    *count = 0;
+    while (*s != '\0') {
+        char *end = NULL;
+        long long v = strtoll(s, &end, 10);
+        if (end == s || v <= 0 || *count == ROW_SIZES_MAX || (*count > 0 && v < rows[*count - 1])) {
+            return -1;
+        }
+        rows[(*count)++] = v;
+        s = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return -1;
+        }
+    }
+    return *count > 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    long long rows[ROW_SIZES_MAX] = {1000, 100000, 1000000};
+    int row_count = 3;
+    int iters = 200;
+    int inserts = 5000;
+    int batch = WRITE_BATCH_MAX;
+    int clients = 5000;
+    int nicknames = 4;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--rows=", 7) == 0) {
+            if (parse_rows(argv[i] + 7, rows, &row_count) != 0) {
+                fprintf(stderr, "--rows takes ascending comma-separated counts\n");
+                return 2;
+            }
+        } else if (strncmp(argv[i], "--iters=", 8) == 0) {
+            iters = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--inserts=", 10) == 0) {
+            inserts = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            batch = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--clients=", 10) == 0) {
+            clients = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--nicknames=", 12) == 0) {
+            nicknames = atoi(argv[i] + 12);
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--rows=N,N,...] [--iters=N] [--inserts=N] [--batch=N] [--clients=N] [--nicknames=N]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (iters <= 0 || inserts <= 0 || batch <= 0 || nicknames <= 0 || clients <= 0 || clients > 9999) {
+        fprintf(stderr, "iters, inserts, batch and nicknames must be > 0; clients 1 to 9999 (the tag space)\n");
+        return 2;
+    }
+
+    /* Info records go to stdout, which is for results only. */
+    log_set_level(LOG_WARN);
+    if (assets_init() != 0 || render_init() != 0) {
+        fprintf(stderr, "asset loading failed (run from the repo root)\n");
+        return 1;
+    }
+    char dir[] = "/tmp/mb-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(db_path, sizeof(db_path), "%s/messages.db", dir);
+
+    int rc = db_init(1);
+    for (int i = 0; rc == 0 && i < row_count; ++i) {
+        unsigned long long start = bench_now_ns();
+        if (seed_to(rows[i]) != 0) {
+            fprintf(stderr, "seeding %lld rows failed\n", rows[i]);
+            rc = -1;
+            break;
+        }
+        fprintf(stderr, "seeded %lld rows in %.1fs\n", seeded, (double)(bench_now_ns() - start) / 1e9);
+        rc = run_render("db_render_html", db_render_messages_html, iters);
+        rc = rc != 0 ? rc : run_render("db_render_json", db_render_messages_json, iters);
+        rc = rc != 0 ? rc : run_render("db_render_before", render_before, iters);
+    }
+    rc = rc != 0 ? rc : run_inserts(inserts, 1);
+    rc = rc != 0 ? rc : run_inserts(inserts, batch);
+    rc = rc != 0 ? rc : run_tags(nicknames, clients, batch);
+
+    db_close();
+    render_free();
+    assets_free();
+    unlink(db_path);
+    if (chdir("/") == 0) {
+        char path[96];
+        snprintf(path, sizeof(path), "%s/messages.db-wal", dir);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/messages.db-shm", dir);
+        unlink(path);
+        rmdir(dir);
+    }
+    return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+/*
+ * Times HTML and JSON escaping per input shape with the allocating
+ * byte-at-a-time escapers this replaced ("legacy") and with each escape
+ * kernel the CPU supports, appending into a reused Buffer. Every kernel's
+ * output is checked against the legacy output first.
+ * Prints one key=value line per input and implementation.
+ *
+ * usage: bench_escape [--iters=200000]
+ */
+#include "bench_common.h"
+#include "escape.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The previous util.c escapers: one buffer_reserve or vsnprintf per byte. */
+static char *legacy_html_escape(const char *src)
+{
+    struct Buffer out = {0};
+
+    for (const unsigned char *p = (const unsigned char *)src; *p != '\0'; ++p) {
+        int rc = 0;
+        switch (*p) {
+        case '&':
+            rc = buffer_append(&out, "&amp;");
+            break;
+        case '<':
+            rc = buffer_append(&out, "&lt;");
+            break;
+        case '>':
+            rc = buffer_append(&out, "&gt;");
+            break;
+        case '"':
+            rc = buffer_append(&out, "&quot;");
+            break;
+        default:
+            rc = buffer_reserve(&out, 1);
+            if (rc == 0) {
+                out.data[out.len++] = (char)*p;
+                out.data[out.len] = '\0';
+            }
+            break;
+        }
+
+        if (rc != 0) {
+            free(out.data);
+            return NULL;
+        }
+    }
+
+    if (out.data == NULL) {
+        out.data = strdup("");
+    }
+    return out.data;
+}
+
+static char *legacy_json_escape(const char *src)
+{
+    struct Buffer out = {0};
+
+    for (const unsigned char *p = (const unsigned char *)src; *p != '\0'; ++p) {
+        int rc = 0;
+        switch (*p) {
+        case '\"':
+            rc = buffer_append(&out, "\\\"");
+            break;
+        case '\\':
+            rc = buffer_append(&out, "\\\\");
+            break;
+        case '\b':
+            rc = buffer_append(&out, "\\b");
+            break;
+        case '\f':
+            rc = buffer_append(&out, "\\f");
+            break;
+        case '\n':
+            rc = buffer_append(&out, "\\n");
+            break;
+        case '\r':
+            rc = buffer_append(&out, "\\r");
+            break;
+        case '\t':
+            rc = buffer_append(&out, "\\t");
+            break;
+        default:
+            if (*p < 0x20) {
+                rc = buffer_appendf(&out, "\\u%04x", *p);
+            } else {
+                rc = buffer_appendf(&out, "%c", *p);
+            }
+            break;
+        }
+
+        if (rc != 0) {
+            free(out.data);
+            return NULL;
+        }
+    }
+
+    if (out.data == NULL) {
+        out.data = strdup("");
+    }
+    return out.data;
+}
+
+struct Input {
+    const char *name;
+    char *text;
+};
+
+static int check_kernel(const struct Input *in)
+{
+    char *want_html = legacy_html_escape(in->text);
+    char *want_json = legacy_json_escape(in->text);
+    struct Buffer html = {0};
+    struct Buffer json = {0};
+    size_t len = strlen(in->text);
+    int ok = want_html != NULL && want_json != NULL && escape_html(&html, in->text, len) == 0 &&
+             escape_json(&json, in->text, len) == 0 && strcmp(html.data, want_html) == 0 &&
+             strcmp(json.data, want_json) == 0;
+    free(want_html);
+    free(want_json);
+    free(html.data);
+    free(json.data);
+    return ok ? 0 : -1;
+}
+
+static void run_legacy(const struct Input *in, int iters)
+{
+    double start = bench_cpu_ns();
+    for (int i = 0; i < iters; ++i) {
+        free(legacy_html_escape(in->text));
+    }
+    double html_ns = (bench_cpu_ns() - start) / iters;
+
+    start = bench_cpu_ns();
+    for (int i = 0; i < iters; ++i) {
+        free(legacy_json_escape(in->text));
+    }
+    double json_ns = (bench_cpu_ns() - start) / iters;
+
+    printf("input=%s bytes=%zu impl=legacy html_ns=%.1f json_ns=%.1f build=%s\n", in->name, strlen(in->text), html_ns, json_ns, bench_build());
+}
+
+static void run_kernel(const struct Input *in, int iters)
+{
+    struct Buffer out = {0};
+    size_t len = strlen(in->text);
+
+    double start = bench_cpu_ns();
+    for (int i = 0; i < iters; ++i) {
+        out.len = 0;
+        escape_html(&out, in->text, len);
+    }
+    double html_ns = (bench_cpu_ns() - start) / iters;
+
+    start = bench_cpu_ns();
+    for (int i = 0; i < iters; ++i) {
+        out.len = 0;
+        escape_json(&out, in->text, len);
+    }
+    double json_ns = (bench_cpu_ns() - start) / iters;
+    free(out.data);
+
+    printf("input=%s bytes=%zu impl=%s html_ns=%.1f json_ns=%.1f build=%s\n",
+           in->name,
+           len,
+           escape_kernel_name(escape_kernel()),
+           html_ns,
+           json_ns, bench_build());
+}
+
+int main(int argc, char **argv)
+{
+    int iters = 200000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--iters=", 8) == 0) {
+            iters = atoi(argv[i] + 8);
+        } else {
+            fprintf(stderr, "usage: %s [--iters=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (iters <= 0) {
+        fprintf(stderr, "iters must be > 0\n");
+        return 2;
+    }
+
+    struct Input inputs[] = {
+        {"nickname", bench_make_text(12, 0)},
+        {"short", bench_make_text(80, 40)},
+        {"long_clean", bench_make_text(1024, 0)},
+        {"long_markup", bench_make_text(1024, 50)},
+        {"html_fragment", bench_make_text(4096, 12)},
+    };
+    size_t input_count = sizeof(inputs) / sizeof(inputs[0]);
+    static const enum EscapeKernel kernels[] = {ESCAPE_SCALAR, ESCAPE_SSE2, ESCAPE_AVX2};
+
+    int rc = 0;
+    for (size_t i = 0; i < input_count; ++i) {
+        if (inputs[i].text == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+            if (escape_use_kernel(kernels[k]) == 0 && check_kernel(&inputs[i]) != 0) {
+                fprintf(stderr, "kernel=%s input=%s output differs from legacy\n", escape_kernel_name(kernels[k]), inputs[i].name);
+                rc = 1;
+            }
+        }
+    }
+
+    for (size_t i = 0; rc == 0 && i < input_count; ++i) {
+        run_legacy(&inputs[i], iters);
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+            if (escape_use_kernel(kernels[k]) == 0) {
+                run_kernel(&inputs[i], iters);
+            }
+        }
+        fflush(stdout);
+    }
+
+    for (size_t i = 0; i < input_count; ++i) {
+        free(inputs[i].text);
+    }
+    return rc;
+}
@@ -0,0 +1,168 @@
+/*
+ * Measures reads served from the fragments stored at insert time against
+ * rendering every row on read, and the background re-render that brings
+ * stale rows back up to RENDER_FRAGMENT_VERSION:
+ *   stored   newest page, HTML and JSON, concatenating stored fragments
+ *   live     the same pages after every row is marked stale
+ *   refresh  db_refresh_fragments steps until the table is current
+ * Page output is checked to be byte-identical across the three states.
+ * Prints one key=value line per mode.
+ *
+ * usage: bench_fragments [--rows=10000] [--iters=2000]
+ */
+#include "arena.h"
+#include "bench_common.h"
+#include "config.h"
+#include "db.h"
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Marks every row stale from a second connection, as an older build would. */
+static int mark_stale(void)
+{
+    sqlite3 *conn = NULL;
+    int rc = sqlite3_open("messages.db", &conn) == SQLITE_OK ? 0 : -1;
+    if (rc == 0) {
+        rc = sqlite3_exec(conn,
+                          "UPDATE messages SET fragment_version = 0;"
+                          "UPDATE render_state SET fragment_version = 0;",
+                          NULL,
+                          NULL,
+                          NULL) == SQLITE_OK
+                 ? 0
+                 : -1;
+    }
+    sqlite3_close(conn);
+    return rc;
+}
+
+struct Pages {
+    char *html;
+    char *json;
+};
+
+static void pages_free(struct Pages *p)
+{
+    free(p->html);
+    free(p->json);
+    p->html = NULL;
+    p->json = NULL;
+}
+
+static int run_reads(const char *mode, int iters, struct Pages *out)
+{
+    out->html = db_render_messages_html();
+    out->json = db_render_messages_json();
+    arena_thread_reset();
+    if (out->html == NULL || out->json == NULL) {
+        return -1;
+    }
+
+    double start = bench_cpu_us();
+    for (int i = 0; i < iters; ++i) {
+        free(db_render_messages_html());
+        arena_thread_reset();
+    }
+    double html_us = (bench_cpu_us() - start) / iters;
+
+    start = bench_cpu_us();
+    for (int i = 0; i < iters; ++i) {
+        free(db_render_messages_json());
+        arena_thread_reset();
+    }
+    double json_us = (bench_cpu_us() - start) / iters;
+
+    printf("mode=%s iters=%d html_cpu_us=%.1f json_cpu_us=%.1f stale=%d build=%s\n", mode, iters, html_us, json_us, db_fragments_stale(), bench_build());
+    fflush(stdout);
+    return 0;
+}
+
+static int same_pages(const struct Pages *a, const struct Pages *b)
+{
+    return strcmp(a->html, b->html) == 0 && strcmp(a->json, b->json) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rows = 10000;
+    int iters = 2000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--rows=", 7) == 0) {
+            rows = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--iters=", 8) == 0) {
+            iters = atoi(argv[i] + 8);
+        } else {
+            fprintf(stderr, "usage: %s [--rows=N] [--iters=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (rows <= 0 || iters <= 0) {
+        fprintf(stderr, "rows and iters must be > 0\n");
+        return 2;
+    }
+
+    char dir[] = "/tmp/mb-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    struct Pages stored = {0};
+    struct Pages live = {0};
+    struct Pages refreshed = {0};
+    int rc = 0;
+    if (db_init(1) != 0 || bench_seed(0, rows) != 0) {
+        fprintf(stderr, "seed failed\n");
+        rc = 1;
+    } else if (run_reads("stored", iters, &stored) != 0) {
+        rc = 1;
+    }
+
+    db_close();
+    if (rc == 0 && (mark_stale() != 0 || db_init(1) != 0 || run_reads("live", iters, &live) != 0)) {
+        fprintf(stderr, "stale reads failed\n");
+        rc = 1;
+    }
+
+    if (rc == 0) {
+        int steps = 0;
+        int step = 1;
+        double start = bench_cpu_us();
+        while (step > 0) {
+            step = db_refresh_fragments(FRAGMENT_REFRESH_BATCH);
+            steps++;
+        }
+        double refresh_ms = (bench_cpu_us() - start) / 1e3;
+        printf("mode=refresh rows=%d steps=%d cpu_ms=%.1f rows_per_sec=%.0f ok=%d build=%s\n",
+               rows,
+               steps,
+               refresh_ms,
+               rows / (refresh_ms / 1e3),
+               step == 0, bench_build());
+        if (step != 0 || run_reads("refreshed", iters, &refreshed) != 0) {
+            rc = 1;
+        }
+    }
+
+    if (rc == 0 && (!same_pages(&stored, &live) || !same_pages(&stored, &refreshed))) {
+        fprintf(stderr, "page output differs between stored and live fragments\n");
+        rc = 1;
+    }
+
+    pages_free(&stored);
+    pages_free(&live);
+    pages_free(&refreshed);
+    db_close();
+    unlink("messages.db");
+    unlink("messages.db-wal");
+    unlink("messages.db-shm");
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return rc;
+}
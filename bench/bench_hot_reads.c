@@ -0,0 +1,217 @@
+/*
+ * Measures read throughput across reader threads for the requests the hot
+ * window serves, against the SQLite reads they replaced:
+ *   sqlite  since=<latest-20> page from a pooled SQLite reader
+ *   hot     the same page from the in-memory snapshot (hot_render_page)
+ *   body    newest /messages body from the snapshot (cache_acquire/release)
+ * Each mode runs at 1, 2, 4 ... --threads readers for --ms milliseconds,
+ * optionally with a publisher posting a message every --publish-us.
+ * Prints one key=value line per mode and thread count.
+ *
+ * usage: bench_hot_reads [--rows=10000] [--threads=online cores] [--ms=500]
+ *                        [--publish-us=0]
+ */
+#include "arena.h"
+#include "assets.h"
+#include "bench_common.h"
+#include "cache.h"
+#include "config.h"
+#include "db.h"
+#include "hot.h"
+#include "render.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum Mode {
+    MODE_SQLITE,
+    MODE_HOT,
+    MODE_BODY,
+};
+
+static const char *mode_names[] = {"sqlite", "hot", "body"};
+
+static atomic_int stop;
+static atomic_int failed;
+
+struct Reader {
+    pthread_t thread;
+    enum Mode mode;
+    unsigned long long ops;
+};
+
+static int read_once(enum Mode mode)
+{
+    if (mode == MODE_BODY) {
+        struct CachedBody *body = cache_acquire(CACHE_MESSAGES_HTML);
+        if (body == NULL) {
+            return -1;
+        }
+        cache_release(body);
+        return 0;
+    }
+
+    struct MessagePage page = {hot_latest_id() - 20, 0};
+    char *rows = mode == MODE_HOT ? hot_render_page(page.cursor, MESSAGE_PAGE_SIZE, 1, 0, &page)
+                                  : db_render_messages_since_html(page.cursor, MESSAGE_PAGE_SIZE, &page);
+    free(rows);
+    arena_thread_reset();
+    return rows != NULL ? 0 : -1;
+}
+
+static void *reader_main(void *arg)
+{
+    struct Reader *reader = arg;
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        if (read_once(reader->mode) != 0) {
+            atomic_store(&failed, 1);
+            break;
+        }
+        reader->ops++;
+    }
+    return NULL;
+}
+
+/* Posts one message at a time, the way the writer publishes a small batch. */
+static void *publisher_main(void *arg)
+{
+    int interval_us = *(int *)arg;
+    unsigned long long n = 0;
+    char client_id[32];
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        snprintf(client_id, sizeof(client_id), "publisher-%llu", n++ % 997);
+        struct MessageInsert m = {.nickname = "publisher", .client_id = client_id, .content = "a message posted mid-run"};
+        if (db_insert_messages(&m, 1) != 1 || hot_publish(&m.record, 1) != 0) {
+            atomic_store(&failed, 1);
+            break;
+        }
+        usleep((useconds_t)interval_us);
+    }
+    return NULL;
+}
+
+static int run(enum Mode mode, int threads, int ms, int publish_us)
+{
+    struct Reader *readers = calloc((size_t)threads, sizeof(*readers));
+    if (readers == NULL) {
+        return -1;
+    }
+    pthread_t publisher;
+    int publishing = 0;
+
+    atomic_store(&stop, 0);
+    unsigned long long publishes_before = 0;
+    struct HotStats stats;
+    hot_get_stats(&stats);
+    publishes_before = stats.publishes;
+
+    double start = bench_now_us();
+    int started = 0;
+    for (; started < threads; ++started) {
+        readers[started].mode = mode;
+        if (pthread_create(&readers[started].thread, NULL, reader_main, &readers[started]) != 0) {
+            break;
+        }
+    }
+    if (publish_us > 0 && pthread_create(&publisher, NULL, publisher_main, &publish_us) == 0) {
+        publishing = 1;
+    }
+    usleep((useconds_t)ms * 1000);
+    atomic_store(&stop, 1);
+
+    unsigned long long ops = 0;
+    for (int i = 0; i < started; ++i) {
+        pthread_join(readers[i].thread, NULL);
+        ops += readers[i].ops;
+    }
+    if (publishing) {
+        pthread_join(publisher, NULL);
+    }
+    double elapsed_s = (bench_now_us() - start) / 1e6;
+    hot_get_stats(&stats);
+    free(readers);
+
+    if (started != threads) {
+        fprintf(stderr, "could not start %d reader threads\n", threads);
+        return -1;
+    }
+    printf("mode=%s threads=%d ops=%llu ops_per_sec=%.0f per_thread_ops_per_sec=%.0f publishes=%llu build=%s\n",
+           mode_names[mode],
+           threads,
+           ops,
+           ops / elapsed_s,
+           ops / elapsed_s / threads,
+           stats.publishes - publishes_before, bench_build());
+    fflush(stdout);
+    return atomic_load(&failed) ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rows = 10000;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cores > 0 ? (int)cores : 1;
+    int ms = 500;
+    int publish_us = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--rows=", 7) == 0) {
+            rows = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--ms=", 5) == 0) {
+            ms = atoi(argv[i] + 5);
+        } else if (strncmp(argv[i], "--publish-us=", 13) == 0) {
+            publish_us = atoi(argv[i] + 13);
+        } else {
+            fprintf(stderr, "usage: %s [--rows=N] [--threads=N] [--ms=N] [--publish-us=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (rows <= 0 || threads <= 0 || ms <= 0 || publish_us < 0) {
+        fprintf(stderr, "rows, threads and ms must be > 0\n");
+        return 2;
+    }
+
+    char dir[] = "/tmp/mb-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    int rc = 0;
+    cache_init();
+    if (db_init((unsigned int)threads) != 0 || assets_init() != 0 || render_init() != 0 || bench_seed(0, rows) != 0 ||
+        hot_init() != 0) {
+        fprintf(stderr, "setup failed\n");
+        rc = 1;
+    }
+    for (int mode = MODE_SQLITE; rc == 0 && mode <= MODE_BODY; ++mode) {
+        for (int n = 1; rc == 0; n *= 2) {
+            int count = n < threads ? n : threads;
+            if (run((enum Mode)mode, count, ms, publish_us) != 0) {
+                fprintf(stderr, "%s reads failed\n", mode_names[mode]);
+                rc = 1;
+            }
+            if (count == threads) {
+                break;
+            }
+        }
+    }
+
+    hot_shutdown();
+    render_free();
+    assets_free();
+    db_close();
+    unlink("messages.db");
+    unlink("messages.db-wal");
+    unlink("messages.db-shm");
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return rc;
+}
@@ -0,0 +1,110 @@
+/*
+ * Measures the cost of recording a request across threads:
+ *   shared   one relaxed fetch_add on a counter every thread shares
+ *   counter  metrics_add on the thread's own shard
+ *   request  metrics_request: route histogram bucket plus sum
+ * Prints one key=value line per mode and thread count, at 1, 2, 4 ...
+ * --threads threads.
+ *
+ * usage: bench_metrics [--threads=online cores] [--ops=5000000]
+ */
+#include "bench_common.h"
+#include "metrics.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+enum Mode {
+    MODE_SHARED,
+    MODE_COUNTER,
+    MODE_REQUEST,
+};
+
+static const char *mode_names[] = {"shared", "counter", "request"};
+
+static atomic_ullong shared_counter;
+static long ops_per_thread = 5000000;
+
+static void *worker_main(void *arg)
+{
+    enum Mode mode = *(enum Mode *)arg;
+    for (long i = 0; i < ops_per_thread; ++i) {
+        if (mode == MODE_SHARED) {
+            atomic_fetch_add_explicit(&shared_counter, 1, memory_order_relaxed);
+        } else if (mode == MODE_COUNTER) {
+            metrics_add(METRIC_BODY_BYTES, 1);
+        } else {
+            metrics_request(METRIC_ROUTE_MESSAGES, (unsigned long long)(i & 0xfffff));
+        }
+    }
+    return NULL;
+}
+
+static int run(enum Mode mode, int threads)
+{
+    pthread_t *tids = calloc((size_t)threads, sizeof(*tids));
+    if (tids == NULL) {
+        return -1;
+    }
+
+    unsigned long long start = metrics_now_ns();
+    int started = 0;
+    for (; started < threads; ++started) {
+        if (pthread_create(&tids[started], NULL, worker_main, &mode) != 0) {
+            break;
+        }
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    double elapsed_ns = (double)(metrics_now_ns() - start);
+    free(tids);
+
+    double ops = (double)started * (double)ops_per_thread;
+    printf("mode=%s threads=%d ops=%.0f ns_per_op=%.2f ops_per_sec=%.0f build=%s\n",
+           mode_names[mode],
+           started,
+           ops,
+           elapsed_ns / ops,
+           ops / (elapsed_ns / 1e9), bench_build());
+    fflush(stdout);
+    return started == threads ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cores > 0 ? (int)cores : 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--ops=", 6) == 0) {
+            ops_per_thread = atol(argv[i] + 6);
+        } else {
+            fprintf(stderr, "usage: %s [--threads=N] [--ops=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (threads <= 0 || ops_per_thread <= 0) {
+        fprintf(stderr, "threads and ops must be > 0\n");
+        return 2;
+    }
+
+    int rc = 0;
+    for (int mode = MODE_SHARED; rc == 0 && mode <= MODE_REQUEST; ++mode) {
+        for (int n = 1; rc == 0; n *= 2) {
+            int count = n < threads ? n : threads;
+            rc = run((enum Mode)mode, count);
+            if (count == threads) {
+                break;
+            }
+        }
+    }
+    return rc == 0 ? 0 : 1;
+}
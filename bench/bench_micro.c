@@ -0,0 +1,165 @@
+/*
+ * Times the request path's CPU-only building blocks in isolation:
+ *   html_escape     escape_html into a reused Buffer
+ *   json_escape     escape_json into a reused Buffer
+ *   buffer_appendf  one <li> header line, as the fragment renderer formats it
+ *   form_parse      a whole POST body through the streaming form parser
+ * Inputs are nickname-, message- and fragment-sized. Each case is warmed up
+ * once, then timed over --iters calls. Prints one key=value line per case:
+ *   bench= input= bytes= ops= ns_per_op= allocs_per_op= ops_per_sec= mb_per_sec=
+ * Allocations are our own heap calls (see alloc_count.h).
+ *
+ * usage: bench_micro [--iters=200000]
+ */
+#include "alloc_count.h"
+#include "bench_common.h"
+#include "escape.h"
+#include "form.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Case {
+    const char *bench;
+    const char *input;
+    const char *text;
+    size_t bytes;
+    int (*op)(const struct Case *c);
+};
+
+static struct Buffer out;
+
+static int op_html_escape(const struct Case *c)
+{
+    out.len = 0;
+    return escape_html(&out, c->text, c->bytes);
+}
+
+static int op_json_escape(const struct Case *c)
+{
+    out.len = 0;
+    return escape_json(&out, c->text, c->bytes);
+}
+
+static int op_buffer_appendf(const struct Case *c)
+{
+    out.len = 0;
+    return buffer_appendf(&out,
+                          "<li class=\"message\" data-id=\"%lld\"><span class=\"nick\" data-tag=\"%04d\">%s</span>"
+                          "<time datetime=\"%s\">%s</time>",
+                          1234567ll,
+                          4821,
+                          c->text,
+                          "2026-10-17 12:34:56",
+                          "12:34");
+}
+
+static int op_form_parse(const struct Case *c)
+{
+    char nickname[64];
+    char client_id[80];
+    char message[1024];
+    char ajax[8];
+    struct FormField fields[] = {
+        {.name = "nickname", .out = nickname, .size = sizeof(nickname)},
+        {.name = "client_id", .out = client_id, .size = sizeof(client_id)},
+        {.name = "message", .out = message, .size = sizeof(message)},
+        {.name = "ajax", .out = ajax, .size = sizeof(ajax)},
+    };
+    struct FormParser parser;
+    form_parser_init(&parser, fields, sizeof(fields) / sizeof(fields[0]), 8192);
+    if (form_parser_feed(&parser, c->text, c->bytes) != 0) {
+        return -1;
+    }
+    form_parser_finish(&parser);
+    return fields[2].found ? 0 : -1;
+}
+
+/* A urlencoded POST body whose message is `message_len` bytes of prose. */
+static char *make_form(size_t message_len)
+{
+    struct Buffer body = {0};
+    int rc = buffer_append(&body, "nickname=alice+%3C3&client_id=c0ffee-1234-5678&message=");
+    for (size_t i = 0; rc == 0 && i < message_len; ++i) {
+        rc = i % 24 == 23 ? buffer_append(&body, "%21") : buffer_append_len(&body, i % 6 == 5 ? "+" : "a", 1);
+    }
+    rc |= buffer_append(&body, "&ajax=1");
+    if (rc != 0) {
+        buffer_free(&body);
+        return NULL;
+    }
+    return body.data;
+}
+
+static int run(const struct Case *c, long iters)
+{
+    if (c->op(c) != 0) {
+        fprintf(stderr, "bench=%s input=%s failed\n", c->bench, c->input);
+        return -1;
+    }
+
+    struct BenchTimer t;
+    bench_timer_start(&t, alloc_count_calls());
+    for (long i = 0; i < iters; ++i) {
+        c->op(c);
+    }
+    char labels[96];
+    snprintf(labels, sizeof(labels), "%s input=%s bytes=%zu", c->bench, c->input, c->bytes);
+    bench_report(&t, labels, iters, alloc_count_calls(), c->bytes * (size_t)iters);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long iters = 200000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--iters=", 8) == 0) {
+            iters = atol(argv[i] + 8);
+        } else {
+            fprintf(stderr, "usage: %s [--iters=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (iters <= 0) {
+        fprintf(stderr, "iters must be > 0\n");
+        return 2;
+    }
+
+    char *nickname = bench_make_text(12, 0);
+    char *message = bench_make_text(280, 40);
+    char *fragment = bench_make_text(1024, 50);
+    char *form_short = make_form(80);
+    char *form_long = make_form(900);
+    if (nickname == NULL || message == NULL || fragment == NULL || form_short == NULL || form_long == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    const struct Case cases[] = {
+        {"html_escape", "nickname", nickname, strlen(nickname), op_html_escape},
+        {"html_escape", "message", message, strlen(message), op_html_escape},
+        {"html_escape", "fragment", fragment, strlen(fragment), op_html_escape},
+        {"json_escape", "nickname", nickname, strlen(nickname), op_json_escape},
+        {"json_escape", "message", message, strlen(message), op_json_escape},
+        {"json_escape", "fragment", fragment, strlen(fragment), op_json_escape},
+        {"buffer_appendf", "li_header", nickname, strlen(nickname), op_buffer_appendf},
+        {"form_parse", "post_short", form_short, strlen(form_short), op_form_parse},
+        {"form_parse", "post_long", form_long, strlen(form_long), op_form_parse},
+    };
+
+    int rc = 0;
+    for (size_t i = 0; rc == 0 && i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        rc = run(&cases[i], iters);
+    }
+
+    buffer_free(&out);
+    free(nickname);
+    free(message);
+    free(fragment);
+    free(form_short);
+    free(form_long);
+    return rc == 0 ? 0 : 1;
+}
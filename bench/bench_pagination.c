@@ -0,0 +1,184 @@
+/*
+ * Grows a scratch database through the given sizes and times, at each size:
+ *   page1    newest page (db_render_messages_html)
+ *   keyset   the page at --depth pages back (db_render_messages_before_html)
+ *   offset   the same page via LIMIT/OFFSET, for comparison
+ *   legacy   the old ORDER BY created_at DESC LIMIT 50 read, for comparison
+ * Prints one key=value line per size.
+ *
+ * usage: bench_pagination [--sizes=10000,100000,1000000,10000000] [--iters=200]
+ *                         [--depth=10000] [--baseline-iters=3]
+ */
+#include "arena.h"
+#include "bench_common.h"
+#include "config.h"
+#include "db.h"
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int seed_rows(sqlite3 *raw, long long from, long long to)
+{
+    sqlite3_stmt *stmt = NULL;
+    const char *sql =
+        "INSERT INTO messages(content, timestamp, nickname, client_id, user_tag, created_at) "
+        "VALUES(?, '2024-09-05 12:00:00', ?, ?, ?, ?)";
+
+    if (sqlite3_exec(raw, "BEGIN", NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(raw, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+
+    char content[96];
+    char nickname[32];
+    char client_id[32];
+    for (long long i = from; i < to; ++i) {
+        snprintf(content, sizeof(content), "seed message %lld with a little <b>markup</b> & text", i);
+        snprintf(nickname, sizeof(nickname), "nick%lld", i % 97);
+        snprintf(client_id, sizeof(client_id), "client-%lld", i % 997);
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, content, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, nickname, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, client_id, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 4, (int)(i % 9999) + 1);
+        sqlite3_bind_int64(stmt, 5, 1700000000 + i);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            sqlite3_finalize(stmt);
+            return -1;
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    return sqlite3_exec(raw, "COMMIT", NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+}
+
+static double time_raw_query(sqlite3 *raw, const char *sql, long long offset, int iters)
+{
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(raw, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+
+    double start = bench_now_us();
+    for (int i = 0; i < iters; ++i) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_int64(stmt, 1, offset);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+        }
+    }
+    double elapsed = (bench_now_us() - start) / iters;
+    sqlite3_finalize(stmt);
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    const char *sizes_arg = "10000,100000,1000000,10000000";
+    int iters = 200;
+    int baseline_iters = 3;
+    long long depth = 10000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--sizes=", 8) == 0) {
+            sizes_arg = argv[i] + 8;
+        } else if (strncmp(argv[i], "--iters=", 8) == 0) {
+            iters = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--depth=", 8) == 0) {
+            depth = atoll(argv[i] + 8);
+        } else if (strncmp(argv[i], "--baseline-iters=", 17) == 0) {
+            baseline_iters = atoi(argv[i] + 17);
+        } else {
+            fprintf(stderr, "usage: %s [--sizes=a,b,c] [--iters=N] [--depth=PAGES] [--baseline-iters=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (iters <= 0 || baseline_iters <= 0 || depth < 0) {
+        fprintf(stderr, "iters must be > 0 and depth >= 0\n");
+        return 2;
+    }
+
+    char dir[] = "/tmp/mb-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    if (db_init(1) != 0) {
+        return 1;
+    }
+
+    sqlite3 *raw = NULL;
+    if (sqlite3_open("messages.db", &raw) != SQLITE_OK) {
+        fprintf(stderr, "open: %s\n", sqlite3_errmsg(raw));
+        return 1;
+    }
+    sqlite3_exec(raw, "PRAGMA synchronous=OFF", NULL, NULL, NULL);
+
+    long long seeded = 0;
+    char *sizes = strdup(sizes_arg);
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(sizes, ",", &saveptr); tok != NULL; tok = strtok_r(NULL, ",", &saveptr)) {
+        long long size = atoll(tok);
+        if (size > seeded) {
+            if (seed_rows(raw, seeded, size) != 0) {
+                fprintf(stderr, "seed failed: %s\n", sqlite3_errmsg(raw));
+                return 1;
+            }
+            seeded = size;
+        }
+
+        double start = bench_now_us();
+        for (int i = 0; i < iters; ++i) {
+            free(db_render_messages_html());
+            arena_thread_reset();
+        }
+        double page1_us = (bench_now_us() - start) / iters;
+
+        long long offset = depth * MESSAGE_PAGE_SIZE;
+        long long cursor = seeded - offset + 1;
+        if (cursor < 1) {
+            cursor = 1;
+        }
+
+        start = bench_now_us();
+        for (int i = 0; i < iters; ++i) {
+            struct MessagePage page;
+            free(db_render_messages_before_html(cursor, MESSAGE_PAGE_SIZE, &page));
+            arena_thread_reset();
+        }
+        double keyset_us = (bench_now_us() - start) / iters;
+
+        double offset_us = time_raw_query(raw,
+                                          "SELECT rowid, nickname, content, timestamp, user_tag FROM messages "
+                                          "ORDER BY rowid DESC LIMIT 50 OFFSET ?",
+                                          offset,
+                                          baseline_iters);
+        double legacy_us = time_raw_query(raw,
+                                          "SELECT nickname, content, timestamp, user_tag FROM messages "
+                                          "WHERE ? >= 0 ORDER BY created_at DESC LIMIT 50",
+                                          0,
+                                          baseline_iters);
+
+        printf("rows=%lld depth_pages=%lld page1_us=%.1f keyset_us=%.1f offset_us=%.1f legacy_us=%.1f build=%s\n",
+               seeded,
+               depth,
+               page1_us,
+               keyset_us,
+               offset_us,
+               legacy_us, bench_build());
+        fflush(stdout);
+    }
+
+    free(sizes);
+    sqlite3_close(raw);
+    db_close();
+
+    unlink("messages.db");
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Times db_init against a scratch database of --rows messages written in
+ * the pre-migration layout (user_version 0, tags unassigned):
+ *   migrate  first boot, which applies every migration once
+ *   restart  each later boot, which should not touch message rows
+ * Prints one key=value line per boot.
+ *
+ * usage: bench_startup [--rows=1000000] [--restarts=3]
+ */
+#include "bench_common.h"
+#include "db.h"
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int seed_legacy(long long rows)
+{
+    sqlite3 *raw = NULL;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_open("messages.db", &raw) != SQLITE_OK) {
+        sqlite3_close(raw);
+        return -1;
+    }
+
+    const char *schema =
+        "CREATE TABLE messages(content TEXT, timestamp TEXT, nickname TEXT DEFAULT 'anon', "
+        "client_id TEXT DEFAULT 'legacy', user_tag INTEGER DEFAULT -1, created_at INTEGER DEFAULT 0);"
+        "CREATE TABLE nickname_tags(nickname TEXT NOT NULL, client_id TEXT NOT NULL, tag INTEGER NOT NULL, "
+        "UNIQUE(nickname, client_id), UNIQUE(nickname, tag));";
+    const char *sql =
+        "INSERT INTO messages(content, timestamp, nickname, client_id, user_tag, created_at) "
+        "VALUES(?, '2024-09-05 12:00:00', ?, ?, -1, ?)";
+
+    if (sqlite3_exec(raw, schema, NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_exec(raw, "BEGIN", NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(raw, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        sqlite3_close(raw);
+        return -1;
+    }
+
+    char content[96];
+    char nickname[32];
+    char client_id[32];
+    int rc = 0;
+    for (long long i = 0; i < rows && rc == 0; ++i) {
+        snprintf(content, sizeof(content), "seed message %lld with a little <b>markup</b> & text", i);
+        snprintf(nickname, sizeof(nickname), "nick%lld", i % 97);
+        snprintf(client_id, sizeof(client_id), "client-%lld", i % 997);
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, content, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, nickname, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, client_id, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 4, 1700000000 + i);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            rc = -1;
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    if (rc == 0 && sqlite3_exec(raw, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        rc = -1;
+    }
+    sqlite3_close(raw);
+    return rc;
+}
+
+static int time_boot(const char *phase, long long rows)
+{
+    double start = (bench_now_us() / 1e3);
+    if (db_init(1) != 0) {
+        return -1;
+    }
+    double init_ms = (bench_now_us() / 1e3) - start;
+    db_close();
+
+    printf("phase=%s rows=%lld init_ms=%.1f build=%s\n", phase, rows, init_ms, bench_build());
+    fflush(stdout);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long long rows = 1000000;
+    int restarts = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--rows=", 7) == 0) {
+            rows = atoll(argv[i] + 7);
+        } else if (strncmp(argv[i], "--restarts=", 11) == 0) {
+            restarts = atoi(argv[i] + 11);
+        } else {
+            fprintf(stderr, "usage: %s [--rows=N] [--restarts=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (rows <= 0 || restarts <= 0) {
+        fprintf(stderr, "rows and restarts must be > 0\n");
+        return 2;
+    }
+
+    char dir[] = "/tmp/mb-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    int rc = 0;
+    if (seed_legacy(rows) != 0) {
+        fprintf(stderr, "seed failed\n");
+        rc = 1;
+    } else if (time_boot("migrate", rows) != 0) {
+        fprintf(stderr, "migration failed\n");
+        rc = 1;
+    }
+    for (int i = 0; rc == 0 && i < restarts; ++i) {
+        if (time_boot("restart", rows) != 0) {
+            fprintf(stderr, "restart failed\n");
+            rc = 1;
+        }
+    }
+
+    unlink("messages.db");
+    unlink("messages.db-wal");
+    unlink("messages.db-shm");
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return rc;
+}
@@ -0,0 +1,106 @@
+/*
+ * Measures CPU per call of the hot database paths with the prepared
+ * statement cache on and off:
+ *   page     a 50-row keyset page (db_render_messages_before_html)
+ *   since    a short since= page (db_render_messages_since_json)
+ *   insert   one post through db_insert_messages (tag lookup + insert)
+ * Prints one key=value line per path and mode, plus prepare/reuse counts.
+ *
+ * usage: bench_statements [--rows=10000] [--iters=2000]
+ */
+#include "arena.h"
+#include "bench_common.h"
+#include "config.h"
+#include "db.h"
+#include "db_stmt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void run_mode(const char *mode, int iters)
+{
+    long long latest = db_latest_message_id();
+    struct DbStmtStats before;
+    db_stmt_get_stats(&before);
+
+    double start = bench_cpu_us();
+    for (int i = 0; i < iters; ++i) {
+        struct MessagePage page;
+        free(db_render_messages_before_html(latest - (i % 100) * MESSAGE_PAGE_SIZE, MESSAGE_PAGE_SIZE, &page));
+        arena_thread_reset();
+    }
+    double page_us = (bench_cpu_us() - start) / iters;
+
+    start = bench_cpu_us();
+    for (int i = 0; i < iters; ++i) {
+        struct MessagePage page;
+        free(db_render_messages_since_json(latest - 3, MESSAGE_PAGE_SIZE, &page));
+        arena_thread_reset();
+    }
+    double since_us = (bench_cpu_us() - start) / iters;
+
+    struct MessageInsert insert = {.nickname = "bench", .client_id = "bench-client", .content = "hello"};
+    start = bench_cpu_us();
+    for (int i = 0; i < iters; ++i) {
+        db_insert_messages(&insert, 1);
+    }
+    double insert_us = (bench_cpu_us() - start) / iters;
+
+    struct DbStmtStats after;
+    db_stmt_get_stats(&after);
+    printf("mode=%s iters=%d page_cpu_us=%.1f since_cpu_us=%.1f insert_cpu_us=%.1f prepares=%llu reuses=%llu build=%s\n",
+           mode,
+           iters,
+           page_us,
+           since_us,
+           insert_us,
+           after.prepares - before.prepares,
+           after.reuses - before.reuses, bench_build());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int rows = 10000;
+    int iters = 2000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--rows=", 7) == 0) {
+            rows = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--iters=", 8) == 0) {
+            iters = atoi(argv[i] + 8);
+        } else {
+            fprintf(stderr, "usage: %s [--rows=N] [--iters=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (rows <= 0 || iters <= 0) {
+        fprintf(stderr, "rows and iters must be > 0\n");
+        return 2;
+    }
+
+    char dir[] = "/tmp/mb-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    if (db_init(1) != 0 || bench_seed(0, rows) != 0) {
+        fprintf(stderr, "seed failed\n");
+        return 1;
+    }
+
+    db_stmt_set_caching(0);
+    run_mode("prepare_each", iters);
+    db_stmt_set_caching(1);
+    run_mode("cached", iters);
+
+    db_close();
+    unlink("messages.db");
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Measures what a trace_begin/trace_end pair costs the request path:
+ *   off      tracing disabled: no Trace attached, as for unsampled requests
+ *   sampled  --sample=N: one request in N gets a Trace and keeps its spans
+ *   on       every request traced
+ * A request here is --spans pairs bracketed by trace_sample/trace_finish,
+ * which is roughly what a cached GET records. Prints one key=value line per
+ * mode with ns per span pair and per request.
+ *
+ * usage: bench_trace [--requests=200000] [--spans=8] [--sample=100]
+ */
+#include "bench_common.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static long requests = 200000;
+static int spans = 8;
+
+static void run(const char *name, unsigned int sample)
+{
+    trace_set_sample(sample);
+    unsigned long long start = metrics_now_ns();
+    for (long i = 0; i < requests; ++i) {
+        struct Trace *trace = trace_sample();
+        trace_attach(trace);
+        for (int s = 0; s < spans; ++s) {
+            unsigned long long span = trace_begin();
+            trace_end("span", span);
+        }
+        trace_attach(NULL);
+        trace_finish(trace, "request");
+    }
+    double elapsed_ns = (double)(metrics_now_ns() - start);
+
+    printf("mode=%s sample=%u requests=%ld spans=%d ns_per_span=%.2f ns_per_request=%.1f build=%s\n",
+           name,
+           sample,
+           requests,
+           spans,
+           elapsed_ns / ((double)requests * spans),
+           elapsed_ns / (double)requests, bench_build());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int sample = 100;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--requests=", 11) == 0) {
+            requests = atol(argv[i] + 11);
+        } else if (strncmp(argv[i], "--spans=", 8) == 0) {
+            spans = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--sample=", 9) == 0) {
+            sample = (unsigned int)atoi(argv[i] + 9);
+        } else {
+            fprintf(stderr, "usage: %s [--requests=N] [--spans=N] [--sample=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (requests <= 0 || spans <= 0 || sample == 0) {
+        fprintf(stderr, "requests, spans and sample must be > 0\n");
+        return 2;
+    }
+
+    run("off", 0);
+    run("sampled", sample);
+    run("on", 1);
+    return 0;
+}
@@ -0,0 +1,745 @@
+/*
+ * Load generator for a server on localhost. One epoll loop drives:
+ *   subscribers  --subscribers /events streams, held open for the whole run
+ *   posters      --posters keep-alive connections POSTing /post, --rate
+ *                posts per second between them (0: each as fast as it can)
+ *   readers      --readers keep-alive connections GETting /messages or, for
+ *                --json-percent of requests, /messages.json; --read-rate
+ *                requests per second between them (0: as fast as they can)
+ * Each post's message carries a run id and sequence number, so subscribers
+ * can time every delivery from the post's send to its event's arrival.
+ * Rated requests are timed from when they were due, not when they went
+ * out, so a slow server cannot hide the queue it builds.
+ *
+ * Runs for --duration seconds, or until --posts posts are answered, then
+ * waits up to --drain-ms for outstanding deliveries. Prints one key=value
+ * line for the run, one per route with p50/p99/p999 and one for SSE
+ * delivery. Progress goes to stderr once a second.
+ *
+ * usage: load_gen [--port=8888] [--subscribers=100] [--posters=4] [--rate=50]
+ *                 [--readers=4] [--read-rate=0] [--json-percent=50]
+ *                 [--duration=10] [--posts=0] [--drain-ms=2000]
+ */
+#include "bench_common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+enum Role {
+    ROLE_SUBSCRIBER,
+    ROLE_POSTER,
+    ROLE_READER,
+};
+
+enum Route {
+    ROUTE_POST,
+    ROUTE_MESSAGES,
+    ROUTE_MESSAGES_JSON,
+    ROUTE_SSE_DELIVERY,
+    ROUTE_COUNT,
+};
+
+static const char *route_names[] = {"post", "messages", "messages_json", "sse_delivery"};
+
+/*
+ * Latencies in ns, log-linear: values under 64 exactly, then 64 buckets per
+ * power of two, so a reported percentile is within 1/64 of the true one.
+ */
+enum { HIST_SUB = 64, HIST_TOP_POWER = 45, HIST_BUCKETS = (HIST_TOP_POWER - 5) * HIST_SUB };
+
+struct Histogram {
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long count;
+    unsigned long long errors;
+    unsigned long long max_ns;
+};
+
+struct Conn {
+    enum Role role;
+    int fd;
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    char out[2048];
+    size_t out_len;
+    size_t out_off;
+    int opened;
+    int busy;
+    int ready;
+    enum Route route;
+    unsigned long long started_ns;
+    unsigned long long next_due_ns;
+    unsigned long long interval_ns;
+};
+
+static int port = 8888;
+static int json_percent = 50;
+static long posts_limit;
+static int epoll_fd = -1;
+
+static struct Histogram histograms[ROUTE_COUNT];
+static unsigned int run_id;
+static unsigned long long rng_state;
+
+/* Send time of post n, for delivery latency. */
+static unsigned long long *post_sent_ns;
+static size_t post_sent_cap;
+static long posts_started;
+static long posts_finished;
+static unsigned long long posts_ok;
+
+static int subscribers_ready;
+static unsigned long long sse_events;
+static unsigned long long sse_foreign;
+static unsigned long long sse_resets;
+static unsigned long long sse_disconnects;
+static unsigned long long reconnects;
+
+static unsigned long long rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static size_t hist_bucket(unsigned long long ns)
+{
+    if (ns < HIST_SUB) {
+        return (size_t)ns;
+    }
+    int power = 63 - __builtin_clzll(ns);
+    if (power >= HIST_TOP_POWER) {
+        return HIST_BUCKETS - 1;
+    }
+    return (size_t)(power - 5) * HIST_SUB + (size_t)((ns >> (power - 6)) & (HIST_SUB - 1));
+}
+
+/* Midpoint of a bucket's range. */
+static double hist_value(size_t bucket)
+{
+    if (bucket < HIST_SUB) {
+        return (double)bucket;
+    }
+    int power = (int)(bucket / HIST_SUB) + 5;
+    unsigned long long width = 1ull << (power - 6);
+    unsigned long long low = (1ull << power) + (unsigned long long)(bucket % HIST_SUB) * width;
+    return (double)low + (double)width / 2;
+}
+
+static void hist_record(struct Histogram *h, unsigned long long ns)
+{
+    h->counts[hist_bucket(ns)]++;
+    h->count++;
+    if (ns > h->max_ns) {
+        h->max_ns = ns;
+    }
+}
+
+static double hist_percentile_us(const struct Histogram *h, double q)
+{
+    if (h->count == 0) {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)(q * (double)h->count + 0.999999);
+    unsigned long long seen = 0;
+    for (size_t b = 0; b < HIST_BUCKETS; ++b) {
+        seen += h->counts[b];
+        if (seen >= rank) {
+            double v = hist_value(b);
+            return (v < (double)h->max_ns ? v : (double)h->max_ns) / 1e3;
+        }
+    }
+    return (double)h->max_ns / 1e3;
+}
+
+/* Blocking connect: on loopback it completes at once or fails. */
+static int connect_local(void)
+{
+    int fd = bench_connect_local(port);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return fd;
+}
+
+static void conn_close(struct Conn *c)
+{
+    if (c->fd >= 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        c->fd = -1;
+    }
+    c->in_len = 0;
+    c->out_len = 0;
+    c->out_off = 0;
+    if (c->role == ROLE_SUBSCRIBER && c->ready) {
+        subscribers_ready--;
+        sse_disconnects++;
+    }
+    c->ready = 0;
+}
+
+static int conn_open(struct Conn *c)
+{
+    c->fd = connect_local();
+    if (c->fd < 0) {
+        return -1;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c->fd, &ev) != 0) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/* Sends what fits; the rest goes out on EPOLLOUT. */
+static int conn_flush(struct Conn *c)
+{
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        c->out_off += (size_t)n;
+    }
+
+    struct epoll_event ev = {.events = EPOLLIN | (c->out_off < c->out_len ? EPOLLOUT : 0), .data.ptr = c};
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+    return 0;
+}
+
+/* Appends s form-urlencoded. */
+static size_t url_encode(char *out, size_t size, const char *s)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t n = 0;
+    for (const unsigned char *p = (const unsigned char *)s; *p != '\0' && n + 4 < size; ++p) {
+        if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '-' ||
+            *p == '_' || *p == '.') {
+            out[n++] = (char)*p;
+        } else if (*p == ' ') {
+            out[n++] = '+';
+        } else {
+            out[n++] = '%';
+            out[n++] = hex[*p >> 4];
+            out[n++] = hex[*p & 15];
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static int record_post_sent(long seq, unsigned long long ns)
+{
+    if ((size_t)seq >= post_sent_cap) {
+        size_t cap = post_sent_cap > 0 ? post_sent_cap * 2 : 4096;
+        unsigned long long *grown = realloc(post_sent_ns, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        post_sent_ns = grown;
+        post_sent_cap = cap;
+    }
+    post_sent_ns[seq] = ns;
+    return 0;
+}
+
+/* Names and words as scripts/seed_posts.sh picked them. */
+static void build_post(struct Conn *c, long seq)
+{
+    static const char *adjectives[] = {"brisk", "mellow", "neon", "fuzzy", "wired", "cosmic", "rusty", "lucid"};
+    static const char *nouns[] = {"otter", "falcon", "pine", "comet", "fox", "tide", "ember", "quartz"};
+    static const char *verbs[] = {"ships", "tests", "debugs", "tunes", "patches", "maps", "profiles", "traces"};
+    static const char *shared_nicks[] = {"cow", "fox", "owl", "emberbot"};
+
+    char nickname[64];
+    char client_id[64];
+    if (rng_next() % 100 < 45) {
+        const char *nick = shared_nicks[rng_next() % 4];
+        snprintf(nickname, sizeof(nickname), "%s", nick);
+        snprintf(client_id, sizeof(client_id), "seed-%s-client-%d", nick, (int)(rng_next() % 4));
+    } else {
+        snprintf(nickname, sizeof(nickname), "%s_%s%d", adjectives[rng_next() % 8], nouns[rng_next() % 8], (int)(rng_next() % 90 + 10));
+        snprintf(client_id, sizeof(client_id), "seed-%08x-%08x", (unsigned int)rng_next(), (unsigned int)rng_next());
+    }
+    char message[128];
+    snprintf(message,
+             sizeof(message),
+             "%s %s %s build #%04x-%ld",
+             nouns[rng_next() % 8],
+             verbs[rng_next() % 8],
+             adjectives[rng_next() % 8],
+             run_id,
+             seq);
+
+    char body[512];
+    size_t len = 0;
+    len += (size_t)snprintf(body + len, sizeof(body) - len, "nickname=");
+    len += url_encode(body + len, sizeof(body) - len, nickname);
+    len += (size_t)snprintf(body + len, sizeof(body) - len, "&client_id=");
+    len += url_encode(body + len, sizeof(body) - len, client_id);
+    len += (size_t)snprintf(body + len, sizeof(body) - len, "&message=");
+    len += url_encode(body + len, sizeof(body) - len, message);
+    len += (size_t)snprintf(body + len, sizeof(body) - len, "&ajax=1");
+
+    c->out_len = (size_t)snprintf(c->out,
+                                  sizeof(c->out),
+                                  "POST /post HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                                  "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %zu\r\n\r\n%s",
+                                  len,
+                                  body);
+}
+
+static void start_request(struct Conn *c, unsigned long long now)
+{
+    if (c->fd < 0) {
+        if (conn_open(c) != 0) {
+            /* A post that could not be sent still counts, so --posts runs end. */
+            if (c->role == ROLE_POSTER) {
+                posts_started++;
+                posts_finished++;
+            }
+            histograms[c->role == ROLE_POSTER ? ROUTE_POST : ROUTE_MESSAGES].errors++;
+            c->next_due_ns = now + 100000000ull;
+            return;
+        }
+        reconnects += c->opened;
+        c->opened = 1;
+    }
+
+    c->started_ns = c->interval_ns > 0 ? c->next_due_ns : now;
+    c->next_due_ns = c->interval_ns > 0 ? c->next_due_ns + c->interval_ns : now;
+    if (c->role == ROLE_POSTER) {
+        long seq = posts_started++;
+        if (record_post_sent(seq, now) != 0) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        c->route = ROUTE_POST;
+        build_post(c, seq);
+    } else {
+        c->route = (int)(rng_next() % 100) < json_percent ? ROUTE_MESSAGES_JSON : ROUTE_MESSAGES;
+        c->out_len = (size_t)snprintf(c->out,
+                                      sizeof(c->out),
+                                      "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept-Encoding: gzip\r\n\r\n",
+                                      c->route == ROUTE_MESSAGES_JSON ? "/messages.json" : "/messages");
+    }
+    c->out_off = 0;
+    c->busy = 1;
+    if (conn_flush(c) != 0) {
+        histograms[c->route].errors++;
+        posts_finished += c->route == ROUTE_POST;
+        c->busy = 0;
+        conn_close(c);
+    }
+}
+
+static int open_subscriber(struct Conn *c)
+{
+    if (conn_open(c) != 0) {
+        return -1;
+    }
+    /* HTTP/1.0, so the stream arrives unchunked and events are plain text. */
+    c->out_len = (size_t)snprintf(c->out, sizeof(c->out), "GET /events HTTP/1.0\r\nAccept: text/event-stream\r\n\r\n");
+    c->out_off = 0;
+    return conn_flush(c);
+}
+
+/* The value of header `name` inside the header block, or NULL. */
+static const char *header_value(const char *headers, const char *name)
+{
+    size_t name_len = strlen(name);
+    for (const char *line = strstr(headers, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, name, name_len) == 0 && line[2 + name_len] == ':') {
+            const char *v = line + 3 + name_len;
+            while (*v == ' ') {
+                v++;
+            }
+            return v;
+        }
+    }
+    return NULL;
+}
+
+static void consume(struct Conn *c, size_t n)
+{
+    memmove(c->in, c->in + n, c->in_len - n);
+    c->in_len -= n;
+    c->in[c->in_len] = '\0';
+}
+
+/* Handles complete responses in c->in; returns -1 to drop the connection. */
+static int parse_responses(struct Conn *c, unsigned long long now)
+{
+    for (;;) {
+        char *end = strstr(c->in, "\r\n\r\n");
+        if (end == NULL) {
+            return 0;
+        }
+        size_t header_len = (size_t)(end - c->in) + 4;
+        int status = 0;
+        sscanf(c->in, "HTTP/1.%*d %d", &status);
+
+        *end = '\0';
+        const char *length = header_value(c->in, "Content-Length");
+        const char *connection = header_value(c->in, "Connection");
+        int closing = connection != NULL && strncasecmp(connection, "close", 5) == 0;
+        *end = '\r';
+        if (length == NULL) {
+            /* Every route we request sends a length; anything else is unexpected. */
+            histograms[c->route].errors++;
+            c->busy = 0;
+            return -1;
+        }
+        size_t body_len = (size_t)strtoull(length, NULL, 10);
+        if (c->in_len < header_len + body_len) {
+            return 0;
+        }
+
+        if (c->busy) {
+            if (status >= 200 && status < 300) {
+                hist_record(&histograms[c->route], now - c->started_ns);
+                posts_ok += c->route == ROUTE_POST;
+            } else {
+                histograms[c->route].errors++;
+            }
+            posts_finished += c->route == ROUTE_POST;
+            c->busy = 0;
+        }
+        consume(c, header_len + body_len);
+        if (closing) {
+            return -1;
+        }
+    }
+}
+
+/* Times one SSE event against the send of the post it carries. */
+static void handle_event(const char *event, unsigned long long now)
+{
+    if (strncmp(event, "event: reset", 12) == 0 || strstr(event, "\nevent: reset") != NULL) {
+        sse_resets++;
+        return;
+    }
+    if (strstr(event, "event: message") == NULL) {
+        return;
+    }
+    sse_events++;
+
+    char marker[32];
+    snprintf(marker, sizeof(marker), "build #%04x-", run_id);
+    const char *p = strstr(event, marker);
+    if (p == NULL) {
+        sse_foreign++;
+        return;
+    }
+    long seq = strtol(p + strlen(marker), NULL, 10);
+    if (seq < 0 || seq >= posts_started) {
+        sse_foreign++;
+        return;
+    }
+    hist_record(&histograms[ROUTE_SSE_DELIVERY], now - post_sent_ns[seq]);
+}
+
+static int parse_events(struct Conn *c, unsigned long long now)
+{
+    size_t done = 0;
+    if (!c->ready) {
+        char *end = strstr(c->in, "\r\n\r\n");
+        if (end == NULL) {
+            return 0;
+        }
+        int status = 0;
+        sscanf(c->in, "HTTP/1.%*d %d", &status);
+        if (status != 200) {
+            return -1;
+        }
+        c->ready = 1;
+        subscribers_ready++;
+        done = (size_t)(end - c->in) + 4;
+    }
+
+    for (;;) {
+        char *end = strstr(c->in + done, "\n\n");
+        if (end == NULL) {
+            break;
+        }
+        *end = '\0';
+        handle_event(c->in + done, now);
+        done = (size_t)(end - c->in) + 2;
+    }
+    consume(c, done);
+    return 0;
+}
+
+static void conn_read(struct Conn *c)
+{
+    unsigned long long now = bench_now_ns();
+    for (;;) {
+        if (c->in_cap - c->in_len < 4096) {
+            size_t cap = c->in_cap > 0 ? c->in_cap * 2 : 16384;
+            char *grown = realloc(c->in, cap);
+            if (grown == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+            c->in = grown;
+            c->in_cap = cap;
+        }
+        ssize_t n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len - 1, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            if (c->busy) {
+                histograms[c->route].errors++;
+                posts_finished += c->route == ROUTE_POST;
+                c->busy = 0;
+            }
+            conn_close(c);
+            return;
+        }
+        c->in_len += (size_t)n;
+        c->in[c->in_len] = '\0';
+    }
+
+    int rc = c->role == ROLE_SUBSCRIBER ? parse_events(c, now) : parse_responses(c, now);
+    if (rc != 0) {
+        conn_close(c);
+    }
+}
+
+static void print_route(enum Route route, double seconds)
+{
+    const struct Histogram *h = &histograms[route];
+    printf("route=%s requests=%llu errors=%llu rps=%.1f p50_us=%.0f p99_us=%.0f p999_us=%.0f max_us=%.0f build=%s\n",
+           route_names[route],
+           h->count,
+           h->errors,
+           (double)h->count / seconds,
+           hist_percentile_us(h, 0.50),
+           hist_percentile_us(h, 0.99),
+           hist_percentile_us(h, 0.999),
+           (double)h->max_ns / 1e3, bench_build());
+}
+
+int main(int argc, char **argv)
+{
+    int subscribers = 100;
+    int posters = 4;
+    double rate = 50;
+    int readers = 4;
+    double read_rate = 0;
+    double duration = 10;
+    int duration_set = 0;
+    int drain_ms = 2000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--port=", 7) == 0) {
+            port = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--subscribers=", 14) == 0) {
+            subscribers = atoi(argv[i] + 14);
+        } else if (strncmp(argv[i], "--posters=", 10) == 0) {
+            posters = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            rate = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--readers=", 10) == 0) {
+            readers = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--read-rate=", 12) == 0) {
+            read_rate = atof(argv[i] + 12);
+        } else if (strncmp(argv[i], "--json-percent=", 15) == 0) {
+            json_percent = atoi(argv[i] + 15);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration = atof(argv[i] + 11);
+            duration_set = 1;
+        } else if (strncmp(argv[i], "--posts=", 8) == 0) {
+            posts_limit = atol(argv[i] + 8);
+        } else if (strncmp(argv[i], "--drain-ms=", 11) == 0) {
+            drain_ms = atoi(argv[i] + 11);
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--port=N] [--subscribers=N] [--posters=N] [--rate=N] [--readers=N] [--read-rate=N]\n"
+                    "          [--json-percent=N] [--duration=S] [--posts=N] [--drain-ms=N]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    /* --posts alone runs until they are answered. */
+    if (posts_limit > 0 && !duration_set) {
+        duration = 0;
+    }
+    if (subscribers < 0 || posters < 0 || readers < 0 || rate < 0 || read_rate < 0 || duration < 0 ||
+        posts_limit < 0 || drain_ms < 0 || json_percent < 0 || json_percent > 100 || (duration == 0 && posts_limit == 0) ||
+        (posts_limit > 0 && posters == 0)) {
+        fprintf(stderr, "counts and rates must be >= 0, and a run needs --duration or --posts with posters\n");
+        return 2;
+    }
+
+    int probe = connect_local();
+    if (probe < 0) {
+        fprintf(stderr, "cannot connect to 127.0.0.1:%d\n", port);
+        return 1;
+    }
+    close(probe);
+
+    bench_raise_fd_limit();
+    rng_state = bench_now_ns() ^ ((unsigned long long)getpid() << 32);
+    run_id = (unsigned int)(rng_next() & 0xffff);
+    epoll_fd = epoll_create1(0);
+    int total = subscribers + posters + readers;
+    struct Conn *conns = calloc((size_t)(total > 0 ? total : 1), sizeof(*conns));
+    if (epoll_fd < 0 || conns == NULL) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+
+    unsigned long long start = bench_now_ns();
+    for (int i = 0; i < total; ++i) {
+        struct Conn *c = &conns[i];
+        c->fd = -1;
+        c->role = i < subscribers ? ROLE_SUBSCRIBER : i < subscribers + posters ? ROLE_POSTER : ROLE_READER;
+        double per_conn = c->role == ROLE_POSTER ? rate / posters : c->role == ROLE_READER ? read_rate / readers : 0;
+        c->interval_ns = per_conn > 0 ? (unsigned long long)(1e9 / per_conn) : 0;
+        if (c->role == ROLE_SUBSCRIBER && open_subscriber(c) != 0) {
+            conn_close(c);
+        }
+    }
+
+    /* Posting before every stream is parked would undercount deliveries. */
+    struct epoll_event events[256];
+    while (subscribers_ready < subscribers && bench_now_ns() - start < 5000000000ull) {
+        int n = epoll_wait(epoll_fd, events, 256, 50);
+        for (int i = 0; i < n; ++i) {
+            conn_read(events[i].data.ptr);
+        }
+    }
+    int subscribed = subscribers_ready;
+
+    start = bench_now_ns();
+    for (int i = subscribers; i < total; ++i) {
+        /* Spread rated connections over one interval so they do not fire together. */
+        conns[i].next_due_ns = start + (conns[i].interval_ns * (unsigned long long)(i - subscribers)) / (unsigned long long)(total - subscribers);
+    }
+    unsigned long long end = duration > 0 ? start + (unsigned long long)(duration * 1e9) : 0;
+    unsigned long long stop = 0;
+    unsigned long long last_progress = start;
+
+    for (;;) {
+        unsigned long long now = bench_now_ns();
+        int posts_done = posts_limit > 0 && posts_finished >= posts_limit;
+        if (stop == 0 && ((end > 0 && now >= end) || posts_done)) {
+            stop = now;
+        }
+        if (stop != 0) {
+            unsigned long long expected = posts_ok * (unsigned long long)subscribers_ready;
+            int in_flight = 0;
+            for (int i = subscribers; i < total; ++i) {
+                in_flight |= conns[i].busy;
+            }
+            if ((!in_flight && histograms[ROUTE_SSE_DELIVERY].count >= expected) ||
+                now - stop >= (unsigned long long)drain_ms * 1000000ull) {
+                break;
+            }
+        }
+
+        unsigned long long wake = now + 10000000ull;
+        for (int i = subscribers; stop == 0 && i < total; ++i) {
+            struct Conn *c = &conns[i];
+            if (c->busy || (c->role == ROLE_POSTER && posts_limit > 0 && posts_started >= posts_limit)) {
+                continue;
+            }
+            if (c->next_due_ns <= now) {
+                start_request(c, now);
+            }
+            if (!c->busy && c->next_due_ns < wake) {
+                wake = c->next_due_ns;
+            }
+        }
+
+        int timeout_ms = wake > now ? (int)((wake - now) / 1000000ull) : 0;
+        int n = epoll_wait(epoll_fd, events, 256, timeout_ms);
+        for (int i = 0; i < n; ++i) {
+            struct Conn *c = events[i].data.ptr;
+            if ((events[i].events & EPOLLOUT) && c->fd >= 0 && conn_flush(c) != 0) {
+                conn_close(c);
+                continue;
+            }
+            if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && c->fd >= 0) {
+                conn_read(c);
+            }
+        }
+
+        now = bench_now_ns();
+        if (now - last_progress >= 1000000000ull) {
+            last_progress = now;
+            fprintf(stderr,
+                    "[load]\tt=%.0fs\tposts=%llu\treads=%llu\tdeliveries=%llu\tsubscribers=%d\n",
+                    (double)(now - start) / 1e9,
+                    posts_ok,
+                    histograms[ROUTE_MESSAGES].count + histograms[ROUTE_MESSAGES_JSON].count,
+                    histograms[ROUTE_SSE_DELIVERY].count,
+                    subscribers_ready);
+        }
+    }
+
+    double seconds = (double)((stop != 0 ? stop : bench_now_ns()) - start) / 1e9;
+    printf("run=%04x port=%d seconds=%.2f subscribers=%d subscribed=%d posters=%d rate=%.1f readers=%d read_rate=%.1f "
+           "json_percent=%d reconnects=%llu build=%s\n",
+           run_id,
+           port,
+           seconds,
+           subscribers,
+           subscribed,
+           posters,
+           rate,
+           readers,
+           read_rate,
+           json_percent,
+           reconnects, bench_build());
+    print_route(ROUTE_POST, seconds);
+    print_route(ROUTE_MESSAGES, seconds);
+    print_route(ROUTE_MESSAGES_JSON, seconds);
+
+    const struct Histogram *h = &histograms[ROUTE_SSE_DELIVERY];
+    printf("route=sse_delivery events=%llu deliveries=%llu expected=%llu foreign=%llu resets=%llu disconnects=%llu "
+           "p50_us=%.0f p99_us=%.0f p999_us=%.0f max_us=%.0f build=%s\n",
+           sse_events,
+           h->count,
+           posts_ok * (unsigned long long)subscribers_ready,
+           sse_foreign,
+           sse_resets,
+           sse_disconnects,
+           hist_percentile_us(h, 0.50),
+           hist_percentile_us(h, 0.99),
+           hist_percentile_us(h, 0.999),
+           (double)h->max_ns / 1e3, bench_build());
+
+    for (int i = 0; i < total; ++i) {
+        if (conns[i].fd >= 0) {
+            close(conns[i].fd);
+        }
+        free(conns[i].in);
+    }
+    free(conns);
+    free(post_sent_ns);
+    close(epoll_fd);
+    return 0;
+}
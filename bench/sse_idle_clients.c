@@ -0,0 +1,151 @@
+/*
+ * Opens N idle /events subscribers against a running server, then measures
+ * GET /messages latency while they stay connected and samples the server's
+ * RSS and thread count from /proc. Prints one key=value line.
+ *
+ * usage: sse_idle_clients --pid=PID [--port=8888] [--clients=1000] [--samples=200] [--label=pool]
+ */
+#include "bench_common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int fetch_once(int port, const char *path)
+{
+    int fd = bench_connect_local(port);
+    if (fd < 0) {
+        return -1;
+    }
+
+    char req[256];
+    snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n", path);
+    if (bench_send_all(fd, req) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    char buf[16384];
+    ssize_t n;
+    size_t total = 0;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        total += (size_t)n;
+    }
+    close(fd);
+    return total > 0 ? 0 : -1;
+}
+
+static long proc_status_value(int pid, const char *key)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char line[256];
+    size_t key_len = strlen(key);
+    long value = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, key, key_len) == 0 && line[key_len] == ':') {
+            value = strtol(line + key_len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+int main(int argc, char **argv)
+{
+    int port = 8888;
+    int clients = 1000;
+    int samples = 200;
+    int pid = 0;
+    const char *label = "server";
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--port=", 7) == 0) {
+            port = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--clients=", 10) == 0) {
+            clients = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--samples=", 10) == 0) {
+            samples = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--pid=", 6) == 0) {
+            pid = atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "--label=", 8) == 0) {
+            label = argv[i] + 8;
+        } else {
+            fprintf(stderr, "usage: %s --pid=PID [--port=N] [--clients=N] [--samples=N] [--label=S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (clients < 0 || samples <= 0) {
+        fprintf(stderr, "clients must be >= 0 and samples > 0\n");
+        return 2;
+    }
+
+    bench_raise_fd_limit();
+
+    int *fds = calloc((size_t)(clients > 0 ? clients : 1), sizeof(*fds));
+    double *lat = calloc((size_t)samples, sizeof(*lat));
+    if (fds == NULL || lat == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    int connected = 0;
+    for (int i = 0; i < clients; ++i) {
+        int fd = bench_connect_local(port);
+        if (fd < 0 || bench_send_all(fd, "GET /events HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: text/event-stream\r\n\r\n") != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            fds[i] = -1;
+            continue;
+        }
+        fds[i] = fd;
+        connected++;
+    }
+
+    /* Let the server finish accepting and parking the streams. */
+    sleep(2);
+
+    int failed = 0;
+    for (int i = 0; i < samples; ++i) {
+        double start = bench_now_us();
+        if (fetch_once(port, "/messages") != 0) {
+            failed++;
+        }
+        lat[i] = bench_now_us() - start;
+    }
+    qsort(lat, (size_t)samples, sizeof(*lat), bench_cmp_double);
+
+    long rss_kb = pid > 0 ? proc_status_value(pid, "VmRSS") : -1;
+    long threads = pid > 0 ? proc_status_value(pid, "Threads") : -1;
+
+    printf("label=%s clients=%d connected=%d rss_kb=%ld threads=%ld samples=%d failed=%d p50_us=%.0f p99_us=%.0f max_us=%.0f build=%s\n",
+           label,
+           clients,
+           connected,
+           rss_kb,
+           threads,
+           samples,
+           failed,
+           lat[samples / 2],
+           lat[(samples * 99) / 100 < samples ? (samples * 99) / 100 : samples - 1],
+           lat[samples - 1], bench_build());
+
+    for (int i = 0; i < clients; ++i) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    free(fds);
+    free(lat);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Seeds a fresh board, then reports bytes on the wire and server CPU per
+# request for /, /messages, /messages.json and /assets/app.js, with and
+# without gzip.
+#   ./scripts/bench_compression.sh [posts] [requests]
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="${ROOT_DIR}/build"
+PORT=8888
+POSTS="${1:-50}"
+REQUESTS="${2:-2000}"
+
+cmake -S "${ROOT_DIR}" -B "${BUILD_DIR}" -DCMAKE_BUILD_TYPE="${CMAKE_BUILD_TYPE:-RelWithDebInfo}" -DMESSAGE_BOARD_BENCHMARKS=ON >/dev/null
+cmake --build "${BUILD_DIR}" >/dev/null
+
+WORK_DIR="$(mktemp -d)"
+SERVER_PID=""
+
+# The server stops on a line from stdin; hold a fifo open so it never sees EOF.
+mkfifo "${WORK_DIR}/stdin"
+exec 3<>"${WORK_DIR}/stdin"
+
+cleanup() {
+  if [[ -n "${SERVER_PID}" ]] && kill -0 "${SERVER_PID}" 2>/dev/null; then
+    kill "${SERVER_PID}" 2>/dev/null || true
+    wait "${SERVER_PID}" 2>/dev/null || true
+  fi
+  rm -rf "${WORK_DIR}"
+}
+trap cleanup EXIT INT TERM
+
+(cd "${WORK_DIR}" && exec "${BUILD_DIR}/message_board" <&3 >/dev/null 2>&1) &
+SERVER_PID=$!
+sleep 1
+
+"${ROOT_DIR}/scripts/seed_posts.sh" "http://127.0.0.1:${PORT}" "${POSTS}" >/dev/null
+"${BUILD_DIR}/bench_compression" "--pid=${SERVER_PID}" "--port=${PORT}" "--requests=${REQUESTS}"
@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Compares RSS, thread count and /messages latency of the two server modes
+# while 1k/5k/10k idle SSE subscribers are connected.
+#   ./scripts/bench_server_modes.sh [client counts...]
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="${ROOT_DIR}/build"
+PORT=8888
+COUNTS=("$@")
+if (( ${#COUNTS[@]} == 0 )); then
+  COUNTS=(1000 5000 10000)
+fi
+
+cmake -S "${ROOT_DIR}" -B "${BUILD_DIR}" -DCMAKE_BUILD_TYPE="${CMAKE_BUILD_TYPE:-RelWithDebInfo}" -DMESSAGE_BOARD_BENCHMARKS=ON >/dev/null
+cmake --build "${BUILD_DIR}" >/dev/null
+
+ulimit -n "$(ulimit -Hn)"
+
+WORK_DIR="$(mktemp -d)"
+ln -s "${ROOT_DIR}/assets" "${WORK_DIR}/assets"
+SERVER_PID=""
+
+# The server stops on a line from stdin; hold a fifo open so it never sees EOF.
+mkfifo "${WORK_DIR}/stdin"
+exec 3<>"${WORK_DIR}/stdin"
+
+stop_server() {
+  if [[ -n "${SERVER_PID}" ]] && kill -0 "${SERVER_PID}" 2>/dev/null; then
+    kill "${SERVER_PID}" 2>/dev/null || true
+    wait "${SERVER_PID}" 2>/dev/null || true
+  fi
+  SERVER_PID=""
+}
+
+cleanup() {
+  stop_server
+  rm -rf "${WORK_DIR}"
+}
+trap cleanup EXIT INT TERM
+
+for mode in thread pool; do
+  for clients in "${COUNTS[@]}"; do
+    (cd "${WORK_DIR}" && exec "${BUILD_DIR}/message_board" "--mode=${mode}" <&3 >/dev/null 2>&1) &
+    SERVER_PID=$!
+    sleep 1
+
+    "${BUILD_DIR}/sse_idle_clients" \
+      "--pid=${SERVER_PID}" "--port=${PORT}" "--clients=${clients}" "--label=${mode}" || true
+
+    stop_server
+  done
+done
@@ -5,5 +5,5 @@ ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
 BUILD_DIR="${ROOT_DIR}/build"
 
 mkdir -p "${BUILD_DIR}"
-cmake -S "${ROOT_DIR}" -B "${BUILD_DIR}"
+cmake -S "${ROOT_DIR}" -B "${BUILD_DIR}" -DCMAKE_BUILD_TYPE="${CMAKE_BUILD_TYPE:-RelWithDebInfo}" -DMESSAGE_BOARD_DEV_ASSETS="${MESSAGE_BOARD_DEV_ASSETS:-OFF}"
 cmake --build "${BUILD_DIR}"
@@ -5,6 +5,9 @@ ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
 BUILD_DIR="${ROOT_DIR}/build"
 SERVER_PID=""
 
+# Read assets from disk so asset edits only need a restart, not a re-embed.
+export MESSAGE_BOARD_DEV_ASSETS=ON
+
 snapshot_tree() {
   (
     cd "${ROOT_DIR}"
@@ -1,43 +1,42 @@
 #!/usr/bin/env bash
 set -euo pipefail
 
+# Posts COUNT random messages through bench/load_gen, four connections at a
+# time, with the nicknames and words this script used to send one curl at a
+# time. load_gen only talks to 127.0.0.1, so the host must be 127.0.0.1 or
+# localhost; the port defaults to 8888 when the URL has none.
+#   ./scripts/seed_posts.sh [base_url] [count]
+
 ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="${ROOT_DIR}/build"
 BASE_URL="${1:-http://127.0.0.1:8888}"
 COUNT="${2:-128}"
 
-adjectives=(brisk mellow neon fuzzy wired cosmic rusty lucid)
-nouns=(otter falcon pine comet fox tide ember quartz)
-verbs=(ships tests debugs tunes patches maps profiles traces)
-shared_nicks=(cow fox owl emberbot)
-
-rand_from() {
-  local -n arr=$1
-  echo "${arr[RANDOM % ${#arr[@]}]}"
-}
-
-for ((i=1; i<=COUNT; i++)); do
-  if (( RANDOM % 100 < 45 )); then
-    nick="$(rand_from shared_nicks)"
-    client_slot=$((RANDOM % 4))
-    client_id="seed-${nick}-client-${client_slot}"
-  else
-    nick="$(rand_from adjectives)_$(rand_from nouns)$((RANDOM % 90 + 10))"
-    client_id="seed-$(printf '%08x' "$RANDOM")-$(printf '%08x' "$RANDOM")"
-  fi
-
-  msg="$(rand_from nouns) $(rand_from verbs) $(rand_from adjectives) build #${i}"
-
-  curl -fsS -X POST "${BASE_URL}/post" \
-    -H 'Content-Type: application/x-www-form-urlencoded' \
-    --data-urlencode "nickname=${nick}" \
-    --data-urlencode "client_id=${client_id}" \
-    --data-urlencode "message=${msg}" \
-    --data-urlencode "ajax=1" \
-    >/dev/null
-
-  if (( i % 16 == 0 )); then
-    printf '[seed]\tposted %d/%d\n' "$i" "$COUNT"
-  fi
-done
-
-printf '[seed]\tdone: posted %d messages to %s\n' "$COUNT" "$BASE_URL"
+HOST_PORT="${BASE_URL#*://}"
+HOST_PORT="${HOST_PORT%%/*}"
+HOST="${HOST_PORT%%:*}"
+PORT=8888
+if [[ "${HOST_PORT}" == *:* ]]; then
+  PORT="${HOST_PORT##*:}"
+fi
+if [[ "${HOST}" != "127.0.0.1" && "${HOST}" != "localhost" ]]; then
+  printf '[seed]\tload_gen only posts to 127.0.0.1; %s is not local\n' "${HOST}" >&2
+  exit 1
+fi
+if [[ ! "${PORT}" =~ ^[0-9]+$ ]]; then
+  printf '[seed]\tbad port in %s\n' "${BASE_URL}" >&2
+  exit 1
+fi
+
+cmake -S "${ROOT_DIR}" -B "${BUILD_DIR}" -DCMAKE_BUILD_TYPE="${CMAKE_BUILD_TYPE:-RelWithDebInfo}" -DMESSAGE_BOARD_BENCHMARKS=ON >/dev/null
+cmake --build "${BUILD_DIR}" --target load_gen >/dev/null
+
+summary="$("${BUILD_DIR}/load_gen" "--port=${PORT}" "--posts=${COUNT}" --posters=4 --rate=0 --subscribers=0 --readers=0)"
+post_line="$(grep '^route=post ' <<<"${summary}")"
+printf '[seed]\t%s\n' "${post_line}"
+
+if [[ "${post_line}" != *" errors=0 "* ]]; then
+  printf '[seed]\tsome posts failed\n' >&2
+  exit 1
+fi
+printf '[seed]\tdone: posted %d messages to %s\n' "${COUNT}" "${BASE_URL}"
@@ -0,0 +1,158 @@
+#include "arena.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A request renders into its thread's arena and copies the finished body
+ * out once. Reset keeps the memory: when a request spilled into several
+ * blocks they are replaced by one block of their combined size, so after
+ * warm-up a request of the same shape allocates nothing.
+ */
+
+enum { ARENA_BLOCK_SIZE = 64 * 1024, ARENA_ALIGN = 16 };
+
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGN) char data[];
+};
+
+static size_t align_up(size_t n)
+{
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static struct ArenaBlock *block_new(size_t size, struct ArenaBlock *next)
+{
+    struct ArenaBlock *block = malloc(sizeof(*block) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void *arena_alloc(struct Arena *a, size_t size)
+{
+    size = align_up(size == 0 ? 1 : size);
+    struct ArenaBlock *block = a->head;
+    if (block == NULL || block->size - block->used < size) {
+        block = block_new(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE, a->head);
+        if (block == NULL) {
+            return NULL;
+        }
+        a->head = block;
+    }
+
+    char *ptr = block->data + block->used;
+    block->used += size;
+    a->last = ptr;
+    return ptr;
+}
+
+void *arena_grow(struct Arena *a, void *ptr, size_t old_size, size_t new_size)
+{
+    if (ptr == NULL) {
+        return arena_alloc(a, new_size);
+    }
+
+    struct ArenaBlock *block = a->head;
+    if (ptr == a->last && block != NULL) {
+        size_t offset = (size_t)((char *)ptr - block->data);
+        if (align_up(new_size) <= block->size - offset) {
+            block->used = offset + align_up(new_size);
+            return ptr;
+        }
+    }
+
+    void *moved = arena_alloc(a, new_size);
+    if (moved != NULL) {
+        memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return moved;
+}
+
+void arena_reset(struct Arena *a)
+{
+    struct ArenaBlock *block = a->head;
+    if (block != NULL && block->next != NULL) {
+        size_t total = 0;
+        while (block != NULL) {
+            struct ArenaBlock *next = block->next;
+            total += block->size;
+            free(block);
+            block = next;
+        }
+        a->head = block_new(total, NULL);
+    } else if (block != NULL) {
+        block->used = 0;
+    }
+    a->last = NULL;
+}
+
+void arena_release(struct Arena *a)
+{
+    struct ArenaBlock *block = a->head;
+    while (block != NULL) {
+        struct ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    a->head = NULL;
+    a->last = NULL;
+}
+
+static atomic_int arena_on = 1;
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local struct Arena *thread_arena;
+
+/* Frees a thread's arena when it exits (thread-per-connection mode). */
+static void thread_arena_destroy(void *arena)
+{
+    arena_release(arena);
+    free(arena);
+}
+
+static void arena_key_init(void)
+{
+    pthread_key_create(&arena_key, thread_arena_destroy);
+}
+
+struct Arena *arena_thread(void)
+{
+    if (!atomic_load_explicit(&arena_on, memory_order_relaxed)) {
+        return NULL;
+    }
+    if (thread_arena == NULL) {
+        pthread_once(&arena_key_once, arena_key_init);
+        thread_arena = calloc(1, sizeof(*thread_arena));
+        if (thread_arena != NULL) {
+            pthread_setspecific(arena_key, thread_arena);
+        }
+    }
+    return thread_arena;
+}
+
+void arena_thread_reset(void)
+{
+    if (thread_arena != NULL) {
+        arena_reset(thread_arena);
+    }
+}
+
+int arena_enabled(void)
+{
+    return atomic_load_explicit(&arena_on, memory_order_relaxed);
+}
+
+void arena_set_enabled(int enabled)
+{
+    atomic_store_explicit(&arena_on, enabled != 0, memory_order_relaxed);
+}
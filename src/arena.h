@@ -0,0 +1,27 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct ArenaBlock;
+
+/* Bump allocator: allocations are never freed one by one, only all at once. */
+struct Arena {
+    struct ArenaBlock *head;
+    /* Most recent allocation; arena_grow extends it in place when it fits. */
+    char *last;
+};
+
+void *arena_alloc(struct Arena *a, size_t size);
+void *arena_grow(struct Arena *a, void *ptr, size_t old_size, size_t new_size);
+void arena_reset(struct Arena *a);
+void arena_release(struct Arena *a);
+
+/* Per-thread scratch arena for one request; NULL while disabled. */
+struct Arena *arena_thread(void);
+void arena_thread_reset(void);
+int arena_enabled(void);
+/* Benchmarks turn this off to measure the malloc-per-buffer baseline. */
+void arena_set_enabled(int enabled);
+
+#endif
@@ -0,0 +1,185 @@
+#include "assets.h"
+
+#include "logging.h"
+
+#ifndef MESSAGE_BOARD_DEV_ASSETS
+#include "embedded.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Static assets are compiled into the binary by tools/embed_assets; dev
+ * builds (MESSAGE_BOARD_DEV_ASSETS) read them from disk at startup instead,
+ * so scripts/dev.sh only has to restart the server. Either way they are
+ * hashed and gzip/deflate-compressed once at startup. Each one is reachable
+ * at its plain URL (revalidated through its ETag) and at a fingerprinted
+ * URL carrying the content hash, which never changes meaning and can be
+ * cached forever. The page template links the fingerprinted form.
+ */
+
+static struct Asset assets[] = {
+    {.name = "styles.css", .content_type = "text/css; charset=utf-8"},
+    {.name = "app.js", .content_type = "application/javascript; charset=utf-8"},
+};
+
+enum { ASSET_COUNT = sizeof(assets) / sizeof(assets[0]) };
+
+static char *read_file_to_string(const char *path, size_t *out_len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    long size = ftell(f);
+    if (size < 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    rewind(f);
+
+    char *buf = malloc((size_t)size + 1);
+    if (buf == NULL) {
+        fclose(f);
+        return NULL;
+    }
+
+    size_t read_n = fread(buf, 1, (size_t)size, f);
+    fclose(f);
+    if (read_n != (size_t)size) {
+        free(buf);
+        return NULL;
+    }
+
+    buf[size] = '\0';
+    *out_len = (size_t)size;
+    return buf;
+}
+
+static unsigned long long fnv1a_64(const char *data, size_t len)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+char *assets_read_file(const char *name, size_t *out_len)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "assets/%s", name);
+    char *data = read_file_to_string(path, out_len);
+    if (data == NULL) {
+        snprintf(path, sizeof(path), "build/assets/%s", name);
+        data = read_file_to_string(path, out_len);
+    }
+    return data;
+}
+
+static int load_asset(struct Asset *asset)
+{
+#ifdef MESSAGE_BOARD_DEV_ASSETS
+    asset->data = assets_read_file(asset->name, &asset->len);
+#else
+    for (size_t i = 0; i < embedded_file_count; ++i) {
+        if (strcmp(embedded_files[i].name, asset->name) == 0) {
+            asset->data = embedded_files[i].data;
+            asset->len = embedded_files[i].len;
+        }
+    }
+#endif
+    if (asset->data == NULL) {
+        log_error("Failed loading asset %s", asset->name);
+        return -1;
+    }
+
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", fnv1a_64(asset->data, asset->len));
+    snprintf(asset->etag, sizeof(asset->etag), "\"%s\"", hash);
+    snprintf(asset->url, sizeof(asset->url), "/assets/%s", asset->name);
+
+    /* Each coding gets its own ETag, since the bytes differ. */
+    for (int enc = ENCODING_IDENTITY + 1; enc < ENCODING_COUNT; ++enc) {
+        struct AssetVariant *variant = &asset->compressed[enc];
+        if (compress_body((enum Encoding)enc, asset->data, asset->len, &variant->data, &variant->len) == 0) {
+            snprintf(variant->etag, sizeof(variant->etag), "\"%s-%s\"", hash, compress_encoding_name((enum Encoding)enc));
+        }
+    }
+
+    /* app.js -> /assets/app.<hash>.js */
+    const char *dot = strrchr(asset->name, '.');
+    int stem_len = dot != NULL ? (int)(dot - asset->name) : (int)strlen(asset->name);
+    snprintf(asset->fingerprinted_url,
+             sizeof(asset->fingerprinted_url),
+             "/assets/%.*s.%s%s",
+             stem_len,
+             asset->name,
+             hash,
+             dot != NULL ? dot : "");
+    return 0;
+}
+
+int assets_init(void)
+{
+    for (size_t i = 0; i < ASSET_COUNT; ++i) {
+        if (load_asset(&assets[i]) != 0) {
+            assets_free();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void assets_free(void)
+{
+    for (size_t i = 0; i < ASSET_COUNT; ++i) {
+#ifdef MESSAGE_BOARD_DEV_ASSETS
+        free((char *)assets[i].data);
+#endif
+        assets[i].data = NULL;
+        assets[i].len = 0;
+        for (size_t enc = 0; enc < ENCODING_COUNT; ++enc) {
+            free(assets[i].compressed[enc].data);
+            assets[i].compressed[enc].data = NULL;
+        }
+    }
+}
+
+const struct Asset *assets_lookup(const char *url, int *fingerprinted)
+{
+    for (size_t i = 0; i < ASSET_COUNT; ++i) {
+        if (assets[i].data == NULL) {
+            continue;
+        }
+        if (strcmp(url, assets[i].url) == 0) {
+            *fingerprinted = 0;
+            return &assets[i];
+        }
+        if (strcmp(url, assets[i].fingerprinted_url) == 0) {
+            *fingerprinted = 1;
+            return &assets[i];
+        }
+    }
+    return NULL;
+}
+
+const struct Asset *assets_find(const char *name)
+{
+    for (size_t i = 0; i < ASSET_COUNT; ++i) {
+        if (assets[i].data != NULL && strcmp(name, assets[i].name) == 0) {
+            return &assets[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,32 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include "compress.h"
+
+#include <stddef.h>
+
+/* A compressed copy of an asset, with its own ETag. */
+struct AssetVariant {
+    char *data;
+    size_t len;
+    char etag[32];
+};
+
+struct Asset {
+    const char *name;
+    const char *content_type;
+    const char *data;
+    size_t len;
+    char etag[20];
+    char url[64];
+    char fingerprinted_url[96];
+    struct AssetVariant compressed[ENCODING_COUNT];
+};
+
+int assets_init(void);
+void assets_free(void);
+const struct Asset *assets_lookup(const char *url, int *fingerprinted);
+const struct Asset *assets_find(const char *name);
+char *assets_read_file(const char *name, size_t *out_len);
+
+#endif
@@ -0,0 +1,186 @@
+#include "cache.h"
+
+#include "hot.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * The newest-page bodies are built by the writer when it publishes the hot
+ * window and live in its snapshot. Readers take a reference to the current
+ * body inside the snapshot's epoch and hand its bytes to MHD without
+ * copying; the last reference frees it. Compressed forms are cached on the
+ * body, so a version is gzipped once however many clients fetch it.
+ */
+
+/*
+ * Built once per publish by the writer; hits are sharded metrics counters.
+ * Readers never render, so a miss is a request that found no snapshot to
+ * serve from: none published yet, or no epoch record free to read it.
+ */
+static atomic_ullong cache_builds[CACHE_KIND_COUNT];
+static atomic_ullong cache_misses[CACHE_KIND_COUNT];
+
+/*
+ * Distinguishes this process's versions from a previous run's: ids restart
+ * when the database is replaced, and a rebuild can change the page template.
+ */
+static unsigned long long cache_boot_id;
+
+void cache_init(void)
+{
+    cache_boot_id = (unsigned long long)time(NULL);
+}
+
+/* Weak, because gzip and identity bodies of one version share it. */
+void cache_etag(long long version, char *out, size_t size)
+{
+    snprintf(out, size, "W/\"%llx-%lld\"", cache_boot_id, version);
+}
+
+struct CachedBody *cache_body_new(enum CacheKind kind, long long version, char *data, size_t len)
+{
+    struct CachedBody *body = calloc(1, sizeof(*body));
+    if (body == NULL) {
+        free(data);
+        return NULL;
+    }
+
+    atomic_init(&body->refs, 1);
+    pthread_mutex_init(&body->variant_lock, NULL);
+    body->version = version;
+    body->len = len;
+    body->data = data;
+    atomic_fetch_add_explicit(&cache_builds[kind], 1, memory_order_relaxed);
+    return body;
+}
+
+void cache_release(struct CachedBody *body)
+{
+    if (body != NULL && atomic_fetch_sub_explicit(&body->refs, 1, memory_order_acq_rel) == 1) {
+        for (size_t i = 0; i < ENCODING_COUNT; ++i) {
+            free(body->variants[i].data);
+        }
+        pthread_mutex_destroy(&body->variant_lock);
+        free(body->data);
+        free(body);
+    }
+}
+
+struct CachedBody *cache_acquire(enum CacheKind kind)
+{
+    struct EpochRecord *guard = NULL;
+    const struct HotSnapshot *snap = hot_enter(&guard);
+    if (snap == NULL) {
+        atomic_fetch_add_explicit(&cache_misses[kind], 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    /* The snapshot holds its own reference until it is reclaimed, which
+     * cannot happen before hot_exit. */
+    struct CachedBody *body = snap->bodies[kind];
+    atomic_fetch_add_explicit(&body->refs, 1, memory_order_relaxed);
+    hot_exit(guard);
+
+    metrics_add((enum MetricCounter)(METRIC_CACHE_HITS_HOME + kind), 1);
+    return body;
+}
+
+void cache_get_stats(enum CacheKind kind, struct CacheStats *out)
+{
+    out->hits = metrics_counter((enum MetricCounter)(METRIC_CACHE_HITS_HOME + kind));
+    out->misses = atomic_load_explicit(&cache_misses[kind], memory_order_relaxed);
+    out->builds = atomic_load_explicit(&cache_builds[kind], memory_order_relaxed);
+}
+
+const char *cache_kind_name(enum CacheKind kind)
+{
+    switch (kind) {
+    case CACHE_HOME:
+        return "home";
+    case CACHE_MESSAGES_HTML:
+        return "messages_html";
+    case CACHE_MESSAGES_JSON:
+        return "messages_json";
+    default:
+        return "unknown";
+    }
+}
+
+static void cached_body_free_callback(void *cls)
+{
+    cache_release((struct CachedBody *)cls);
+}
+
+/* Returns the body's bytes in the given coding, falling back to identity. */
+static enum Encoding cached_variant(struct CachedBody *body, enum Encoding encoding, const char **data, size_t *len)
+{
+    *data = body->data;
+    *len = body->len;
+    if (encoding == ENCODING_IDENTITY) {
+        return ENCODING_IDENTITY;
+    }
+
+    /* Only the first request per coding takes the lock and compresses. */
+    struct CachedVariant *variant = &body->variants[encoding];
+    if (!atomic_load_explicit(&variant->ready, memory_order_acquire)) {
+        pthread_mutex_lock(&body->variant_lock);
+        if (!atomic_load_explicit(&variant->ready, memory_order_relaxed)) {
+            unsigned long long span = trace_begin();
+            if (compress_body(encoding, body->data, body->len, &variant->data, &variant->len) != 0) {
+                variant->data = NULL;
+            }
+            trace_end("compress", span);
+            atomic_store_explicit(&variant->ready, 1, memory_order_release);
+        }
+        pthread_mutex_unlock(&body->variant_lock);
+    }
+
+    if (variant->data == NULL) {
+        return ENCODING_IDENTITY;
+    }
+    *data = variant->data;
+    *len = variant->len;
+    return encoding;
+}
+
+int queue_cached_response(struct MHD_Connection *connection, const char *content_type, struct CachedBody *body)
+{
+    const char *data = NULL;
+    size_t len = 0;
+    enum Encoding encoding = cached_variant(body, compress_negotiate(connection), &data, &len);
+
+    struct MHD_Response *response = MHD_create_response_from_buffer_with_free_callback_cls(
+        len,
+        data,
+        &cached_body_free_callback,
+        body);
+    if (response == NULL) {
+        cache_release(body);
+        return MHD_NO;
+    }
+    metrics_add(METRIC_BODY_BYTES, len);
+
+    char cursor[32];
+    char etag[64];
+    snprintf(cursor, sizeof(cursor), "%lld", body->version);
+    cache_etag(body->version, etag, sizeof(etag));
+    MHD_add_response_header(response, "Content-Type", content_type);
+    MHD_add_response_header(response, "X-Message-Cursor", cursor);
+    MHD_add_response_header(response, "ETag", etag);
+    MHD_add_response_header(response, "Cache-Control", "no-cache");
+    MHD_add_response_header(response, "Vary", "Accept-Encoding");
+    if (encoding != ENCODING_IDENTITY) {
+        MHD_add_response_header(response, "Content-Encoding", compress_encoding_name(encoding));
+    }
+    unsigned long long span = trace_begin();
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    trace_end("MHD_queue_response", span);
+    MHD_destroy_response(response);
+    return ret;
+}
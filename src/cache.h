@@ -0,0 +1,54 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "compress.h"
+
+#include <microhttpd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+enum CacheKind {
+    CACHE_HOME,
+    CACHE_MESSAGES_HTML,
+    CACHE_MESSAGES_JSON,
+    CACHE_KIND_COUNT,
+};
+
+struct CachedVariant {
+    /* Set once data/len are final; NULL data means compression failed. */
+    atomic_int ready;
+    char *data;
+    size_t len;
+};
+
+/*
+ * Immutable rendered body shared by every reader of one message version.
+ * Compressed variants are filled in on first request under variant_lock.
+ */
+struct CachedBody {
+    atomic_int refs;
+    long long version;
+    size_t len;
+    char *data;
+    pthread_mutex_t variant_lock;
+    struct CachedVariant variants[ENCODING_COUNT];
+};
+
+struct CacheStats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long builds;
+};
+
+void cache_init(void);
+void cache_etag(long long version, char *out, size_t size);
+/* Takes ownership of data, freeing it on failure. */
+struct CachedBody *cache_body_new(enum CacheKind kind, long long version, char *data, size_t len);
+struct CachedBody *cache_acquire(enum CacheKind kind);
+void cache_release(struct CachedBody *body);
+void cache_get_stats(enum CacheKind kind, struct CacheStats *out);
+const char *cache_kind_name(enum CacheKind kind);
+int queue_cached_response(struct MHD_Connection *connection, const char *content_type, struct CachedBody *body);
+
+#endif
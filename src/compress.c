@@ -0,0 +1,130 @@
+#include "compress.h"
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+/*
+ * Accept-Encoding negotiation and one-shot zlib compression. Callers cache
+ * the result next to the identity body, so each body is compressed at most
+ * once per encoding.
+ */
+
+/* Returns the q-value (0..1000) the header gives coding, or -1 if unlisted. */
+static int coding_quality(const char *header, const char *coding)
+{
+    size_t coding_len = strlen(coding);
+    int wildcard = -1;
+    const char *p = header;
+
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+        const char *token = p;
+        while (*p != '\0' && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        size_t token_len = (size_t)(p - token);
+
+        int quality = 1000;
+        while (*p != '\0' && *p != ',') {
+            if (*p == ';') {
+                const char *param = p + 1;
+                while (*param == ' ' || *param == '\t') {
+                    param++;
+                }
+                if ((param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                    double q = strtod(param + 2, NULL);
+                    quality = q <= 0 ? 0 : q >= 1 ? 1000 : (int)(q * 1000);
+                }
+            }
+            p++;
+        }
+
+        if (token_len == coding_len && strncasecmp(token, coding, coding_len) == 0) {
+            return quality;
+        }
+        if (token_len == 1 && token[0] == '*') {
+            wildcard = quality;
+        }
+    }
+    return wildcard;
+}
+
+enum Encoding compress_negotiate(struct MHD_Connection *connection)
+{
+    const char *header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept-Encoding");
+    if (header == NULL) {
+        return ENCODING_IDENTITY;
+    }
+
+    /* gzip wins ties: it is what every browser sends first. */
+    int gzip = coding_quality(header, "gzip");
+    int deflate = coding_quality(header, "deflate");
+    if (gzip > 0 && gzip >= deflate) {
+        return ENCODING_GZIP;
+    }
+    if (deflate > 0) {
+        return ENCODING_DEFLATE;
+    }
+    return ENCODING_IDENTITY;
+}
+
+const char *compress_encoding_name(enum Encoding encoding)
+{
+    switch (encoding) {
+    case ENCODING_GZIP:
+        return "gzip";
+    case ENCODING_DEFLATE:
+        return "deflate";
+    default:
+        return "identity";
+    }
+}
+
+/*
+ * Compresses data with the given coding ("deflate" is the zlib format, per
+ * RFC 9110). Returns -1 when the body is too small to bother with or would
+ * not shrink, in which case the caller serves identity.
+ */
+int compress_body(enum Encoding encoding, const char *data, size_t len, char **out, size_t *out_len)
+{
+    if (encoding == ENCODING_IDENTITY || len < COMPRESSION_MIN_SIZE) {
+        return -1;
+    }
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    int window_bits = encoding == ENCODING_GZIP ? 15 + 16 : 15;
+    if (deflateInit2(&zs, COMPRESSION_LEVEL, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+
+    size_t cap = deflateBound(&zs, (uLong)len);
+    char *buf = malloc(cap);
+    if (buf == NULL) {
+        deflateEnd(&zs);
+        return -1;
+    }
+
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = (uInt)len;
+    zs.next_out = (Bytef *)buf;
+    zs.avail_out = (uInt)cap;
+    int rc = deflate(&zs, Z_FINISH);
+    size_t produced = cap - zs.avail_out;
+    deflateEnd(&zs);
+
+    if (rc != Z_STREAM_END || produced >= len) {
+        free(buf);
+        return -1;
+    }
+
+    *out = buf;
+    *out_len = produced;
+    return 0;
+}
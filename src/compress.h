@@ -0,0 +1,18 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <microhttpd.h>
+#include <stddef.h>
+
+enum Encoding {
+    ENCODING_IDENTITY,
+    ENCODING_GZIP,
+    ENCODING_DEFLATE,
+    ENCODING_COUNT,
+};
+
+enum Encoding compress_negotiate(struct MHD_Connection *connection);
+const char *compress_encoding_name(enum Encoding encoding);
+int compress_body(enum Encoding encoding, const char *data, size_t len, char **out, size_t *out_len);
+
+#endif
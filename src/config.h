@@ -5,5 +5,39 @@
 #define MAX_NICKNAME 64
 #define MAX_CLIENT_ID 80
 #define MAX_MESSAGE 1024
+#define MESSAGE_PAGE_SIZE 50
+#define MESSAGE_PAGE_MAX 200
+/* Largest accepted POST body: every field fully percent-encoded, plus slack. */
+#define MAX_POST_BODY 8192
+
+#define MAX_CONNECTIONS 16384
+#define SSE_HEARTBEAT_SECONDS 15
+/* Newest messages held in memory: the newest page, recent since=/before=
+ * pages and SSE replay are served from them without touching SQLite. */
+#define HOT_WINDOW_MESSAGES 256
+
+#define DB_BUSY_TIMEOUT_MS 5000
+#define WRITE_BATCH_MAX 256
+#define WRITE_BATCH_DELAY_MS 2
+/* Rows per transaction when the writer re-renders stale message fragments. */
+#define FRAGMENT_REFRESH_BATCH 256
+/* Idle wait before retrying a refresh step that failed. */
+#define FRAGMENT_REFRESH_RETRY_MS 1000
+
+/* Log records queued for the flusher thread (a power of two); records longer
+ * than LOG_RECORD_MAX bytes are truncated. */
+#define LOG_RING_RECORDS 4096
+#define LOG_RECORD_MAX 512
+
+/* Metric shards; threads beyond this many share one. */
+#define METRICS_SHARDS 64
+
+/* Spans one trace holds, its root included; later spans are dropped. */
+#define TRACE_MAX_EVENTS 64
+/* Finished traces kept for /debug/trace; the oldest is freed first. */
+#define TRACE_KEEP 256
+
+#define COMPRESSION_LEVEL 6
+#define COMPRESSION_MIN_SIZE 256
 
 #endif
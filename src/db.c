@@ -1,15 +1,54 @@
 #include "db.h"
 
+#include "arena.h"
+#include "config.h"
+#include "db_stmt.h"
 #include "db_tags.h"
 #include "logging.h"
+#include "render.h"
+#include "trace.h"
 #include "util.h"
 
+#include <pthread.h>
 #include <sqlite3.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+/*
+ * The database runs in WAL mode with one read-write connection and a pool
+ * of read-only ones. db is the write connection: schema setup and inserts
+ * (from the writer thread) use it. Request-path reads check out a reader
+ * for the duration of one query. WAL lets readers run in parallel with each
+ * other and with a commit, each seeing the last committed snapshot.
+ */
 static sqlite3 *db;
+static struct DbConn write_conn;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_available = PTHREAD_COND_INITIALIZER;
+static struct DbConn *readers;
+static struct DbConn **free_readers;
+static unsigned int reader_count;
+static unsigned int free_count;
+static struct DbPoolStats pool_stats;
+/* Rowid of the newest committed message; doubles as the content version. */
+static atomic_llong latest_message_id;
+
+/*
+ * Messages never change, so each row stores its <li> and JSON renderings,
+ * written with the row and tagged with RENDER_FRAGMENT_VERSION. Reads
+ * concatenate them and only render rows whose fragments are missing or
+ * stale. render_state holds the version every row was last brought up to;
+ * while it lags, the writer re-renders rows newest first between batches.
+ * All of this is writer-thread state, like write_conn.
+ */
+static struct Arena fragment_arena;
+static int fragments_current;
+static long long refresh_cursor = INT64_MAX;
 
 static int table_has_column(const char *column_name)
 {
@@ -32,10 +71,10 @@ static int table_has_column(const char *column_name)
     return found;
 }
 
-static int exec_sql(const char *sql)
+static int exec_sql(sqlite3 *conn, const char *sql)
 {
     char *err_msg = NULL;
-    int rc = sqlite3_exec(db, sql, NULL, NULL, &err_msg);
+    int rc = sqlite3_exec(conn, sql, NULL, NULL, &err_msg);
     if (rc != SQLITE_OK) {
         log_error("SQL error: %s", err_msg ? err_msg : "unknown");
         sqlite3_free(err_msg);
@@ -45,16 +84,117 @@ static int exec_sql(const char *sql)
     return 0;
 }
 
-int db_init(void)
+static long long query_latest_message_id(void)
 {
-    log_info("Initializing database");
+    sqlite3_stmt *stmt = NULL;
+    long long id = 0;
 
-    if (sqlite3_open("messages.db", &db) != SQLITE_OK) {
-        log_error("Cannot open database: %s", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    if (sqlite3_prepare_v2(db, "SELECT MAX(rowid) FROM messages", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        id = sqlite3_column_int64(stmt, 0);
+    }
+
+    sqlite3_finalize(stmt);
+    return id;
+}
+
+static void close_readers(void)
+{
+    for (unsigned int i = 0; i < reader_count; ++i) {
+        db_stmt_finalize_all(&readers[i]);
+        sqlite3_close(readers[i].handle);
+    }
+    free(readers);
+    free(free_readers);
+    readers = NULL;
+    free_readers = NULL;
+    reader_count = 0;
+    free_count = 0;
+}
+
+static int open_readers(unsigned int count)
+{
+    readers = calloc(count, sizeof(*readers));
+    free_readers = calloc(count, sizeof(*free_readers));
+    if (readers == NULL || free_readers == NULL) {
+        close_readers();
         return -1;
     }
 
+    for (unsigned int i = 0; i < count; ++i) {
+        /* NOMUTEX: a checked-out reader is only ever used by one thread. */
+        if (sqlite3_open_v2("messages.db", &readers[i].handle, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK) {
+            log_error("Cannot open read connection: %s", sqlite3_errmsg(readers[i].handle));
+            sqlite3_close(readers[i].handle);
+            readers[i].handle = NULL;
+            close_readers();
+            return -1;
+        }
+        sqlite3_busy_timeout(readers[i].handle, DB_BUSY_TIMEOUT_MS);
+        reader_count++;
+        free_readers[free_count++] = &readers[i];
+    }
+    return 0;
+}
+
+static double elapsed_us(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1e6 + (double)(now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static struct DbConn *reader_acquire(void)
+{
+    unsigned long long span = trace_begin();
+    pthread_mutex_lock(&pool_lock);
+    pool_stats.acquires++;
+    if (free_count == 0) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (free_count == 0) {
+            pthread_cond_wait(&pool_available, &pool_lock);
+        }
+        double waited = elapsed_us(&start);
+        pool_stats.waits++;
+        pool_stats.wait_us_total += waited;
+        if (waited > pool_stats.wait_us_max) {
+            pool_stats.wait_us_max = waited;
+        }
+    }
+    struct DbConn *conn = free_readers[--free_count];
+    pthread_mutex_unlock(&pool_lock);
+    trace_end("read pool acquire", span);
+    return conn;
+}
+
+static void reader_release(struct DbConn *conn)
+{
+    pthread_mutex_lock(&pool_lock);
+    free_readers[free_count++] = conn;
+    pthread_cond_signal(&pool_available);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void db_get_pool_stats(struct DbPoolStats *out)
+{
+    pthread_mutex_lock(&pool_lock);
+    *out = pool_stats;
+    out->size = reader_count;
+    out->in_use = reader_count - free_count;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * Schema changes and data backfills, oldest first. Each runs once, in one
+ * transaction that also advances PRAGMA user_version to its position in
+ * this list, so a restart of an up-to-date database touches no message rows.
+ * Append new migrations; never reorder or edit applied ones.
+ */
+static int migrate_schema(void)
+{
     const char *create_sql =
         "CREATE TABLE IF NOT EXISTS messages("
         "content TEXT,"
@@ -65,307 +205,648 @@ int db_init(void)
         "created_at INTEGER DEFAULT (strftime('%s','now'))"
         ")";
 
-    if (exec_sql(create_sql) != 0) {
-        sqlite3_close(db);
+    if (exec_sql(db, create_sql) != 0) {
         return -1;
     }
-    if (exec_sql("CREATE TABLE IF NOT EXISTS nickname_tags(nickname TEXT NOT NULL, client_id TEXT NOT NULL, tag INTEGER NOT NULL, UNIQUE(nickname, client_id), UNIQUE(nickname, tag))") != 0) {
-        sqlite3_close(db);
+    if (exec_sql(db, "CREATE TABLE IF NOT EXISTS nickname_tags(nickname TEXT NOT NULL, client_id TEXT NOT NULL, tag INTEGER NOT NULL, UNIQUE(nickname, client_id), UNIQUE(nickname, tag))") != 0) {
         return -1;
     }
 
-    if (!table_has_column("nickname") && exec_sql("ALTER TABLE messages ADD COLUMN nickname TEXT DEFAULT 'anon'") != 0) {
-        sqlite3_close(db);
+    if (!table_has_column("nickname") && exec_sql(db, "ALTER TABLE messages ADD COLUMN nickname TEXT DEFAULT 'anon'") != 0) {
         return -1;
     }
-    if (!table_has_column("client_id") && exec_sql("ALTER TABLE messages ADD COLUMN client_id TEXT DEFAULT 'legacy'") != 0) {
-        sqlite3_close(db);
+    if (!table_has_column("client_id") && exec_sql(db, "ALTER TABLE messages ADD COLUMN client_id TEXT DEFAULT 'legacy'") != 0) {
         return -1;
     }
-    if (!table_has_column("user_tag") && exec_sql("ALTER TABLE messages ADD COLUMN user_tag INTEGER DEFAULT -1") != 0) {
-        sqlite3_close(db);
+    if (!table_has_column("user_tag") && exec_sql(db, "ALTER TABLE messages ADD COLUMN user_tag INTEGER DEFAULT -1") != 0) {
         return -1;
     }
-    if (!table_has_column("created_at") && exec_sql("ALTER TABLE messages ADD COLUMN created_at INTEGER DEFAULT 0") != 0) {
-        sqlite3_close(db);
+    if (!table_has_column("created_at") && exec_sql(db, "ALTER TABLE messages ADD COLUMN created_at INTEGER DEFAULT 0") != 0) {
         return -1;
     }
 
-    if (exec_sql("UPDATE messages SET nickname='anon' WHERE nickname IS NULL OR nickname = ''") != 0 ||
-        exec_sql("UPDATE messages SET client_id='legacy' WHERE client_id IS NULL OR client_id = ''") != 0 ||
-        exec_sql("UPDATE messages SET created_at=strftime('%s','now') WHERE created_at IS NULL OR created_at = 0") != 0) {
-        sqlite3_close(db);
+    if (exec_sql(db, "UPDATE messages SET nickname='anon' WHERE nickname IS NULL OR nickname = ''") != 0 ||
+        exec_sql(db, "UPDATE messages SET client_id='legacy' WHERE client_id IS NULL OR client_id = ''") != 0 ||
+        exec_sql(db, "UPDATE messages SET created_at=strftime('%s','now') WHERE created_at IS NULL OR created_at = 0") != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int migrate_tags(void)
+{
+    return db_tags_backfill(&write_conn);
+}
+
+/* Existing rows get their fragments from the writer's background refresh. */
+static int migrate_fragments(void)
+{
+    if (exec_sql(db, "ALTER TABLE messages ADD COLUMN html_fragment TEXT") != 0 ||
+        exec_sql(db, "ALTER TABLE messages ADD COLUMN json_fragment TEXT") != 0 ||
+        exec_sql(db, "ALTER TABLE messages ADD COLUMN fragment_version INTEGER NOT NULL DEFAULT 0") != 0) {
+        return -1;
+    }
+    if (exec_sql(db, "CREATE TABLE render_state(fragment_version INTEGER NOT NULL)") != 0 ||
+        exec_sql(db, "INSERT INTO render_state(fragment_version) VALUES(0)") != 0) {
         return -1;
     }
+    return 0;
+}
+
+static int (*const migrations[])(void) = {
+    migrate_schema,
+    migrate_tags,
+    migrate_fragments,
+};
 
-    if (db_tags_backfill(db) != 0) {
+static int schema_version(void)
+{
+    sqlite3_stmt *stmt = NULL;
+    int version = -1;
+
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+static int run_migrations(void)
+{
+    int latest = (int)(sizeof(migrations) / sizeof(migrations[0]));
+    int version = schema_version();
+    if (version < 0) {
+        return -1;
+    }
+    if (version > latest) {
+        log_error("Database schema version %d is newer than this build (%d)", version, latest);
+        return -1;
+    }
+
+    for (int i = version; i < latest; ++i) {
+        log_info("Applying database migration %d", i + 1);
+        if (exec_sql(db, "BEGIN IMMEDIATE") != 0) {
+            return -1;
+        }
+
+        char sql[64];
+        snprintf(sql, sizeof(sql), "PRAGMA user_version = %d", i + 1);
+        if (migrations[i]() != 0 || exec_sql(db, sql) != 0 || exec_sql(db, "COMMIT") != 0) {
+            log_error("Database migration %d failed", i + 1);
+            exec_sql(db, "ROLLBACK");
+            db_tags_rollback(0);
+            return -1;
+        }
+        /* The tags backfill assigns through the map; db_tags_load reloads it after. */
+        db_tags_commit();
+    }
+    return 0;
+}
+
+static int load_fragment_version(void)
+{
+    sqlite3_stmt *stmt = NULL;
+    int version = -1;
+
+    if (sqlite3_prepare_v2(db, "SELECT fragment_version FROM render_state", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Cannot read render state: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    fragments_current = version == RENDER_FRAGMENT_VERSION;
+    refresh_cursor = INT64_MAX;
+    if (!fragments_current) {
+        log_info("Stored message fragments are version %d, re-rendering as version %d", version, RENDER_FRAGMENT_VERSION);
+    }
+    return 0;
+}
+
+int db_init(unsigned int read_connections)
+{
+    log_info("Initializing database");
+
+    if (read_connections == 0) {
+        read_connections = 1;
+    }
+
+    if (sqlite3_open("messages.db", &db) != SQLITE_OK) {
+        log_error("Cannot open database: %s", sqlite3_errmsg(db));
         sqlite3_close(db);
+        db = NULL;
+        return -1;
+    }
+    sqlite3_busy_timeout(db, DB_BUSY_TIMEOUT_MS);
+
+    /* WAL is persistent in the file; readers opened below inherit it. */
+    if (exec_sql(db, "PRAGMA journal_mode=WAL") != 0) {
+        db_close();
+        return -1;
+    }
+
+    write_conn.handle = db;
+    if (run_migrations() != 0 || load_fragment_version() != 0 || db_tags_load(&write_conn) != 0 ||
+        open_readers(read_connections) != 0) {
+        db_close();
         return -1;
     }
 
+    atomic_store(&latest_message_id, query_latest_message_id());
+
     log_info("Database initialized successfully");
     return 0;
 }
 
 void db_close(void)
 {
+    close_readers();
     if (db != NULL) {
+        db_stmt_finalize_all(&write_conn);
+        write_conn.handle = NULL;
         sqlite3_close(db);
         db = NULL;
     }
+    db_tags_free();
+    arena_release(&fragment_arena);
 }
 
-int db_insert_message(const char *nickname, const char *client_id, const char *content)
+/* Renders both fragments into fragment_arena and points the record at them. */
+static int render_fragments(struct MessageRecord *m)
+{
+    struct Buffer html = {.arena = &fragment_arena};
+    struct Buffer json = {.arena = &fragment_arena};
+    if (render_message_html(&html, m) != 0 || render_message_json(&json, m) != 0) {
+        return -1;
+    }
+
+    m->html_fragment = html.data;
+    m->html_len = html.len;
+    m->json_fragment = json.data;
+    m->json_len = json.len;
+    return 0;
+}
+
+/* The writer holds the write lock, so the row takes the id it was given. */
+static int insert_one(struct MessageInsert *m, long long id, const char *timestamp)
 {
     int user_tag = -1;
-    if (db_tags_get_or_assign(db, nickname, client_id, &user_tag) != 0) {
+    if (db_tags_get_or_assign(&write_conn, m->nickname, m->client_id, &user_tag) != 0) {
         return -1;
     }
 
-    sqlite3_stmt *stmt = NULL;
-    const char *sql =
-        "INSERT INTO messages(content, timestamp, nickname, client_id, user_tag, created_at) "
-        "VALUES(?, ?, ?, ?, ?, strftime('%s','now'))";
+    m->record = (struct MessageRecord){.id = id, .nickname = m->nickname, .content = m->content, .tag = user_tag};
+    snprintf(m->record.timestamp, sizeof(m->record.timestamp), "%s", timestamp);
+    unsigned long long span = trace_begin();
+    if (render_fragments(&m->record) != 0) {
+        return -1;
+    }
+    trace_end("render fragments", span);
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    sqlite3_stmt *stmt = db_stmt(&write_conn, STMT_MESSAGE_INSERT);
+    if (stmt == NULL) {
         return -1;
     }
+    sqlite3_bind_int64(stmt, 1, id);
+    sqlite3_bind_text(stmt, 2, m->content, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, timestamp, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, m->nickname, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, m->client_id, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 6, user_tag);
+    sqlite3_bind_text(stmt, 7, m->record.html_fragment, (int)m->record.html_len, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 8, m->record.json_fragment, (int)m->record.json_len, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 9, RENDER_FRAGMENT_VERSION);
+
+    span = trace_begin();
+    int rc = sqlite3_step(stmt);
+    db_stmt_done(stmt);
+    trace_end("sqlite insert", span);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+static long long max_message_id(void)
+{
+    sqlite3_stmt *stmt = db_stmt(&write_conn, STMT_MESSAGES_MAX_ID);
+    if (stmt == NULL) {
+        return -1;
+    }
+    long long id = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+    db_stmt_done(stmt);
+    return id;
+}
+
+/*
+ * Inserts a batch in one transaction, so the journal is synced once per
+ * batch rather than once per statement. Each row runs in a savepoint: a
+ * failed row is rolled back and marked !ok without failing the rest.
+ * Returns the number of rows committed, or -1 if the transaction failed.
+ */
+int db_insert_messages(struct MessageInsert *batch, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        batch[i].ok = 0;
+    }
 
     time_t now = time(NULL);
     struct tm tm_now;
     localtime_r(&now, &tm_now);
 
-    char timestamp[64];
+    char timestamp[32];
     if (strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_now) == 0) {
-        sqlite3_finalize(stmt);
         return -1;
     }
 
-    sqlite3_bind_text(stmt, 1, content, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, timestamp, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, nickname, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 4, client_id, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 5, user_tag);
+    unsigned long long span = trace_begin();
+    if (exec_sql(write_conn.handle, "BEGIN IMMEDIATE") != 0) {
+        return -1;
+    }
+    trace_end("sqlite begin", span);
+    long long newest = max_message_id();
+    if (newest < 0) {
+        exec_sql(write_conn.handle, "ROLLBACK");
+        return -1;
+    }
 
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    return rc == SQLITE_DONE ? 0 : -1;
+    /* The previous batch's records have been published by now. */
+    arena_reset(&fragment_arena);
+    size_t batch_tags = db_tags_mark();
+    int inserted = 0;
+    for (size_t i = 0; i < count; ++i) {
+        struct MessageInsert *m = &batch[i];
+        size_t message_tags = db_tags_mark();
+        if (exec_sql(write_conn.handle, "SAVEPOINT message") != 0) {
+            break;
+        }
+        if (insert_one(m, newest + 1, timestamp) != 0) {
+            log_error("Failed inserting message: %s", sqlite3_errmsg(write_conn.handle));
+            exec_sql(write_conn.handle, "ROLLBACK TO message");
+            db_tags_rollback(message_tags);
+        } else {
+            m->ok = 1;
+            inserted++;
+            newest = m->record.id;
+        }
+        exec_sql(write_conn.handle, "RELEASE message");
+    }
+
+    span = trace_begin();
+    if (exec_sql(write_conn.handle, "COMMIT") != 0) {
+        exec_sql(write_conn.handle, "ROLLBACK");
+        db_tags_rollback(batch_tags);
+        for (size_t i = 0; i < count; ++i) {
+            batch[i].ok = 0;
+        }
+        return -1;
+    }
+    db_tags_commit();
+    trace_end("sqlite commit", span);
+
+    /* Publish only after the rows are committed so a render keyed by this
+     * version always sees them. */
+    long long seen = atomic_load_explicit(&latest_message_id, memory_order_relaxed);
+    while (newest > seen &&
+           !atomic_compare_exchange_weak_explicit(&latest_message_id, &seen, newest, memory_order_release, memory_order_relaxed)) {
+    }
+    return inserted;
 }
 
-static char *json_escape(const char *src)
+long long db_latest_message_id(void)
 {
-    struct Buffer out = {0};
+    return atomic_load_explicit(&latest_message_id, memory_order_acquire);
+}
 
-    for (const unsigned char *p = (const unsigned char *)src; *p != '\0'; ++p) {
-        int rc = 0;
-        switch (*p) {
-        case '\"':
-            rc = buffer_append(&out, "\\\"");
-            break;
-        case '\\':
-            rc = buffer_append(&out, "\\\\");
-            break;
-        case '\b':
-            rc = buffer_append(&out, "\\b");
-            break;
-        case '\f':
-            rc = buffer_append(&out, "\\f");
-            break;
-        case '\n':
-            rc = buffer_append(&out, "\\n");
-            break;
-        case '\r':
-            rc = buffer_append(&out, "\\r");
-            break;
-        case '\t':
-            rc = buffer_append(&out, "\\t");
-            break;
-        default:
-            if (*p < 0x20) {
-                rc = buffer_appendf(&out, "\\u%04x", *p);
-            } else {
-                rc = buffer_appendf(&out, "%c", *p);
+static void row_to_record(sqlite3_stmt *stmt, struct MessageRecord *m)
+{
+    const char *nickname = (const char *)sqlite3_column_text(stmt, 1);
+    const char *content = (const char *)sqlite3_column_text(stmt, 2);
+    const char *timestamp = (const char *)sqlite3_column_text(stmt, 3);
+
+    m->id = sqlite3_column_int64(stmt, 0);
+    m->nickname = nickname ? nickname : "anon";
+    m->content = content ? content : "";
+    m->tag = sqlite3_column_int(stmt, 4);
+    if (m->tag <= 0 || m->tag > 9999) {
+        m->tag = 1;
+    }
+    snprintf(m->timestamp, sizeof(m->timestamp), "%s", timestamp ? timestamp : "");
+
+    m->html_fragment = NULL;
+    m->json_fragment = NULL;
+    m->html_len = 0;
+    m->json_len = 0;
+    const char *html = (const char *)sqlite3_column_text(stmt, 5);
+    const char *json = (const char *)sqlite3_column_text(stmt, 6);
+    if (html != NULL && json != NULL && sqlite3_column_int(stmt, 7) == RENDER_FRAGMENT_VERSION) {
+        m->html_fragment = html;
+        m->html_len = (size_t)sqlite3_column_bytes(stmt, 5);
+        m->json_fragment = json;
+        m->json_len = (size_t)sqlite3_column_bytes(stmt, 6);
+    }
+}
+
+/*
+ * Reads walk the rowid b-tree directly: rowid is the table's clustered key
+ * and grows with insertion order, so "newest N" and "N before cursor" are a
+ * seek plus N steps regardless of table size, with no sort.
+ */
+static int render_rows(sqlite3_stmt *stmt, int as_json, struct Buffer *out, int limit, long long *first_id, long long *last_id)
+{
+    int rc = 0;
+    int row_count = 0;
+    while (rc == 0 && row_count < limit && sqlite3_step(stmt) == SQLITE_ROW) {
+        struct MessageRecord m;
+        row_to_record(stmt, &m);
+        if (as_json) {
+            if (row_count > 0) {
+                rc |= buffer_append_len(out, ",", 1);
             }
-            break;
+            rc |= m.json_fragment != NULL ? buffer_append_len(out, m.json_fragment, m.json_len) : render_message_json(out, &m);
+        } else {
+            rc |= m.html_fragment != NULL ? buffer_append_len(out, m.html_fragment, m.html_len) : render_message_html(out, &m);
         }
-
-        if (rc != 0) {
-            free(out.data);
-            return NULL;
+        if (row_count == 0) {
+            *first_id = m.id;
         }
+        *last_id = m.id;
+        row_count++;
     }
+    return rc != 0 ? -1 : row_count;
+}
 
-    if (out.data == NULL) {
-        out.data = strdup("");
+static int has_rows_before(struct DbConn *conn, long long id)
+{
+    sqlite3_stmt *stmt = db_stmt(conn, STMT_MESSAGES_EXIST_BEFORE);
+    if (stmt == NULL) {
+        return 0;
     }
-    return out.data;
+    sqlite3_bind_int64(stmt, 1, id);
+    int found = sqlite3_step(stmt) == SQLITE_ROW;
+    db_stmt_done(stmt);
+    return found;
 }
 
-static unsigned int nickname_hue(const char *nickname)
+/* Appends up to `limit` rows older than `before`, oldest first. */
+static int render_rows_before(struct DbConn *conn, long long before, int limit, int as_json, struct Buffer *out, struct MessagePage *page)
 {
-    unsigned int hash = 5381u;
-    for (const unsigned char *p = (const unsigned char *)nickname; *p != '\0'; ++p) {
-        hash = ((hash << 5) + hash) ^ (unsigned int)(*p);
+    sqlite3_stmt *stmt = db_stmt(conn, STMT_MESSAGES_BEFORE);
+    if (stmt == NULL) {
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, before);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    long long first_id = before;
+    long long last_id = before;
+    int rows = render_rows(stmt, as_json, out, limit, &first_id, &last_id);
+    db_stmt_done(stmt);
+    if (rows < 0) {
+        return -1;
     }
-    return hash % 360u;
+
+    page->cursor = first_id;
+    page->more = rows == limit && has_rows_before(conn, first_id);
+    return rows;
 }
 
-char *db_render_messages_html(void)
+/* Appends up to `limit` rows newer than `since`, oldest first. */
+static int render_rows_since(struct DbConn *conn, long long since, int limit, int as_json, struct Buffer *out, struct MessagePage *page)
 {
-    const char *sql =
-        "SELECT m.nickname, m.content, m.timestamp, m.user_tag "
-        "FROM ("
-        "SELECT nickname, content, timestamp, user_tag, created_at "
-        "FROM messages ORDER BY created_at DESC LIMIT 50"
-        ") AS m "
-        "ORDER BY m.created_at ASC";
+    sqlite3_stmt *stmt = db_stmt(conn, STMT_MESSAGES_SINCE);
+    if (stmt == NULL) {
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, since);
+    sqlite3_bind_int(stmt, 2, limit + 1);
+
+    long long first_id = since;
+    long long last_id = since;
+    int rows = render_rows(stmt, as_json, out, limit, &first_id, &last_id);
+    page->more = rows == limit && sqlite3_step(stmt) == SQLITE_ROW;
+    db_stmt_done(stmt);
+    if (rows < 0) {
+        return -1;
+    }
 
-    sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return strdup("<li class=\"rounded-lg border border-red-200 bg-red-50 px-3 py-2 text-sm text-red-700 dark:border-red-900 dark:bg-red-950/40 dark:text-red-200\">Failed to load messages.</li>");
+    page->cursor = last_id;
+    return rows;
+}
+
+/* Reads one page on a pooled read connection. */
+static int render_rows_page(long long cursor, int limit, int newer, int as_json, struct Buffer *out, struct MessagePage *page)
+{
+    struct DbConn *conn = reader_acquire();
+    unsigned long long span = trace_begin();
+    int rows = newer ? render_rows_since(conn, cursor, limit, as_json, out, page)
+                     : render_rows_before(conn, cursor, limit, as_json, out, page);
+    trace_end("sqlite page read", span);
+    reader_release(conn);
+    return rows;
+}
+
+/* Calls fn on the newest `limit` messages, oldest first. Returns the row count. */
+int db_read_newest(int limit, int (*fn)(const struct MessageRecord *m, void *ctx), void *ctx)
+{
+    struct DbConn *conn = reader_acquire();
+    sqlite3_stmt *stmt = db_stmt(conn, STMT_MESSAGES_BEFORE);
+    if (stmt == NULL) {
+        reader_release(conn);
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, INT64_MAX);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    int rows = 0;
+    while (rows >= 0 && sqlite3_step(stmt) == SQLITE_ROW) {
+        struct MessageRecord m;
+        row_to_record(stmt, &m);
+        rows = fn(&m, ctx) == 0 ? rows + 1 : -1;
     }
+    db_stmt_done(stmt);
+    reader_release(conn);
+    return rows;
+}
 
-    struct Buffer out = {0};
+char *db_render_messages_html(void)
+{
+    struct Buffer out = {.arena = arena_thread()};
+    struct MessagePage page;
     if (buffer_append(&out, "") != 0) {
-        sqlite3_finalize(stmt);
         return strdup("<li class=\"rounded-lg border border-red-200 bg-red-50 px-3 py-2 text-sm text-red-700 dark:border-red-900 dark:bg-red-950/40 dark:text-red-200\">Failed to render messages.</li>");
     }
 
-    int row_count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        row_count++;
-        const char *nickname = (const char *)sqlite3_column_text(stmt, 0);
-        const char *content = (const char *)sqlite3_column_text(stmt, 1);
-        const char *timestamp = (const char *)sqlite3_column_text(stmt, 2);
-        int user_tag = sqlite3_column_int(stmt, 3);
-        if (user_tag <= 0 || user_tag > 9999) {
-            user_tag = 1;
-        }
-        unsigned int hue = nickname_hue(nickname ? nickname : "anon");
-
-        char *nick_esc = html_escape(nickname ? nickname : "anon");
-        char *content_esc = html_escape(content ? content : "");
-        char *time_esc = html_escape(timestamp ? timestamp : "");
-
-        if (nick_esc == NULL || content_esc == NULL || time_esc == NULL) {
-            free(nick_esc);
-            free(content_esc);
-            free(time_esc);
-            free(out.data);
-            sqlite3_finalize(stmt);
-            return strdup("<li class=\"rounded-lg border border-red-200 bg-red-50 px-3 py-2 text-sm text-red-700 dark:border-red-900 dark:bg-red-950/40 dark:text-red-200\">Failed to render messages.</li>");
-        }
+    int rows = render_rows_page(INT64_MAX, MESSAGE_PAGE_SIZE, 0, 0, &out, &page);
+    if (rows < 0) {
+        buffer_free(&out);
+        return strdup("<li class=\"rounded-lg border border-red-200 bg-red-50 px-3 py-2 text-sm text-red-700 dark:border-red-900 dark:bg-red-950/40 dark:text-red-200\">Failed to load messages.</li>");
+    }
 
-        int rc = buffer_appendf(
-            &out,
-            "<li class=\"msg-item mb-2 rounded-lg border border-slate-200 bg-white px-3 py-2 shadow-sm last:mb-0 dark:border-slate-700 dark:bg-slate-900\" style=\"border-left:4px solid hsl(%u 72%% 46%%)\">"
-            "<div class=\"mb-1 grid grid-cols-[1fr_auto] items-center gap-x-2 text-xs\">"
-            "<span class=\"font-semibold\" style=\"color:hsl(%u 75%% 30%%)\">%s</span>"
-            "<span class=\"msg-tag rounded bg-slate-100 px-2 py-0.5 font-mono text-[11px] tracking-wide text-slate-700 dark:bg-slate-800 dark:text-slate-200\">#%04d</span>"
-            "<span class=\"msg-time col-span-2 text-[11px] text-slate-500 dark:text-slate-400\">%s</span>"
-            "</div>"
-            "<div class=\"msg-content whitespace-pre-wrap break-words text-sm text-slate-800 dark:text-slate-200\">%s</div>"
-            "</li>",
-            hue,
-            hue,
-            nick_esc,
-            user_tag,
-            time_esc,
-            content_esc);
-
-        free(nick_esc);
-        free(content_esc);
-        free(time_esc);
-
-        if (rc != 0) {
-            free(out.data);
-            sqlite3_finalize(stmt);
-            return strdup("<li class=\"rounded-lg border border-red-200 bg-red-50 px-3 py-2 text-sm text-red-700 dark:border-red-900 dark:bg-red-950/40 dark:text-red-200\">Failed to render messages.</li>");
-        }
+    if (rows == 0) {
+        buffer_free(&out);
+        return strdup(render_no_messages_html);
     }
 
-    sqlite3_finalize(stmt);
+    return buffer_detach(&out);
+}
+
+char *db_render_messages_json(void)
+{
+    struct Buffer out = {.arena = arena_thread()};
+    struct MessagePage page;
+    if (buffer_append(&out, "[") != 0) {
+        return strdup("[]");
+    }
 
-    if (row_count == 0) {
-        free(out.data);
-        return strdup("<li class=\"rounded-lg border border-dashed border-slate-300 bg-white px-3 py-4 text-center text-sm text-slate-500 dark:border-slate-700 dark:bg-slate-900 dark:text-slate-300\">No messages yet.</li>");
+    if (render_rows_page(INT64_MAX, MESSAGE_PAGE_SIZE, 0, 1, &out, &page) < 0 || buffer_append(&out, "]") != 0) {
+        buffer_free(&out);
+        return strdup("[]");
     }
 
-    return out.data;
+    return buffer_detach(&out);
 }
 
-char *db_render_messages_json(void)
+static char *render_page_html(long long cursor, int limit, int newer, struct MessagePage *page)
 {
-    const char *sql =
-        "SELECT m.nickname, m.content, m.timestamp, m.user_tag "
-        "FROM ("
-        "SELECT nickname, content, timestamp, user_tag, created_at "
-        "FROM messages ORDER BY created_at DESC LIMIT 50"
-        ") AS m "
-        "ORDER BY m.created_at ASC";
+    struct Buffer out = {.arena = arena_thread()};
+    int rows = buffer_append(&out, "");
+    if (rows == 0) {
+        rows = render_rows_page(cursor, limit, newer, 0, &out, page);
+    }
+    if (rows < 0) {
+        buffer_free(&out);
+        return NULL;
+    }
 
-    sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        return strdup("{\"error\":\"Failed to load messages\"}");
+    return buffer_detach(&out);
+}
+
+static char *render_page_json(long long cursor, int limit, int newer, struct MessagePage *page)
+{
+    struct Buffer out = {.arena = arena_thread()};
+    int rows = buffer_append(&out, "[");
+    if (rows == 0) {
+        rows = render_rows_page(cursor, limit, newer, 1, &out, page);
+    }
+    if (rows < 0) {
+        buffer_free(&out);
+        return NULL;
     }
 
-    struct Buffer out = {0};
-    if (buffer_append(&out, "[") != 0) {
-        sqlite3_finalize(stmt);
-        return strdup("[]");
+    /* The wrapper fields depend on the rows, so splice them in front. */
+    struct Buffer wrapped = {.arena = out.arena};
+    int rc = buffer_appendf(&wrapped, "{\"cursor\":%lld,\"more\":%s,\"messages\":", page->cursor, page->more ? "true" : "false");
+    rc |= buffer_append(&wrapped, out.data);
+    rc |= buffer_append(&wrapped, "]}");
+    buffer_free(&out);
+    if (rc != 0) {
+        buffer_free(&wrapped);
+        return NULL;
     }
 
-    int row_count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *nickname = (const char *)sqlite3_column_text(stmt, 0);
-        const char *content = (const char *)sqlite3_column_text(stmt, 1);
-        const char *timestamp = (const char *)sqlite3_column_text(stmt, 2);
-        int user_tag = sqlite3_column_int(stmt, 3);
-        if (user_tag <= 0 || user_tag > 9999) {
-            user_tag = 1;
-        }
+    return buffer_detach(&wrapped);
+}
 
-        char *nick_esc = json_escape(nickname ? nickname : "anon");
-        char *content_esc = json_escape(content ? content : "");
-        char *time_esc = json_escape(timestamp ? timestamp : "");
-        if (nick_esc == NULL || content_esc == NULL || time_esc == NULL) {
-            free(nick_esc);
-            free(content_esc);
-            free(time_esc);
-            free(out.data);
-            sqlite3_finalize(stmt);
-            return strdup("[]");
-        }
+char *db_render_messages_since_html(long long since, int limit, struct MessagePage *page)
+{
+    return render_page_html(since, limit, 1, page);
+}
 
-        int rc = 0;
-        if (row_count > 0) {
-            rc |= buffer_append(&out, ",");
-        }
-        rc |= buffer_appendf(
-            &out,
-            "{\"nickname\":\"%s\",\"tag\":%d,\"timestamp\":\"%s\",\"content\":\"%s\"}",
-            nick_esc,
-            user_tag,
-            time_esc,
-            content_esc);
-        row_count++;
+char *db_render_messages_since_json(long long since, int limit, struct MessagePage *page)
+{
+    return render_page_json(since, limit, 1, page);
+}
+
+char *db_render_messages_before_html(long long before, int limit, struct MessagePage *page)
+{
+    return render_page_html(before, limit, 0, page);
+}
 
-        free(nick_esc);
-        free(content_esc);
-        free(time_esc);
+char *db_render_messages_before_json(long long before, int limit, struct MessagePage *page)
+{
+    return render_page_json(before, limit, 0, page);
+}
 
-        if (rc != 0) {
-            free(out.data);
-            sqlite3_finalize(stmt);
-            return strdup("[]");
-        }
+int db_fragments_stale(void)
+{
+    return !fragments_current;
+}
+
+/*
+ * One step of the background re-render: brings up to `limit` rows below
+ * the cursor to RENDER_FRAGMENT_VERSION in one transaction, newest first
+ * since those are read most. Newer rows were written current. Returns 1
+ * while rows remain, 0 once render_state is current, -1 on error.
+ */
+int db_refresh_fragments(int limit)
+{
+    if (fragments_current) {
+        return 0;
+    }
+    if (exec_sql(write_conn.handle, "BEGIN IMMEDIATE") != 0) {
+        return -1;
     }
 
-    sqlite3_finalize(stmt);
-    if (buffer_append(&out, "]") != 0) {
-        free(out.data);
-        return strdup("[]");
+    sqlite3_stmt *scan = db_stmt(&write_conn, STMT_FRAGMENTS_SCAN);
+    sqlite3_stmt *update = db_stmt(&write_conn, STMT_FRAGMENTS_UPDATE);
+    if (scan == NULL || update == NULL) {
+        exec_sql(write_conn.handle, "ROLLBACK");
+        return -1;
+    }
+    sqlite3_bind_int64(scan, 1, refresh_cursor);
+    sqlite3_bind_int(scan, 2, limit);
+
+    arena_reset(&fragment_arena);
+    int rc = 0;
+    int rows = 0;
+    int step = SQLITE_DONE;
+    long long cursor = refresh_cursor;
+    while (rc == 0 && (step = sqlite3_step(scan)) == SQLITE_ROW) {
+        struct MessageRecord m;
+        row_to_record(scan, &m);
+        cursor = m.id;
+        rows++;
+        if (sqlite3_column_int(scan, 7) == RENDER_FRAGMENT_VERSION) {
+            continue;
+        }
+        if (render_fragments(&m) != 0) {
+            rc = -1;
+            break;
+        }
+        sqlite3_bind_text(update, 1, m.html_fragment, (int)m.html_len, SQLITE_STATIC);
+        sqlite3_bind_text(update, 2, m.json_fragment, (int)m.json_len, SQLITE_STATIC);
+        sqlite3_bind_int(update, 3, RENDER_FRAGMENT_VERSION);
+        sqlite3_bind_int64(update, 4, m.id);
+        rc = sqlite3_step(update) == SQLITE_DONE ? 0 : -1;
+        sqlite3_reset(update);
+    }
+    /* A scan cut short by an error must not pass for the end of the table. */
+    if (rc == 0 && step != SQLITE_DONE) {
+        rc = -1;
+    }
+    db_stmt_done(scan);
+    db_stmt_done(update);
+
+    int done = rc == 0 && rows < limit;
+    if (done) {
+        char sql[64];
+        snprintf(sql, sizeof(sql), "UPDATE render_state SET fragment_version = %d", RENDER_FRAGMENT_VERSION);
+        rc = exec_sql(write_conn.handle, sql);
+    }
+    if (rc != 0 || exec_sql(write_conn.handle, "COMMIT") != 0) {
+        log_error("Failed re-rendering message fragments: %s", sqlite3_errmsg(write_conn.handle));
+        exec_sql(write_conn.handle, "ROLLBACK");
+        return -1;
     }
 
-    return out.data;
+    refresh_cursor = cursor;
+    if (done) {
+        fragments_current = 1;
+        log_info("Message fragments are current (version %d)", RENDER_FRAGMENT_VERSION);
+    }
+    return done ? 0 : 1;
 }
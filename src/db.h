@@ -1,10 +1,71 @@
 #ifndef DB_H
 #define DB_H
 
-int db_init(void);
+#include <stddef.h>
+
+/* One stored message. Text fields borrow from the caller or the current row. */
+struct MessageRecord {
+    long long id;
+    const char *nickname;
+    const char *content;
+    int tag;
+    char timestamp[32];
+    /* The <li> and JSON renderings stored with the row, or NULL when they
+     * are missing or from an older RENDER_FRAGMENT_VERSION. */
+    const char *html_fragment;
+    size_t html_len;
+    const char *json_fragment;
+    size_t json_len;
+};
+
+/* One row of a batch insert; ok and record are filled in by the insert.
+ * The record's fragments stay valid until the next db_insert_messages. */
+struct MessageInsert {
+    const char *nickname;
+    const char *client_id;
+    const char *content;
+    int ok;
+    struct MessageRecord record;
+};
+
+/* Position reached by a cursor read: the id to continue from (newest row for
+ * since=, oldest row for before=, or the request cursor when no rows) and
+ * whether more rows follow in that direction. */
+struct MessagePage {
+    long long cursor;
+    int more;
+};
+
+/* Read pool counters; wait times are for acquires that found no free reader. */
+struct DbPoolStats {
+    unsigned int size;
+    unsigned int in_use;
+    unsigned long long acquires;
+    unsigned long long waits;
+    double wait_us_total;
+    double wait_us_max;
+};
+
+int db_init(unsigned int read_connections);
 void db_close(void);
-int db_insert_message(const char *nickname, const char *client_id, const char *content);
+int db_insert_messages(struct MessageInsert *batch, size_t count);
+int db_fragments_stale(void);
+int db_refresh_fragments(int limit);
+long long db_latest_message_id(void);
+void db_get_pool_stats(struct DbPoolStats *out);
+int db_read_newest(int limit, int (*fn)(const struct MessageRecord *m, void *ctx), void *ctx);
+/*
+ * Rendered bodies are malloc'd copies for the caller to free. Scratch space
+ * comes from the calling thread's request arena (arena_thread), which the
+ * request handler resets once the response is queued. Callers rendering
+ * outside a request must call arena_thread_reset() after each render, or the
+ * arena keeps every page.
+ */
 char *db_render_messages_html(void);
 char *db_render_messages_json(void);
+char *db_render_messages_since_html(long long since, int limit, struct MessagePage *page);
+char *db_render_messages_since_json(long long since, int limit, struct MessagePage *page);
+char *db_render_messages_before_html(long long before, int limit, struct MessagePage *page);
+char *db_render_messages_before_json(long long before, int limit, struct MessagePage *page);
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef DB_STMT_H
+#define DB_STMT_H
+
+#include <sqlite3.h>
+
+enum DbStmtId {
+    STMT_MESSAGE_INSERT,
+    STMT_MESSAGES_MAX_ID,
+    STMT_MESSAGES_BEFORE,
+    STMT_MESSAGES_SINCE,
+    STMT_FRAGMENTS_SCAN,
+    STMT_FRAGMENTS_UPDATE,
+    STMT_MESSAGES_EXIST_BEFORE,
+    STMT_TAG_INSERT,
+    STMT_COUNT,
+};
+
+/* A connection plus its prepared hot statements. Used by one thread at a time. */
+struct DbConn {
+    sqlite3 *handle;
+    sqlite3_stmt *stmts[STMT_COUNT];
+};
+
+struct DbStmtStats {
+    unsigned long long prepares;
+    unsigned long long reuses;
+};
+
+sqlite3_stmt *db_stmt(struct DbConn *conn, enum DbStmtId id);
+void db_stmt_done(sqlite3_stmt *stmt);
+void db_stmt_finalize_all(struct DbConn *conn);
+void db_stmt_get_stats(struct DbStmtStats *out);
+void db_stmt_set_caching(int enabled);
+
+#endif
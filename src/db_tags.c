@@ -1,8 +1,11 @@
 #include "db_tags.h"
 
 #include "config.h"
+#include "trace.h"
 
+#include <pthread.h>
 #include <sqlite3.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -86,134 +89,464 @@ static int parse_form_value(const char *form_body, const char *key, char *out, s
     return found;
 }
 
-int db_tags_get_or_assign(sqlite3 *db, const char *nickname, const char *client_id, int *out_tag)
+/*
+ * Tags live in memory: a map from (nickname, client_id) to tag, and per
+ * nickname a bitmap of the tags already taken. Lookups never touch SQL and
+ * a new pair costs one bitmap scan plus one write-through INSERT. The
+ * tables are loaded from nickname_tags at startup and guarded by one mutex.
+ *
+ * The write-through INSERT is part of the caller's transaction, so a new
+ * pair is also kept on a pending list until the caller reports the outcome:
+ * db_tags_commit forgets the list, db_tags_rollback drops the pairs added
+ * since a mark from the map and the bitmaps. The map then never holds a pair
+ * that nickname_tags lost, which would otherwise keep its tag for this run
+ * only and go to someone else after a restart.
+ */
+
+enum { TAG_MAX = 9999, TAG_WORDS = (TAG_MAX + 63) / 64 };
+
+struct NickTags {
+    char *nickname;
+    unsigned int hash;
+    uint64_t used[TAG_WORDS];
+};
+
+struct TagEntry {
+    struct NickTags *nick;
+    char *client_id;
+    unsigned int hash;
+    int tag;
+};
+
+/* Open-addressed tables; capacities are powers of two, NULL/0 marks empty. */
+static pthread_mutex_t tags_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct NickTags **nicks;
+static size_t nick_cap;
+static size_t nick_count;
+static struct TagEntry *entries;
+static size_t entry_cap;
+static size_t entry_count;
+
+/* Pairs added since the last db_tags_commit; client_id is the entry's copy. */
+struct PendingTag {
+    struct NickTags *nick;
+    const char *client_id;
+    unsigned int hash;
+};
+
+static struct PendingTag *pending;
+static size_t pending_cap;
+static size_t pending_count;
+
+static unsigned int pair_hash(unsigned int nick_hash, const char *client_id)
 {
-    sqlite3_stmt *stmt = NULL;
-    int had_invalid_row = 0;
+    unsigned int hash = nick_hash ^ 0x9e3779b9u;
+    for (const unsigned char *p = (const unsigned char *)client_id; *p != '\0'; ++p) {
+        hash ^= (unsigned int)(*p);
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-    const char *select_sql =
-        "SELECT tag FROM nickname_tags WHERE nickname = ? AND client_id = ? LIMIT 1";
-    if (sqlite3_prepare_v2(db, select_sql, -1, &stmt, NULL) != SQLITE_OK) {
+static void tags_clear(void)
+{
+    for (size_t i = 0; i < nick_cap; ++i) {
+        if (nicks[i] != NULL) {
+            free(nicks[i]->nickname);
+            free(nicks[i]);
+        }
+    }
+    for (size_t i = 0; i < entry_cap; ++i) {
+        free(entries[i].client_id);
+    }
+    free(nicks);
+    free(entries);
+    free(pending);
+    nicks = NULL;
+    entries = NULL;
+    pending = NULL;
+    nick_cap = nick_count = 0;
+    entry_cap = entry_count = 0;
+    pending_cap = pending_count = 0;
+}
+
+static int nicks_grow(void)
+{
+    size_t cap = nick_cap == 0 ? 64 : nick_cap * 2;
+    struct NickTags **table = calloc(cap, sizeof(*table));
+    if (table == NULL) {
         return -1;
     }
-    sqlite3_bind_text(stmt, 1, nickname, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, client_id, -1, SQLITE_TRANSIENT);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        int existing_tag = sqlite3_column_int(stmt, 0);
-        if (existing_tag > 0 && existing_tag <= 9999) {
-            *out_tag = existing_tag;
-            sqlite3_finalize(stmt);
-            return 0;
+    for (size_t i = 0; i < nick_cap; ++i) {
+        if (nicks[i] == NULL) {
+            continue;
+        }
+        size_t slot = nicks[i]->hash & (cap - 1);
+        while (table[slot] != NULL) {
+            slot = (slot + 1) & (cap - 1);
         }
-        had_invalid_row = 1;
+        table[slot] = nicks[i];
     }
-    sqlite3_finalize(stmt);
-
-    const char *insert_sql =
-        "INSERT INTO nickname_tags(nickname, client_id, tag) VALUES(?, ?, ?)";
-    const char *delete_sql =
-        "DELETE FROM nickname_tags WHERE nickname = ? AND client_id = ?";
+    free(nicks);
+    nicks = table;
+    nick_cap = cap;
+    return 0;
+}
 
-    if (had_invalid_row) {
-        if (sqlite3_prepare_v2(db, delete_sql, -1, &stmt, NULL) != SQLITE_OK) {
-            return -1;
+static int entries_grow(void)
+{
+    size_t cap = entry_cap == 0 ? 256 : entry_cap * 2;
+    struct TagEntry *table = calloc(cap, sizeof(*table));
+    if (table == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < entry_cap; ++i) {
+        if (entries[i].client_id == NULL) {
+            continue;
+        }
+        size_t slot = entries[i].hash & (cap - 1);
+        while (table[slot].client_id != NULL) {
+            slot = (slot + 1) & (cap - 1);
         }
-        sqlite3_bind_text(stmt, 1, nickname, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, client_id, -1, SQLITE_TRANSIENT);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
+        table[slot] = entries[i];
     }
+    free(entries);
+    entries = table;
+    entry_cap = cap;
+    return 0;
+}
 
-    int start_tag = (int)(fnv1a_32(client_id) % 9999u) + 1;
-    for (int offset = 0; offset < 9999; ++offset) {
-        int tag = ((start_tag - 1 + offset) % 9999) + 1;
-        if (sqlite3_prepare_v2(db, insert_sql, -1, &stmt, NULL) != SQLITE_OK) {
-            return -1;
-        }
-        sqlite3_bind_text(stmt, 1, nickname, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, client_id, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(stmt, 3, tag);
-        int rc = sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-
-        if (rc == SQLITE_DONE) {
-            *out_tag = tag;
-            return 0;
+static struct NickTags *nick_find(const char *nickname, int create)
+{
+    unsigned int hash = fnv1a_32(nickname);
+    if (nick_cap > 0) {
+        for (size_t slot = hash & (nick_cap - 1); nicks[slot] != NULL; slot = (slot + 1) & (nick_cap - 1)) {
+            if (nicks[slot]->hash == hash && strcmp(nicks[slot]->nickname, nickname) == 0) {
+                return nicks[slot];
+            }
         }
+    }
+    if (!create) {
+        return NULL;
+    }
 
-        if (rc != SQLITE_CONSTRAINT) {
-            return -1;
+    if ((nick_count + 1) * 4 > nick_cap * 3 && nicks_grow() != 0) {
+        return NULL;
+    }
+    struct NickTags *nick = calloc(1, sizeof(*nick));
+    if (nick == NULL || (nick->nickname = strdup(nickname)) == NULL) {
+        free(nick);
+        return NULL;
+    }
+    nick->hash = hash;
+
+    size_t slot = hash & (nick_cap - 1);
+    while (nicks[slot] != NULL) {
+        slot = (slot + 1) & (nick_cap - 1);
+    }
+    nicks[slot] = nick;
+    nick_count++;
+    return nick;
+}
+
+static struct TagEntry *entry_find(const struct NickTags *nick, const char *client_id, unsigned int hash)
+{
+    if (entry_cap == 0) {
+        return NULL;
+    }
+    for (size_t slot = hash & (entry_cap - 1); entries[slot].client_id != NULL; slot = (slot + 1) & (entry_cap - 1)) {
+        struct TagEntry *e = &entries[slot];
+        if (e->hash == hash && e->nick == nick && strcmp(e->client_id, client_id) == 0) {
+            return e;
         }
+    }
+    return NULL;
+}
 
-        if (sqlite3_prepare_v2(db, select_sql, -1, &stmt, NULL) != SQLITE_OK) {
-            return -1;
+static int entry_add(struct NickTags *nick, const char *client_id, unsigned int hash, int tag)
+{
+    if ((entry_count + 1) * 4 > entry_cap * 3 && entries_grow() != 0) {
+        return -1;
+    }
+    char *copy = strdup(client_id);
+    if (copy == NULL) {
+        return -1;
+    }
+
+    size_t slot = hash & (entry_cap - 1);
+    while (entries[slot].client_id != NULL) {
+        slot = (slot + 1) & (entry_cap - 1);
+    }
+    entries[slot] = (struct TagEntry){.nick = nick, .client_id = copy, .hash = hash, .tag = tag};
+    entry_count++;
+    nick->used[(tag - 1) / 64] |= UINT64_C(1) << ((tag - 1) % 64);
+    return 0;
+}
+
+/* Backward-shift deletion keeps every probe chain unbroken without tombstones. */
+static void entry_remove(struct TagEntry *e)
+{
+    struct NickTags *nick = e->nick;
+    nick->used[(e->tag - 1) / 64] &= ~(UINT64_C(1) << ((e->tag - 1) % 64));
+    free(e->client_id);
+
+    size_t mask = entry_cap - 1;
+    size_t hole = (size_t)(e - entries);
+    entries[hole] = (struct TagEntry){0};
+    for (size_t slot = (hole + 1) & mask; entries[slot].client_id != NULL; slot = (slot + 1) & mask) {
+        size_t home = entries[slot].hash & mask;
+        /* Entries whose home lies cyclically in (hole, slot] must stay put. */
+        int stays = hole < slot ? (home > hole && home <= slot) : (home > hole || home <= slot);
+        if (!stays) {
+            entries[hole] = entries[slot];
+            entries[slot] = (struct TagEntry){0};
+            hole = slot;
         }
-        sqlite3_bind_text(stmt, 1, nickname, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, client_id, -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            int existing_tag = sqlite3_column_int(stmt, 0);
-            sqlite3_finalize(stmt);
-            if (existing_tag > 0 && existing_tag <= 9999) {
-                *out_tag = existing_tag;
-                return 0;
+    }
+    entry_count--;
+}
+
+static int pending_reserve(void)
+{
+    if (pending_count < pending_cap) {
+        return 0;
+    }
+    size_t cap = pending_cap == 0 ? 64 : pending_cap * 2;
+    struct PendingTag *list = realloc(pending, cap * sizeof(*list));
+    if (list == NULL) {
+        return -1;
+    }
+    pending = list;
+    pending_cap = cap;
+    return 0;
+}
+
+static int tag_is_used(const struct NickTags *nick, int tag)
+{
+    return (nick->used[(tag - 1) / 64] >> ((tag - 1) % 64)) & 1;
+}
+
+/* First free tag at or after start, wrapping; same choice the old probe loop made. */
+static int next_free_tag(const struct NickTags *nick, int start)
+{
+    int tag = start;
+    for (int scanned = 0; scanned < TAG_MAX;) {
+        int bit = (tag - 1) % 64;
+        uint64_t word = nick->used[(tag - 1) / 64];
+        if (bit == 0 && word == UINT64_MAX && tag + 63 <= TAG_MAX) {
+            scanned += 64;
+            tag += 64;
+        } else {
+            if (!(word >> bit & 1)) {
+                return tag;
             }
+            scanned++;
+            tag++;
+        }
+        if (tag > TAG_MAX) {
+            tag = 1;
+        }
+    }
+    return -1;
+}
+
+int db_tags_load(struct DbConn *conn)
+{
+    pthread_mutex_lock(&tags_lock);
+    sqlite3 *db = conn->handle;
+    tags_clear();
+
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT nickname, client_id, tag FROM nickname_tags", -1, &stmt, NULL) != SQLITE_OK) {
+        pthread_mutex_unlock(&tags_lock);
+        return -1;
+    }
+
+    int rc = 0;
+    while (rc == 0 && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *nickname = (const char *)sqlite3_column_text(stmt, 0);
+        const char *client_id = (const char *)sqlite3_column_text(stmt, 1);
+        int tag = sqlite3_column_int(stmt, 2);
+        if (nickname == NULL || client_id == NULL || tag <= 0 || tag > TAG_MAX) {
             continue;
         }
-        sqlite3_finalize(stmt);
+
+        struct NickTags *nick = nick_find(nickname, 1);
+        if (nick == NULL) {
+            rc = -1;
+        } else if (!tag_is_used(nick, tag)) {
+            rc = entry_add(nick, client_id, pair_hash(nick->hash, client_id), tag);
+        }
     }
+    sqlite3_finalize(stmt);
 
-    return -1;
+    /* Rows with a tag out of range are dropped and reassigned on next use. */
+    if (rc == 0 && sqlite3_exec(db, "DELETE FROM nickname_tags WHERE tag <= 0 OR tag > 9999", NULL, NULL, NULL) != SQLITE_OK) {
+        rc = -1;
+    }
+    pthread_mutex_unlock(&tags_lock);
+    return rc;
+}
+
+static int get_or_assign(struct DbConn *conn, const char *nickname, const char *client_id, int *out_tag)
+{
+    pthread_mutex_lock(&tags_lock);
+
+    struct NickTags *nick = nick_find(nickname, 1);
+    if (nick == NULL) {
+        pthread_mutex_unlock(&tags_lock);
+        return -1;
+    }
+
+    unsigned int hash = pair_hash(nick->hash, client_id);
+    struct TagEntry *existing = entry_find(nick, client_id, hash);
+    if (existing != NULL) {
+        *out_tag = existing->tag;
+        pthread_mutex_unlock(&tags_lock);
+        return 0;
+    }
+
+    int tag = next_free_tag(nick, (int)(fnv1a_32(client_id) % (unsigned int)TAG_MAX) + 1);
+    if (tag < 0) {
+        pthread_mutex_unlock(&tags_lock);
+        return -1;
+    }
+
+    sqlite3_stmt *stmt = pending_reserve() == 0 ? db_stmt(conn, STMT_TAG_INSERT) : NULL;
+    if (stmt == NULL) {
+        pthread_mutex_unlock(&tags_lock);
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, nickname, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, client_id, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, tag);
+    int rc = sqlite3_step(stmt);
+    db_stmt_done(stmt);
+
+    if (rc != SQLITE_DONE || entry_add(nick, client_id, hash, tag) != 0) {
+        pthread_mutex_unlock(&tags_lock);
+        return -1;
+    }
+
+    struct TagEntry *added = entry_find(nick, client_id, hash);
+    pending[pending_count++] = (struct PendingTag){nick, added->client_id, hash};
+    *out_tag = tag;
+    pthread_mutex_unlock(&tags_lock);
+    return 0;
+}
+
+int db_tags_get_or_assign(struct DbConn *conn, const char *nickname, const char *client_id, int *out_tag)
+{
+    unsigned long long span = trace_begin();
+    int rc = get_or_assign(conn, nickname, client_id, out_tag);
+    trace_end("db_tags_get_or_assign", span);
+    return rc;
+}
+
+size_t db_tags_mark(void)
+{
+    pthread_mutex_lock(&tags_lock);
+    size_t mark = pending_count;
+    pthread_mutex_unlock(&tags_lock);
+    return mark;
+}
+
+void db_tags_rollback(size_t mark)
+{
+    pthread_mutex_lock(&tags_lock);
+    while (pending_count > mark) {
+        struct PendingTag *p = &pending[--pending_count];
+        struct TagEntry *e = entry_find(p->nick, p->client_id, p->hash);
+        if (e != NULL) {
+            entry_remove(e);
+        }
+    }
+    pthread_mutex_unlock(&tags_lock);
+}
+
+void db_tags_commit(void)
+{
+    pthread_mutex_lock(&tags_lock);
+    pending_count = 0;
+    pthread_mutex_unlock(&tags_lock);
 }
 
-int db_tags_backfill(sqlite3 *db)
+void db_tags_free(void)
 {
+    pthread_mutex_lock(&tags_lock);
+    tags_clear();
+    pthread_mutex_unlock(&tags_lock);
+}
+
+/*
+ * One-time migration of legacy rows. Rows whose content still holds a raw
+ * form body are split back into nickname, client_id and message. Then tags
+ * are reassigned to every pair in (nickname, client_id) order, and every
+ * message takes its pair's tag. Runs inside the caller's transaction.
+ */
+int db_tags_backfill(struct DbConn *conn)
+{
+    sqlite3 *db = conn->handle;
     sqlite3_stmt *select_stmt = NULL;
     sqlite3_stmt *update_stmt = NULL;
 
-    const char *select_sql =
-        "SELECT DISTINCT nickname, client_id, content FROM messages "
-        "WHERE nickname IS NOT NULL AND nickname != '' "
-        "AND client_id IS NOT NULL AND client_id != ''";
-    const char *update_sql =
-        "UPDATE messages SET nickname = ?, client_id = ?, user_tag = ?, content = ? "
-        "WHERE rowid = ?";
-
     const char *select_rows_sql =
-        "SELECT rowid, nickname, client_id, user_tag, content FROM messages";
+        "SELECT rowid, nickname, client_id, content FROM messages "
+        "WHERE content LIKE '%&client_id=%' AND content LIKE '%&message=%'";
+    const char *update_sql =
+        "UPDATE messages SET nickname = ?, client_id = ?, content = ? WHERE rowid = ?";
 
-    if (sqlite3_prepare_v2(db, select_sql, -1, &select_stmt, NULL) != SQLITE_OK) {
+    if (sqlite3_prepare_v2(db, select_rows_sql, -1, &select_stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    if (sqlite3_prepare_v2(db, update_sql, -1, &update_stmt, NULL) != SQLITE_OK) {
+        sqlite3_finalize(select_stmt);
         return -1;
     }
 
     while (sqlite3_step(select_stmt) == SQLITE_ROW) {
-        const char *nickname = (const char *)sqlite3_column_text(select_stmt, 0);
-        const char *client_id = (const char *)sqlite3_column_text(select_stmt, 1);
-        if (nickname == NULL || client_id == NULL) {
-            continue;
+        sqlite3_int64 rowid = sqlite3_column_int64(select_stmt, 0);
+        const char *nickname = (const char *)sqlite3_column_text(select_stmt, 1);
+        const char *client_id = (const char *)sqlite3_column_text(select_stmt, 2);
+        const char *content = (const char *)sqlite3_column_text(select_stmt, 3);
+
+        char nick_buf[MAX_NICKNAME] = {0};
+        char cid_buf[MAX_CLIENT_ID] = {0};
+        char msg_buf[MAX_MESSAGE] = {0};
+
+        snprintf(nick_buf, sizeof(nick_buf), "%s", nickname ? nickname : "anon");
+        snprintf(cid_buf, sizeof(cid_buf), "%s", client_id ? client_id : "legacy");
+        snprintf(msg_buf, sizeof(msg_buf), "%s", content ? content : "");
+
+        parse_form_value(msg_buf, "nickname", nick_buf, sizeof(nick_buf));
+        if (nick_buf[0] == '\0') {
+            snprintf(nick_buf, sizeof(nick_buf), "anon");
         }
-        int tag = -1;
-        if (db_tags_get_or_assign(db, nickname, client_id, &tag) != 0) {
-            continue;
+        parse_form_value(msg_buf, "client_id", cid_buf, sizeof(cid_buf));
+        if (cid_buf[0] == '\0') {
+            snprintf(cid_buf, sizeof(cid_buf), "legacy");
         }
+        parse_form_value(content ? content : "", "message", msg_buf, sizeof(msg_buf));
 
-        sqlite3_stmt *u = NULL;
-        if (sqlite3_prepare_v2(db,
-                               "UPDATE messages SET user_tag = ? WHERE nickname = ? AND client_id = ? AND (user_tag IS NULL OR user_tag <= 0)",
-                               -1,
-                               &u,
-                               NULL) == SQLITE_OK) {
-            sqlite3_bind_int(u, 1, tag);
-            sqlite3_bind_text(u, 2, nickname, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(u, 3, client_id, -1, SQLITE_TRANSIENT);
-            sqlite3_step(u);
-            sqlite3_finalize(u);
+        sqlite3_reset(update_stmt);
+        sqlite3_clear_bindings(update_stmt);
+        sqlite3_bind_text(update_stmt, 1, nick_buf, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(update_stmt, 2, cid_buf, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(update_stmt, 3, msg_buf, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(update_stmt, 4, rowid);
+        if (sqlite3_step(update_stmt) != SQLITE_DONE) {
+            sqlite3_finalize(update_stmt);
+            sqlite3_finalize(select_stmt);
+            return -1;
         }
     }
+    sqlite3_finalize(update_stmt);
     sqlite3_finalize(select_stmt);
 
     if (sqlite3_exec(db, "DELETE FROM nickname_tags", NULL, NULL, NULL) != SQLITE_OK) {
         return -1;
     }
+    db_tags_free();
 
     if (sqlite3_prepare_v2(db,
                            "SELECT DISTINCT nickname, client_id FROM messages "
@@ -234,13 +567,14 @@ int db_tags_backfill(sqlite3 *db)
         }
 
         int tag = -1;
-        if (db_tags_get_or_assign(db, nickname, client_id, &tag) != 0) {
+        if (db_tags_get_or_assign(conn, nickname, client_id, &tag) != 0) {
             sqlite3_finalize(select_stmt);
             return -1;
         }
     }
     sqlite3_finalize(select_stmt);
 
+    /* The lookup uses the UNIQUE(nickname, client_id) index: one probe per row. */
     if (sqlite3_exec(db,
                      "UPDATE messages "
                      "SET user_tag = COALESCE(("
@@ -252,59 +586,5 @@ int db_tags_backfill(sqlite3 *db)
                      NULL) != SQLITE_OK) {
         return -1;
     }
-
-    if (sqlite3_prepare_v2(db, select_rows_sql, -1, &select_stmt, NULL) != SQLITE_OK) {
-        return 0;
-    }
-    if (sqlite3_prepare_v2(db, update_sql, -1, &update_stmt, NULL) != SQLITE_OK) {
-        sqlite3_finalize(select_stmt);
-        return 0;
-    }
-
-    while (sqlite3_step(select_stmt) == SQLITE_ROW) {
-        sqlite3_int64 rowid = sqlite3_column_int64(select_stmt, 0);
-        const char *nickname = (const char *)sqlite3_column_text(select_stmt, 1);
-        const char *client_id = (const char *)sqlite3_column_text(select_stmt, 2);
-        int user_tag = sqlite3_column_int(select_stmt, 3);
-        const char *content = (const char *)sqlite3_column_text(select_stmt, 4);
-
-        char nick_buf[MAX_NICKNAME] = {0};
-        char cid_buf[MAX_CLIENT_ID] = {0};
-        char msg_buf[MAX_MESSAGE] = {0};
-
-        snprintf(nick_buf, sizeof(nick_buf), "%s", nickname ? nickname : "anon");
-        snprintf(cid_buf, sizeof(cid_buf), "%s", client_id ? client_id : "legacy");
-        snprintf(msg_buf, sizeof(msg_buf), "%s", content ? content : "");
-
-        if (strstr(msg_buf, "&client_id=") != NULL && strstr(msg_buf, "&message=") != NULL) {
-            parse_form_value(msg_buf, "nickname", nick_buf, sizeof(nick_buf));
-            if (nick_buf[0] == '\0') {
-                snprintf(nick_buf, sizeof(nick_buf), "anon");
-            }
-            parse_form_value(msg_buf, "client_id", cid_buf, sizeof(cid_buf));
-            if (cid_buf[0] == '\0') {
-                snprintf(cid_buf, sizeof(cid_buf), "legacy");
-            }
-            parse_form_value(content ? content : "", "message", msg_buf, sizeof(msg_buf));
-        }
-
-        if (user_tag <= 0 || user_tag > 9999) {
-            if (db_tags_get_or_assign(db, nick_buf, cid_buf, &user_tag) != 0) {
-                user_tag = 1;
-            }
-        }
-
-        sqlite3_reset(update_stmt);
-        sqlite3_clear_bindings(update_stmt);
-        sqlite3_bind_text(update_stmt, 1, nick_buf, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(update_stmt, 2, cid_buf, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(update_stmt, 3, user_tag);
-        sqlite3_bind_text(update_stmt, 4, msg_buf, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int64(update_stmt, 5, rowid);
-        sqlite3_step(update_stmt);
-    }
-
-    sqlite3_finalize(update_stmt);
-    sqlite3_finalize(select_stmt);
     return 0;
 }
@@ -1,9 +1,23 @@
 #ifndef DB_TAGS_H
 #define DB_TAGS_H
 
+#include "db_stmt.h"
+
 #include <sqlite3.h>
+#include <stddef.h>
 
-int db_tags_get_or_assign(sqlite3 *db, const char *nickname, const char *client_id, int *out_tag);
-int db_tags_backfill(sqlite3 *db);
+int db_tags_load(struct DbConn *conn);
+int db_tags_get_or_assign(struct DbConn *conn, const char *nickname, const char *client_id, int *out_tag);
+/*
+ * New pairs are written through inside the caller's transaction. Report its
+ * outcome so the in-memory map follows the table: db_tags_mark before a
+ * savepoint, db_tags_rollback(mark) after rolling back to it (or the whole
+ * transaction), db_tags_commit after COMMIT.
+ */
+size_t db_tags_mark(void);
+void db_tags_rollback(size_t mark);
+void db_tags_commit(void);
+int db_tags_backfill(struct DbConn *conn);
+void db_tags_free(void);
 
 #endif
@@ -0,0 +1,22 @@
+#ifndef EMBEDDED_H
+#define EMBEDDED_H
+
+#include "template.h"
+
+#include <stddef.h>
+
+/* Defined in the embedded_assets.c that tools/embed_assets generates. */
+
+struct EmbeddedFile {
+    const char *name;
+    const char *data;
+    size_t len;
+};
+
+extern const struct EmbeddedFile embedded_files[];
+extern const size_t embedded_file_count;
+
+extern const struct TemplateSegment embedded_page_segments[];
+extern const size_t embedded_page_segment_count;
+
+#endif
@@ -0,0 +1,159 @@
+#include "epoch.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Each reader thread owns a cache-line-sized record holding the global
+ * epoch it entered at, or 0 while outside. Entering is one store to that
+ * line, so readers never write shared memory. Retiring stamps the object
+ * with the current epoch and advances it; an object is freed once every
+ * active record entered after its stamp, since any reader that loaded the
+ * old pointer must have entered at or before it. Records are recycled when
+ * their thread exits and never freed.
+ */
+
+struct EpochRecord {
+    _Alignas(64) atomic_ullong active;
+    atomic_int in_use;
+    struct EpochRecord *next;
+};
+
+struct Retired {
+    void *ptr;
+    void (*free_fn)(void *);
+    unsigned long long epoch;
+    struct Retired *next;
+};
+
+static atomic_ullong global_epoch = 1;
+static _Atomic(struct EpochRecord *) records;
+static _Thread_local struct EpochRecord *thread_record;
+static pthread_key_t record_key;
+static pthread_once_t record_key_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t retire_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct Retired *retired_head;
+static struct Retired *retired_tail;
+
+static void record_release(void *record)
+{
+    atomic_store_explicit(&((struct EpochRecord *)record)->in_use, 0, memory_order_release);
+}
+
+static void record_key_init(void)
+{
+    pthread_key_create(&record_key, record_release);
+}
+
+static struct EpochRecord *record_get(void)
+{
+    if (thread_record != NULL) {
+        return thread_record;
+    }
+    pthread_once(&record_key_once, record_key_init);
+
+    struct EpochRecord *record = NULL;
+    for (struct EpochRecord *r = atomic_load(&records); r != NULL; r = r->next) {
+        int free_slot = 0;
+        if (atomic_compare_exchange_strong(&r->in_use, &free_slot, 1)) {
+            record = r;
+            break;
+        }
+    }
+    if (record == NULL) {
+        record = aligned_alloc(_Alignof(struct EpochRecord), sizeof(*record));
+        if (record == NULL) {
+            return NULL;
+        }
+        atomic_init(&record->active, 0);
+        atomic_init(&record->in_use, 1);
+        record->next = atomic_load(&records);
+        while (!atomic_compare_exchange_weak(&records, &record->next, record)) {
+        }
+    }
+
+    pthread_setspecific(record_key, record);
+    thread_record = record;
+    return record;
+}
+
+struct EpochRecord *epoch_enter(void)
+{
+    struct EpochRecord *record = record_get();
+    if (record != NULL) {
+        /* Sequentially consistent, so the store is visible before any load
+         * of the protected pointer that follows. */
+        atomic_store(&record->active, atomic_load(&global_epoch));
+    }
+    return record;
+}
+
+void epoch_exit(struct EpochRecord *record)
+{
+    atomic_store_explicit(&record->active, 0, memory_order_release);
+}
+
+static unsigned long long oldest_active(void)
+{
+    unsigned long long oldest = UINT64_MAX;
+    for (struct EpochRecord *r = atomic_load(&records); r != NULL; r = r->next) {
+        unsigned long long active = atomic_load(&r->active);
+        if (active != 0 && active < oldest) {
+            oldest = active;
+        }
+    }
+    return oldest;
+}
+
+/* Caller holds retire_lock. */
+static void reclaim(unsigned long long oldest)
+{
+    while (retired_head != NULL && retired_head->epoch < oldest) {
+        struct Retired *done = retired_head;
+        retired_head = done->next;
+        done->free_fn(done->ptr);
+        free(done);
+    }
+    if (retired_head == NULL) {
+        retired_tail = NULL;
+    }
+}
+
+void epoch_retire(void *ptr, void (*free_fn)(void *))
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&retire_lock);
+    unsigned long long epoch = atomic_fetch_add(&global_epoch, 1);
+    struct Retired *node = malloc(sizeof(*node));
+    if (node == NULL) {
+        /* No memory to defer: wait out the readers instead. */
+        while (oldest_active() <= epoch) {
+            sched_yield();
+        }
+        free_fn(ptr);
+    } else {
+        *node = (struct Retired){ptr, free_fn, epoch, NULL};
+        if (retired_tail != NULL) {
+            retired_tail->next = node;
+        } else {
+            retired_head = node;
+        }
+        retired_tail = node;
+    }
+    reclaim(oldest_active());
+    pthread_mutex_unlock(&retire_lock);
+}
+
+void epoch_drain(void)
+{
+    pthread_mutex_lock(&retire_lock);
+    reclaim(UINT64_MAX);
+    pthread_mutex_unlock(&retire_lock);
+}
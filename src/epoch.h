@@ -0,0 +1,20 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+struct EpochRecord;
+
+/*
+ * Epoch-based reclamation for data that readers use without a lock. A
+ * reader brackets its use with epoch_enter/epoch_exit (no nesting); the
+ * publisher swaps in new data and retires the old, which is freed once
+ * every reader that could still see it has left.
+ */
+/* NULL if the thread's record could not be allocated. */
+struct EpochRecord *epoch_enter(void);
+void epoch_exit(struct EpochRecord *record);
+/* Publisher side; calls are serialized internally. */
+void epoch_retire(void *ptr, void (*free_fn)(void *));
+/* Frees everything retired. Only once no reader can be running. */
+void epoch_drain(void);
+
+#endif
@@ -0,0 +1,299 @@
+#include "escape.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+/*
+ * Escaping is a scan for the next special byte followed by a bulk copy of
+ * the clean run before it. Messages are mostly clean, so the scan decides
+ * the cost: the SSE2 and AVX2 kernels test 16 or 32 bytes per compare and
+ * fall back to the scalar loop for the tail. The widest kernel the CPU
+ * supports is picked on first use.
+ */
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define ESCAPE_HAVE_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define ESCAPE_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+struct EscapeScanner {
+    size_t (*html)(const unsigned char *s, size_t len);
+    size_t (*json)(const unsigned char *s, size_t len);
+};
+
+static int html_special(unsigned char c)
+{
+    return c == '&' || c == '<' || c == '>' || c == '"';
+}
+
+static int json_special(unsigned char c)
+{
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+static size_t scan_html_scalar(const unsigned char *s, size_t len)
+{
+    size_t i = 0;
+    while (i < len && !html_special(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+static size_t scan_json_scalar(const unsigned char *s, size_t len)
+{
+    size_t i = 0;
+    while (i < len && !json_special(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef ESCAPE_HAVE_SSE2
+static size_t scan_html_sse2(const unsigned char *s, size_t len)
+{
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i quot = _mm_set1_epi8('"');
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, amp), _mm_cmpeq_epi8(v, lt)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, gt), _mm_cmpeq_epi8(v, quot)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+    return i + scan_html_scalar(s + i, len - i);
+}
+
+static size_t scan_json_sse2(const unsigned char *s, size_t len)
+{
+    const __m128i quot = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i ctrl_max = _mm_set1_epi8(0x1f);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        /* Unsigned v <= 0x1f exactly when min(v, 0x1f) == v. */
+        __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl_max), v);
+        __m128i hit = _mm_or_si128(ctrl, _mm_or_si128(_mm_cmpeq_epi8(v, quot), _mm_cmpeq_epi8(v, bslash)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+    return i + scan_json_scalar(s + i, len - i);
+}
+#endif
+
+#ifdef ESCAPE_HAVE_AVX2
+__attribute__((target("avx2"))) static size_t scan_html_avx2(const unsigned char *s, size_t len)
+{
+    const __m256i amp = _mm256_set1_epi8('&');
+    const __m256i lt = _mm256_set1_epi8('<');
+    const __m256i gt = _mm256_set1_epi8('>');
+    const __m256i quot = _mm256_set1_epi8('"');
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, amp), _mm256_cmpeq_epi8(v, lt)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(v, gt), _mm256_cmpeq_epi8(v, quot)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+    /* Clear the upper halves before legacy SSE code runs, or every SSE op pays a transition. */
+    _mm256_zeroupper();
+    return i + scan_html_sse2(s + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t scan_json_avx2(const unsigned char *s, size_t len)
+{
+    const __m256i quot = _mm256_set1_epi8('"');
+    const __m256i bslash = _mm256_set1_epi8('\\');
+    const __m256i ctrl_max = _mm256_set1_epi8(0x1f);
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl_max), v);
+        __m256i hit = _mm256_or_si256(ctrl, _mm256_or_si256(_mm256_cmpeq_epi8(v, quot), _mm256_cmpeq_epi8(v, bslash)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+    _mm256_zeroupper();
+    return i + scan_json_sse2(s + i, len - i);
+}
+#endif
+
+static const struct EscapeScanner scanners[] = {
+    [ESCAPE_SCALAR] = {scan_html_scalar, scan_json_scalar},
+#ifdef ESCAPE_HAVE_SSE2
+    [ESCAPE_SSE2] = {scan_html_sse2, scan_json_sse2},
+#endif
+#ifdef ESCAPE_HAVE_AVX2
+    [ESCAPE_AVX2] = {scan_html_avx2, scan_json_avx2},
+#endif
+};
+
+/* -1 until the first call picks a kernel. */
+static atomic_int active_kernel = -1;
+
+static int kernel_supported(enum EscapeKernel kernel)
+{
+    switch (kernel) {
+    case ESCAPE_SCALAR:
+        return 1;
+    case ESCAPE_SSE2:
+#ifdef ESCAPE_HAVE_SSE2
+        return 1;
+#else
+        return 0;
+#endif
+    case ESCAPE_AVX2:
+#ifdef ESCAPE_HAVE_AVX2
+        return __builtin_cpu_supports("avx2");
+#else
+        return 0;
+#endif
+    }
+    return 0;
+}
+
+enum EscapeKernel escape_kernel(void)
+{
+    int kernel = atomic_load_explicit(&active_kernel, memory_order_relaxed);
+    if (kernel < 0) {
+        kernel = kernel_supported(ESCAPE_AVX2) ? ESCAPE_AVX2 : kernel_supported(ESCAPE_SSE2) ? ESCAPE_SSE2 : ESCAPE_SCALAR;
+        atomic_store_explicit(&active_kernel, kernel, memory_order_relaxed);
+    }
+    return (enum EscapeKernel)kernel;
+}
+
+const char *escape_kernel_name(enum EscapeKernel kernel)
+{
+    switch (kernel) {
+    case ESCAPE_SCALAR:
+        return "scalar";
+    case ESCAPE_SSE2:
+        return "sse2";
+    case ESCAPE_AVX2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+int escape_use_kernel(enum EscapeKernel kernel)
+{
+    if (!kernel_supported(kernel)) {
+        return -1;
+    }
+    atomic_store_explicit(&active_kernel, (int)kernel, memory_order_relaxed);
+    return 0;
+}
+
+static int append_html_entity(struct Buffer *out, unsigned char c)
+{
+    switch (c) {
+    case '&':
+        return buffer_append_len(out, "&amp;", 5);
+    case '<':
+        return buffer_append_len(out, "&lt;", 4);
+    case '>':
+        return buffer_append_len(out, "&gt;", 4);
+    default:
+        return buffer_append_len(out, "&quot;", 6);
+    }
+}
+
+static int append_json_escape(struct Buffer *out, unsigned char c)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    switch (c) {
+    case '"':
+        return buffer_append_len(out, "\\\"", 2);
+    case '\\':
+        return buffer_append_len(out, "\\\\", 2);
+    case '\b':
+        return buffer_append_len(out, "\\b", 2);
+    case '\f':
+        return buffer_append_len(out, "\\f", 2);
+    case '\n':
+        return buffer_append_len(out, "\\n", 2);
+    case '\r':
+        return buffer_append_len(out, "\\r", 2);
+    case '\t':
+        return buffer_append_len(out, "\\t", 2);
+    default: {
+        char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f]};
+        return buffer_append_len(out, esc, sizeof(esc));
+    }
+    }
+}
+
+int escape_html(struct Buffer *out, const char *src, size_t len)
+{
+    const struct EscapeScanner *scan = &scanners[escape_kernel()];
+    const unsigned char *s = (const unsigned char *)src;
+
+    /* The output is at least as long as the input. */
+    if (buffer_reserve(out, len) != 0) {
+        return -1;
+    }
+
+    size_t i = 0;
+    while (i < len) {
+        size_t run = scan->html(s + i, len - i);
+        if (run > 0 && buffer_append_len(out, src + i, run) != 0) {
+            return -1;
+        }
+        i += run;
+        if (i < len) {
+            if (append_html_entity(out, s[i]) != 0) {
+                return -1;
+            }
+            i++;
+        }
+    }
+    return 0;
+}
+
+int escape_json(struct Buffer *out, const char *src, size_t len)
+{
+    const struct EscapeScanner *scan = &scanners[escape_kernel()];
+    const unsigned char *s = (const unsigned char *)src;
+
+    if (buffer_reserve(out, len) != 0) {
+        return -1;
+    }
+
+    size_t i = 0;
+    while (i < len) {
+        size_t run = scan->json(s + i, len - i);
+        if (run > 0 && buffer_append_len(out, src + i, run) != 0) {
+            return -1;
+        }
+        i += run;
+        if (i < len) {
+            if (append_json_escape(out, s[i]) != 0) {
+                return -1;
+            }
+            i++;
+        }
+    }
+    return 0;
+}
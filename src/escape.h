@@ -0,0 +1,24 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include "util.h"
+
+#include <stddef.h>
+
+enum EscapeKernel {
+    ESCAPE_SCALAR,
+    ESCAPE_SSE2,
+    ESCAPE_AVX2,
+};
+
+/* Append src[0..len) to out, escaped for HTML text/attributes or a JSON string body. */
+int escape_html(struct Buffer *out, const char *src, size_t len);
+int escape_json(struct Buffer *out, const char *src, size_t len);
+
+/* The kernel picked at first use is the widest the CPU supports. */
+enum EscapeKernel escape_kernel(void);
+const char *escape_kernel_name(enum EscapeKernel kernel);
+/* Benchmarks force a narrower kernel; returns -1 if the CPU lacks it. */
+int escape_use_kernel(enum EscapeKernel kernel);
+
+#endif
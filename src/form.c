@@ -0,0 +1,155 @@
+#include "form.h"
+
+#include <string.h>
+
+/*
+ * Splits on '&' and '=' first and percent-decodes what lies between, the
+ * same order a tokenize-then-decode pass uses: an encoded %26 or %3D never
+ * acts as a separator. A malformed escape is kept literally. The first
+ * occurrence of a field wins and tokens without '=' are ignored. Bytes are
+ * decoded straight into the field buffers; everything else is skipped.
+ */
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static void emit(struct FormParser *p, char c)
+{
+    if (p->in_value) {
+        struct FormField *f = p->target;
+        if (f != NULL && f->len + 1 < f->size) {
+            f->out[f->len++] = c;
+            f->out[f->len] = '\0';
+        }
+    } else if (p->key_len + 1 < sizeof(p->key)) {
+        p->key[p->key_len++] = c;
+    } else {
+        p->key_overflow = 1;
+    }
+}
+
+/* Writes out a pending '%' (and its first digit) that did not form an escape. */
+static void flush_escape(struct FormParser *p)
+{
+    if (p->escape >= 1) {
+        emit(p, '%');
+    }
+    if (p->escape == 2) {
+        emit(p, p->escape_raw[0]);
+    }
+    p->escape = 0;
+}
+
+static void decode_byte(struct FormParser *p, char c)
+{
+    if (p->escape == 1) {
+        if (hex_value(c) >= 0) {
+            p->escape_raw[0] = c;
+            p->escape = 2;
+            return;
+        }
+        flush_escape(p);
+    } else if (p->escape == 2) {
+        if (hex_value(c) >= 0) {
+            emit(p, (char)((hex_value(p->escape_raw[0]) << 4) | hex_value(c)));
+            p->escape = 0;
+            return;
+        }
+        flush_escape(p);
+    }
+
+    if (c == '%') {
+        p->escape = 1;
+    } else if (c == '+') {
+        emit(p, ' ');
+    } else {
+        emit(p, c);
+    }
+}
+
+static void begin_value(struct FormParser *p)
+{
+    p->in_value = 1;
+    p->target = NULL;
+    if (p->key_overflow) {
+        return;
+    }
+
+    for (size_t i = 0; i < p->field_count; ++i) {
+        struct FormField *f = &p->fields[i];
+        if (!f->found && strlen(f->name) == p->key_len && memcmp(f->name, p->key, p->key_len) == 0) {
+            f->found = 1;
+            f->len = 0;
+            if (f->size > 0) {
+                f->out[0] = '\0';
+            }
+            p->target = f;
+            return;
+        }
+    }
+}
+
+static void end_token(struct FormParser *p)
+{
+    p->in_value = 0;
+    p->target = NULL;
+    p->key_len = 0;
+    p->key_overflow = 0;
+    p->escape = 0;
+}
+
+void form_parser_init(struct FormParser *p, struct FormField *fields, size_t field_count, size_t limit)
+{
+    memset(p, 0, sizeof(*p));
+    p->fields = fields;
+    p->field_count = field_count;
+    p->limit = limit;
+    for (size_t i = 0; i < field_count; ++i) {
+        fields[i].len = 0;
+        fields[i].found = 0;
+        if (fields[i].size > 0) {
+            fields[i].out[0] = '\0';
+        }
+    }
+}
+
+/* Returns -1 once more than limit bytes have been fed; nothing is parsed past it. */
+int form_parser_feed(struct FormParser *p, const char *data, size_t len)
+{
+    if (len > p->limit - p->consumed) {
+        p->consumed = p->limit;
+        return -1;
+    }
+    p->consumed += len;
+
+    for (size_t i = 0; i < len; ++i) {
+        char c = data[i];
+        if (c == '&') {
+            flush_escape(p);
+            end_token(p);
+        } else if (c == '=' && !p->in_value) {
+            flush_escape(p);
+            begin_value(p);
+        } else {
+            decode_byte(p, c);
+        }
+    }
+    return 0;
+}
+
+void form_parser_finish(struct FormParser *p)
+{
+    flush_escape(p);
+    end_token(p);
+}
@@ -0,0 +1,36 @@
+#ifndef FORM_H
+#define FORM_H
+
+#include <stddef.h>
+
+/* A field to capture: its decoded value is copied into out, truncated to size - 1. */
+struct FormField {
+    const char *name;
+    char *out;
+    size_t size;
+    size_t len;
+    int found;
+};
+
+enum { FORM_KEY_MAX = 32 };
+
+/* Incremental application/x-www-form-urlencoded parser. Keeps no body copy. */
+struct FormParser {
+    struct FormField *fields;
+    size_t field_count;
+    size_t limit;
+    size_t consumed;
+    int in_value;
+    char key[FORM_KEY_MAX];
+    size_t key_len;
+    int key_overflow;
+    struct FormField *target;
+    int escape;
+    char escape_raw[2];
+};
+
+void form_parser_init(struct FormParser *p, struct FormField *fields, size_t field_count, size_t limit);
+int form_parser_feed(struct FormParser *p, const char *data, size_t len);
+void form_parser_finish(struct FormParser *p);
+
+#endif
@@ -0,0 +1,440 @@
+#include "hot.h"
+
+#include "arena.h"
+#include "epoch.h"
+#include "logging.h"
+#include "metrics.h"
+#include "render.h"
+#include "sse.h"
+#include "trace.h"
+#include "util.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The newest HOT_WINDOW_MESSAGES messages live in a ring owned by the
+ * writer thread, each parsed, rendered and framed for SSE once. After every
+ * commit the writer copies the ring into a new immutable snapshot, builds
+ * the newest-page bodies into it and swaps it in with one atomic store.
+ * Readers load the current snapshot inside an epoch, so a read takes no
+ * lock and writes nothing shared; the replaced snapshot and the messages
+ * that fell out of the ring are freed once those readers are gone.
+ */
+
+static _Atomic(struct HotSnapshot *) current;
+static atomic_llong latest_id;
+static atomic_ullong publishes;
+static atomic_ullong cold_pages;
+
+/* Writer-side ring; the snapshots are read-only copies of it. */
+static struct HotMessage *ring[HOT_WINDOW_MESSAGES];
+static size_t ring_start;
+static size_t ring_count;
+static int ring_complete;
+/* Out of the ring but maybe still in the published snapshot. */
+static struct HotMessage *limbo;
+
+static void evict(struct HotMessage *hm)
+{
+    hm->retire_next = limbo;
+    limbo = hm;
+}
+
+static void hot_message_free(void *ptr)
+{
+    struct HotMessage *hm = ptr;
+    sse_event_release(hm->event);
+    free(hm);
+}
+
+/* Copies the record and its fragments (rendering them if missing) into one block. */
+static struct HotMessage *hot_message_new(const struct MessageRecord *m)
+{
+    struct Buffer html = {0};
+    struct Buffer json = {0};
+    const char *html_text = m->html_fragment;
+    size_t html_len = m->html_len;
+    const char *json_text = m->json_fragment;
+    size_t json_len = m->json_len;
+    if (html_text == NULL || json_text == NULL) {
+        if (render_message_html(&html, m) != 0 || render_message_json(&json, m) != 0) {
+            free(html.data);
+            free(json.data);
+            return NULL;
+        }
+        html_text = html.data;
+        html_len = html.len;
+        json_text = json.data;
+        json_len = json.len;
+    }
+
+    size_t nickname_len = strlen(m->nickname);
+    size_t content_len = strlen(m->content);
+    struct HotMessage *hm = malloc(sizeof(*hm) + nickname_len + content_len + html_len + json_len + 4);
+    if (hm != NULL) {
+        char *p = (char *)(hm + 1);
+        hm->record = *m;
+        hm->record.nickname = memcpy(p, m->nickname, nickname_len + 1);
+        p += nickname_len + 1;
+        hm->record.content = memcpy(p, m->content, content_len + 1);
+        p += content_len + 1;
+        hm->record.html_fragment = memcpy(p, html_text, html_len);
+        hm->record.html_len = html_len;
+        p[html_len] = '\0';
+        p += html_len + 1;
+        hm->record.json_fragment = memcpy(p, json_text, json_len);
+        hm->record.json_len = json_len;
+        p[json_len] = '\0';
+        hm->retire_next = NULL;
+        hm->event = sse_event_new(&hm->record);
+        if (hm->event == NULL) {
+            log_error("Failed building SSE event for message %lld", m->id);
+        }
+    }
+    free(html.data);
+    free(json.data);
+    return hm;
+}
+
+static void snapshot_free(void *ptr)
+{
+    struct HotSnapshot *snap = ptr;
+    for (size_t i = 0; i < CACHE_KIND_COUNT; ++i) {
+        cache_release(snap->bodies[i]);
+    }
+    free(snap);
+}
+
+/* The newest page, exactly as the SQLite read would render it. */
+static int build_bodies(struct HotSnapshot *snap)
+{
+    size_t first = snap->count > MESSAGE_PAGE_SIZE ? snap->count - MESSAGE_PAGE_SIZE : 0;
+    struct Buffer html = {0};
+    struct Buffer json = {0};
+    int rc = buffer_append(&html, "") | buffer_append(&json, "[");
+    for (size_t i = first; rc == 0 && i < snap->count; ++i) {
+        const struct MessageRecord *m = &snap->messages[i]->record;
+        rc |= buffer_append_len(&html, m->html_fragment, m->html_len);
+        if (i > first) {
+            rc |= buffer_append_len(&json, ",", 1);
+        }
+        rc |= buffer_append_len(&json, m->json_fragment, m->json_len);
+    }
+    rc |= buffer_append(&json, "]");
+    if (rc == 0 && snap->count == 0) {
+        html.len = 0;
+        rc = buffer_append(&html, render_no_messages_html);
+    }
+    char *home = rc == 0 ? render_home_page(html.data) : NULL;
+    if (home == NULL) {
+        free(html.data);
+        free(json.data);
+        return -1;
+    }
+
+    snap->bodies[CACHE_HOME] = cache_body_new(CACHE_HOME, snap->latest_id, home, strlen(home));
+    snap->bodies[CACHE_MESSAGES_HTML] = cache_body_new(CACHE_MESSAGES_HTML, snap->latest_id, html.data, html.len);
+    snap->bodies[CACHE_MESSAGES_JSON] = cache_body_new(CACHE_MESSAGES_JSON, snap->latest_id, json.data, json.len);
+    for (size_t i = 0; i < CACHE_KIND_COUNT; ++i) {
+        if (snap->bodies[i] == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Publishes the ring as a new snapshot, then retires what it replaced. */
+static int publish_ring(void)
+{
+    struct HotSnapshot *snap = calloc(1, sizeof(*snap));
+    if (snap == NULL) {
+        return -1;
+    }
+    snap->complete = ring_complete;
+    snap->count = ring_count;
+    for (size_t i = 0; i < ring_count; ++i) {
+        snap->messages[i] = ring[(ring_start + i) % HOT_WINDOW_MESSAGES];
+    }
+    snap->latest_id = ring_count > 0 ? snap->messages[ring_count - 1]->record.id : 0;
+    unsigned long long start = metrics_now_ns();
+    if (build_bodies(snap) != 0) {
+        log_error("Failed building hot window pages");
+        snapshot_free(snap);
+        return -1;
+    }
+    metrics_observe(METRIC_RENDER_SNAPSHOT, metrics_now_ns() - start);
+    trace_end("build hot window pages", start);
+
+    struct HotSnapshot *old = atomic_exchange(&current, snap);
+    atomic_store(&latest_id, snap->latest_id);
+    atomic_fetch_add_explicit(&publishes, 1, memory_order_relaxed);
+
+    /* Only after the swap: until then readers can still reach these. */
+    epoch_retire(old, snapshot_free);
+    while (limbo != NULL) {
+        struct HotMessage *next = limbo->retire_next;
+        epoch_retire(limbo, hot_message_free);
+        limbo = next;
+    }
+    return 0;
+}
+
+struct LoadState {
+    struct HotMessage **loaded;
+    size_t count;
+};
+
+static int load_one(const struct MessageRecord *m, void *ctx)
+{
+    struct LoadState *state = ctx;
+    struct HotMessage *hm = hot_message_new(m);
+    if (hm == NULL) {
+        return -1;
+    }
+    state->loaded[state->count++] = hm;
+    return 0;
+}
+
+/*
+ * Refills the whole window from SQLite: at startup, or to repair a failed
+ * publish. One row past the window is read, oldest first, only to learn
+ * whether older rows exist: a table of exactly HOT_WINDOW_MESSAGES rows is
+ * complete.
+ */
+static int load_from_db(void)
+{
+    struct HotMessage *loaded[HOT_WINDOW_MESSAGES + 1];
+    struct LoadState state = {loaded, 0};
+    int rows = db_read_newest(HOT_WINDOW_MESSAGES + 1, load_one, &state);
+    if (rows < 0) {
+        for (size_t i = 0; i < state.count; ++i) {
+            hot_message_free(loaded[i]);
+        }
+        return -1;
+    }
+
+    size_t skip = 0;
+    if (state.count > HOT_WINDOW_MESSAGES) {
+        hot_message_free(loaded[0]);
+        skip = 1;
+    }
+    for (size_t i = 0; i < ring_count; ++i) {
+        evict(ring[(ring_start + i) % HOT_WINDOW_MESSAGES]);
+    }
+    memcpy(ring, loaded + skip, (state.count - skip) * sizeof(*ring));
+    ring_start = 0;
+    ring_count = state.count - skip;
+    ring_complete = skip == 0;
+    return publish_ring();
+}
+
+int hot_init(void)
+{
+    if (load_from_db() != 0) {
+        log_error("Failed loading the hot message window");
+        return -1;
+    }
+    return 0;
+}
+
+void hot_shutdown(void)
+{
+    epoch_retire(atomic_exchange(&current, NULL), snapshot_free);
+    for (size_t i = 0; i < ring_count; ++i) {
+        evict(ring[(ring_start + i) % HOT_WINDOW_MESSAGES]);
+    }
+    while (limbo != NULL) {
+        struct HotMessage *next = limbo->retire_next;
+        epoch_retire(limbo, hot_message_free);
+        limbo = next;
+    }
+    ring_start = 0;
+    ring_count = 0;
+    atomic_store(&latest_id, 0);
+    epoch_drain();
+}
+
+/*
+ * Appends one committed batch, oldest first. Called by the writer thread
+ * only. If the batch cannot be added the window is reloaded from SQLite,
+ * so it never has a hole.
+ */
+int hot_publish(const struct MessageRecord *msgs, size_t count)
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    /* Of a batch larger than the window only its tail can stay. */
+    size_t skip = count > HOT_WINDOW_MESSAGES ? count - HOT_WINDOW_MESSAGES : 0;
+    struct HotMessage *added[HOT_WINDOW_MESSAGES];
+    size_t added_count = 0;
+    for (size_t i = skip; i < count; ++i) {
+        added[added_count] = hot_message_new(&msgs[i]);
+        if (added[added_count] == NULL) {
+            for (size_t j = 0; j < added_count; ++j) {
+                hot_message_free(added[j]);
+            }
+            log_error("Failed adding message %lld to the hot window, reloading it", msgs[i].id);
+            return load_from_db();
+        }
+        added_count++;
+    }
+
+    for (size_t i = 0; i < added_count; ++i) {
+        if (ring_count == HOT_WINDOW_MESSAGES) {
+            evict(ring[ring_start]);
+            ring_complete = 0;
+            ring[ring_start] = added[i];
+            ring_start = (ring_start + 1) % HOT_WINDOW_MESSAGES;
+        } else {
+            ring[(ring_start + ring_count) % HOT_WINDOW_MESSAGES] = added[i];
+            ring_count++;
+        }
+    }
+    if (skip > 0) {
+        ring_complete = 0;
+    }
+    if (publish_ring() != 0) {
+        log_error("Failed publishing the hot window, reloading it");
+        return load_from_db();
+    }
+    return 0;
+}
+
+const struct HotSnapshot *hot_enter(struct EpochRecord **guard)
+{
+    *guard = epoch_enter();
+    if (*guard == NULL) {
+        return NULL;
+    }
+    const struct HotSnapshot *snap = atomic_load(&current);
+    if (snap == NULL) {
+        epoch_exit(*guard);
+        *guard = NULL;
+    }
+    return snap;
+}
+
+void hot_exit(struct EpochRecord *guard)
+{
+    if (guard != NULL) {
+        epoch_exit(guard);
+    }
+}
+
+long long hot_latest_id(void)
+{
+    return atomic_load(&latest_id);
+}
+
+/* Index of the first message with an id above `id`. */
+static size_t first_after(const struct HotSnapshot *snap, long long id)
+{
+    size_t lo = 0;
+    size_t hi = snap->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (snap->messages[mid]->record.id <= id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* True when no message newer than `id` can be missing from the window. */
+static int covers_after(const struct HotSnapshot *snap, long long id)
+{
+    return snap->complete || (snap->count > 0 && id >= snap->messages[0]->record.id - 1);
+}
+
+const struct HotMessage *hot_find_after(const struct HotSnapshot *snap, long long id)
+{
+    size_t i = first_after(snap, id);
+    if (i == snap->count || !covers_after(snap, id)) {
+        return NULL;
+    }
+    return snap->messages[i];
+}
+
+/*
+ * A since=/before= page from the window, byte for byte what the SQLite
+ * read returns. NULL when the page reaches past the window's oldest message.
+ */
+char *hot_render_page(long long cursor, int limit, int newer, int as_json, struct MessagePage *page)
+{
+    struct EpochRecord *guard = NULL;
+    unsigned long long span = trace_begin();
+    const struct HotSnapshot *snap = hot_enter(&guard);
+    if (snap == NULL) {
+        return NULL;
+    }
+
+    size_t from = 0;
+    size_t to = 0;
+    int covered = 0;
+    if (newer) {
+        from = first_after(snap, cursor);
+        to = snap->count - from > (size_t)limit ? from + (size_t)limit : snap->count;
+        covered = covers_after(snap, cursor);
+        page->more = to < snap->count;
+        page->cursor = to > from ? snap->messages[to - 1]->record.id : cursor;
+    } else {
+        to = first_after(snap, cursor - 1);
+        from = to > (size_t)limit ? to - (size_t)limit : 0;
+        covered = snap->complete || to >= (size_t)limit;
+        page->more = to - from == (size_t)limit && (from > 0 || !snap->complete);
+        page->cursor = to > from ? snap->messages[from]->record.id : cursor;
+    }
+    if (!covered) {
+        hot_exit(guard);
+        atomic_fetch_add_explicit(&cold_pages, 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    struct Buffer out = {.arena = arena_thread()};
+    int rc = buffer_append(&out, "");
+    if (as_json) {
+        rc |= buffer_appendf(&out, "{\"cursor\":%lld,\"more\":%s,\"messages\":[", page->cursor, page->more ? "true" : "false");
+    }
+    for (size_t i = from; rc == 0 && i < to; ++i) {
+        const struct MessageRecord *m = &snap->messages[i]->record;
+        if (!as_json) {
+            rc |= buffer_append_len(&out, m->html_fragment, m->html_len);
+            continue;
+        }
+        if (i > from) {
+            rc |= buffer_append_len(&out, ",", 1);
+        }
+        rc |= buffer_append_len(&out, m->json_fragment, m->json_len);
+    }
+    if (as_json) {
+        rc |= buffer_append(&out, "]}");
+    }
+    hot_exit(guard);
+    trace_end("hot window page", span);
+
+    if (rc != 0) {
+        buffer_free(&out);
+        return NULL;
+    }
+    return buffer_detach(&out);
+}
+
+void hot_get_stats(struct HotStats *out)
+{
+    memset(out, 0, sizeof(*out));
+    struct EpochRecord *guard = NULL;
+    const struct HotSnapshot *snap = hot_enter(&guard);
+    if (snap != NULL) {
+        out->messages = snap->count;
+        out->complete = snap->complete;
+        hot_exit(guard);
+    }
+    out->publishes = atomic_load_explicit(&publishes, memory_order_relaxed);
+    out->cold_pages = atomic_load_explicit(&cold_pages, memory_order_relaxed);
+}
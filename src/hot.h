@@ -0,0 +1,53 @@
+#ifndef HOT_H
+#define HOT_H
+
+#include "cache.h"
+#include "config.h"
+#include "db.h"
+
+#include <stddef.h>
+
+struct EpochRecord;
+struct SseEvent;
+
+/* One message in the window; its strings are owned by it and never change. */
+struct HotMessage {
+    struct MessageRecord record;
+    /* The message's SSE frame, or NULL if it could not be built. */
+    struct SseEvent *event;
+    /* Writer-only link while waiting to be retired. */
+    struct HotMessage *retire_next;
+};
+
+/* An immutable view of the window, swapped whole on every publish. */
+struct HotSnapshot {
+    long long latest_id;
+    /* Nothing older than messages[0] exists, so every page is in range. */
+    int complete;
+    size_t count;
+    /* Newest page bodies, keyed by CacheKind. */
+    struct CachedBody *bodies[CACHE_KIND_COUNT];
+    /* Oldest first. */
+    struct HotMessage *messages[HOT_WINDOW_MESSAGES];
+};
+
+struct HotStats {
+    size_t messages;
+    int complete;
+    unsigned long long publishes;
+    unsigned long long cold_pages;
+};
+
+int hot_init(void);
+void hot_shutdown(void);
+int hot_publish(const struct MessageRecord *msgs, size_t count);
+/* Readers: the snapshot stays valid until hot_exit. NULL on failure. */
+const struct HotSnapshot *hot_enter(struct EpochRecord **guard);
+void hot_exit(struct EpochRecord *guard);
+long long hot_latest_id(void);
+/* First message after `id`, or NULL when the window does not reach back to it. */
+const struct HotMessage *hot_find_after(const struct HotSnapshot *snap, long long id);
+char *hot_render_page(long long cursor, int limit, int newer, int as_json, struct MessagePage *page);
+void hot_get_stats(struct HotStats *out);
+
+#endif
@@ -1,260 +1,408 @@
 #include "http.h"
 
+#include "arena.h"
+#include "assets.h"
+#include "cache.h"
+#include "compress.h"
 #include "config.h"
 #include "db.h"
+#include "db_stmt.h"
+#include "form.h"
+#include "hot.h"
 #include "logging.h"
+#include "metrics.h"
 #include "render.h"
+#include "sse.h"
+#include "trace.h"
 #include "util.h"
+#include "writer.h"
 
-#include <errno.h>
-#include <pthread.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
+enum PostField {
+    POST_NICKNAME,
+    POST_CLIENT_ID,
+    POST_MESSAGE,
+    POST_AJAX,
+    POST_FIELD_COUNT,
+};
+
+/*
+ * POST state, one allocation per request: the form is decoded into write
+ * as upload chunks arrive and write is what the writer thread queues.
+ * GETs carry no state; they are marked with get_request instead.
+ */
 struct ConnectionInfo {
-    char *body;
-    size_t body_len;
+    struct WriteRequest write;
+    struct FormParser form;
+    struct FormField fields[POST_FIELD_COUNT];
+    char ajax_value[8];
+    /* Set while write waits on the writer; the connection is suspended. */
+    int queued;
+    int ajax;
+    /* Status queued for the access line written when the request finishes. */
+    unsigned int status;
+    unsigned long long started_ns;
 };
 
-struct SseClient {
-    unsigned long seen_version;
-    char pending[128];
-    size_t pending_len;
-    size_t pending_off;
+static char get_request;
+
+/* Root span names, one per MetricRoute. */
+static const char *route_spans[] = {
+    "GET /", "GET /events", "GET /messages", "GET /messages.json", "POST /post", "GET /debug/cache",
+    "GET /debug/trace", "GET /metrics", "GET /favicon.ico", "GET /assets", "not found",
 };
+_Static_assert(sizeof(route_spans) / sizeof(route_spans[0]) == METRIC_ROUTE_COUNT, "one span name per MetricRoute");
 
-static pthread_mutex_t sse_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t sse_cond = PTHREAD_COND_INITIALIZER;
-static unsigned long sse_version = 0;
+static void post_begin(struct ConnectionInfo *ci)
+{
+    struct WriteRequest *req = &ci->write;
+    ci->fields[POST_NICKNAME] = (struct FormField){.name = "nickname", .out = req->nickname, .size = sizeof(req->nickname)};
+    ci->fields[POST_CLIENT_ID] = (struct FormField){.name = "client_id", .out = req->client_id, .size = sizeof(req->client_id)};
+    ci->fields[POST_MESSAGE] = (struct FormField){.name = "message", .out = req->message, .size = sizeof(req->message)};
+    ci->fields[POST_AJAX] = (struct FormField){.name = "ajax", .out = ci->ajax_value, .size = sizeof(ci->ajax_value)};
+    form_parser_init(&ci->form, ci->fields, POST_FIELD_COUNT, MAX_POST_BODY);
+}
 
-static int append_upload_data(struct ConnectionInfo *ci, const char *data, size_t size)
+/* Rejects a declared Content-Length over the cap before any body is read. */
+static int post_declared_too_large(struct MHD_Connection *connection)
 {
-    char *new_body = realloc(ci->body, ci->body_len + size + 1);
-    if (new_body == NULL) {
-        return -1;
+    const char *length = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Content-Length");
+    if (length == NULL) {
+        return 0;
     }
-
-    ci->body = new_body;
-    memcpy(ci->body + ci->body_len, data, size);
-    ci->body_len += size;
-    ci->body[ci->body_len] = '\0';
-    return 0;
+    char *end = NULL;
+    unsigned long long n = strtoull(length, &end, 10);
+    return end != length && n > MAX_POST_BODY;
 }
 
-static void sse_notify_message(void)
+static int queue_too_large(struct MHD_Connection *connection, const char *url)
 {
-    pthread_mutex_lock(&sse_mutex);
-    sse_version++;
-    pthread_cond_broadcast(&sse_cond);
-    pthread_mutex_unlock(&sse_mutex);
+    log_access("POST %s\tstatus=%u", url, MHD_HTTP_CONTENT_TOO_LARGE);
+    char *body = strdup("Request body too large");
+    if (body == NULL) {
+        return MHD_NO;
+    }
+    return queue_text_response(connection, MHD_HTTP_CONTENT_TOO_LARGE, "text/plain; charset=utf-8", body);
 }
 
-static int handle_get_home(struct MHD_Connection *connection)
+/*
+ * Returns 1 and stores the value when `name` is a valid id, 0 when absent,
+ * -1 when it is malformed or negative.
+ */
+static int get_cursor_arg(struct MHD_Connection *connection, const char *name, long long *out)
 {
-    char *page = render_home_page();
-    if (page == NULL) {
-        return MHD_NO;
+    const char *raw = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, name);
+    if (raw == NULL) {
+        return 0;
     }
 
-    return queue_text_response(connection, MHD_HTTP_OK, "text/html; charset=utf-8", page);
+    char *end = NULL;
+    long long v = strtoll(raw, &end, 10);
+    if (end == raw || *end != '\0' || v < 0) {
+        return -1;
+    }
+
+    *out = v;
+    return 1;
 }
 
-static int handle_get_messages(struct MHD_Connection *connection)
+static int queue_page_response(struct MHD_Connection *connection, const char *content_type, char *body, const struct MessagePage *page)
 {
-    char *messages = db_render_messages_html();
-    if (messages == NULL) {
+    size_t len = strlen(body);
+    struct MHD_Response *response = MHD_create_response_from_buffer(len, body, MHD_RESPMEM_MUST_FREE);
+    if (response == NULL) {
+        free(body);
         return MHD_NO;
     }
-
-    return queue_text_response(connection, MHD_HTTP_OK, "text/html; charset=utf-8", messages);
+    metrics_add(METRIC_BODY_BYTES, len);
+
+    char cursor[32];
+    snprintf(cursor, sizeof(cursor), "%lld", page->cursor);
+    MHD_add_response_header(response, "Content-Type", content_type);
+    MHD_add_response_header(response, "X-Message-Cursor", cursor);
+    MHD_add_response_header(response, "X-Message-More", page->more ? "1" : "0");
+    unsigned long long span = trace_begin();
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    trace_end("MHD_queue_response", span);
+    MHD_destroy_response(response);
+    return ret;
 }
 
-static int handle_get_messages_json(struct MHD_Connection *connection)
+static int queue_bad_cursor(struct MHD_Connection *connection, unsigned int *status)
 {
-    char *messages = db_render_messages_json();
-    if (messages == NULL) {
+    *status = MHD_HTTP_BAD_REQUEST;
+    char *body = strdup("Bad cursor");
+    if (body == NULL) {
         return MHD_NO;
     }
-
-    return queue_text_response(connection, MHD_HTTP_OK, "application/json; charset=utf-8", messages);
+    return queue_text_response(connection, MHD_HTTP_BAD_REQUEST, "text/plain; charset=utf-8", body);
 }
 
-static int handle_get_favicon(struct MHD_Connection *connection)
+/*
+ * Serves one of the newest-page bodies from the hot window. The ETag is the
+ * window's message version, which is an atomic load, so a matching
+ * If-None-Match is answered with a 304 before the snapshot is touched.
+ * *status is set to the status queued, here and in the handlers below.
+ */
+static int queue_cached_kind(struct MHD_Connection *connection, enum CacheKind kind, const char *content_type, unsigned int *status)
 {
-    char *body = strdup("");
+    char etag[64];
+    cache_etag(hot_latest_id(), etag, sizeof(etag));
+    const char *if_none_match = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "If-None-Match");
+    if (etag_matches(if_none_match, etag)) {
+        *status = MHD_HTTP_NOT_MODIFIED;
+        return queue_not_modified_response(connection, etag, "no-cache");
+    }
+
+    struct CachedBody *body = cache_acquire(kind);
     if (body == NULL) {
         return MHD_NO;
     }
-    return queue_text_response(connection, MHD_HTTP_NO_CONTENT, "image/x-icon", body);
+    return queue_cached_response(connection, content_type, body);
 }
 
-static void sse_free_callback(void *cls)
+static int handle_get_home(struct MHD_Connection *connection, unsigned int *status)
 {
-    free(cls);
+    return queue_cached_kind(connection, CACHE_HOME, "text/html; charset=utf-8", status);
 }
 
-static ssize_t sse_reader(void *cls, uint64_t pos, char *buf, size_t max)
+/*
+ * Without a cursor this is the cached newest page. since=<id> returns rows
+ * newer than id; before=<id> returns the rows just older than id (keyset
+ * pagination for history); limit=<n> sizes either page. A bare limit=<n>
+ * is the newest n rows, as before= with no upper bound. Pages inside the
+ * hot window never reach SQLite.
+ */
+static int handle_get_messages(struct MHD_Connection *connection, int as_json, unsigned int *status)
 {
-    (void)pos;
-
-    struct SseClient *client = (struct SseClient *)cls;
-    if (client == NULL || max == 0) {
-        return 0;
+    const char *content_type = as_json ? "application/json; charset=utf-8" : "text/html; charset=utf-8";
+    long long since = 0;
+    long long before = 0;
+    long long limit = MESSAGE_PAGE_SIZE;
+    int has_since = get_cursor_arg(connection, "since", &since);
+    int has_before = get_cursor_arg(connection, "before", &before);
+    int has_limit = get_cursor_arg(connection, "limit", &limit);
+
+    if (has_since < 0 || has_before < 0 || has_limit < 0 || (has_since && has_before) ||
+        limit < 1 || limit > MESSAGE_PAGE_MAX) {
+        return queue_bad_cursor(connection, status);
     }
 
-    if (client->pending_off >= client->pending_len) {
-        int has_update = 0;
-
-        pthread_mutex_lock(&sse_mutex);
-        unsigned long current = client->seen_version;
-
-        if (sse_version != current) {
-            has_update = 1;
-            client->seen_version = sse_version;
-        } else {
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            ts.tv_sec += 15;
-
-            int wait_rc = 0;
-            while (sse_version == current && wait_rc != ETIMEDOUT) {
-                wait_rc = pthread_cond_timedwait(&sse_cond, &sse_mutex, &ts);
-            }
+    if (!has_since && !has_before && !has_limit) {
+        return queue_cached_kind(connection, as_json ? CACHE_MESSAGES_JSON : CACHE_MESSAGES_HTML, content_type, status);
+    }
+    if (!has_since && !has_before) {
+        has_before = 1;
+        before = LLONG_MAX;
+    }
 
-            if (sse_version != current) {
-                has_update = 1;
-                client->seen_version = sse_version;
-            }
-        }
+    unsigned long long start = metrics_now_ns();
+    struct MessagePage page = {has_since ? since : before, 0};
+    char *rows = hot_render_page(page.cursor, (int)limit, has_since, as_json, &page);
+    if (rows == NULL && has_since) {
+        rows = as_json ? db_render_messages_since_json(since, (int)limit, &page)
+                       : db_render_messages_since_html(since, (int)limit, &page);
+    } else if (rows == NULL) {
+        rows = as_json ? db_render_messages_before_json(before, (int)limit, &page)
+                       : db_render_messages_before_html(before, (int)limit, &page);
+    }
+    if (rows == NULL) {
+        return MHD_NO;
+    }
+    metrics_observe(METRIC_RENDER_PAGE, metrics_now_ns() - start);
 
-        pthread_mutex_unlock(&sse_mutex);
+    return queue_page_response(connection, content_type, rows, &page);
+}
 
-        if (has_update) {
-            client->pending_len = (size_t)snprintf(client->pending,
-                                                   sizeof(client->pending),
-                                                   "event: message\ndata: %lu\n\n",
-                                                   client->seen_version);
-        } else {
-            client->pending_len = (size_t)snprintf(client->pending,
-                                                   sizeof(client->pending),
-                                                   ": ping\n\n");
-        }
-        client->pending_off = 0;
+static int handle_get_cache_stats(struct MHD_Connection *connection)
+{
+    struct Buffer out = {0};
+    int rc = buffer_appendf(&out, "{\"version\":%lld", db_latest_message_id());
+    for (int kind = 0; kind < CACHE_KIND_COUNT; ++kind) {
+        struct CacheStats stats;
+        cache_get_stats((enum CacheKind)kind, &stats);
+        rc |= buffer_appendf(&out,
+                             ",\"%s\":{\"hits\":%llu,\"misses\":%llu,\"builds\":%llu}",
+                             cache_kind_name((enum CacheKind)kind),
+                             stats.hits,
+                             stats.misses,
+                             stats.builds);
+    }
+    struct HotStats hot;
+    hot_get_stats(&hot);
+    rc |= buffer_appendf(&out,
+                         ",\"hot_window\":{\"size\":%d,\"messages\":%zu,\"complete\":%s,\"publishes\":%llu,\"cold_pages\":%llu}",
+                         HOT_WINDOW_MESSAGES,
+                         hot.messages,
+                         hot.complete ? "true" : "false",
+                         hot.publishes,
+                         hot.cold_pages);
+    struct LogStats log_stats;
+    log_get_stats(&log_stats);
+    rc |= buffer_appendf(&out, ",\"log\":{\"written\":%llu,\"dropped\":%llu}", log_stats.written, log_stats.dropped);
+    struct DbStmtStats stmt_stats;
+    db_stmt_get_stats(&stmt_stats);
+    rc |= buffer_appendf(&out,
+                         ",\"statements\":{\"prepares\":%llu,\"reuses\":%llu}",
+                         stmt_stats.prepares,
+                         stmt_stats.reuses);
+    struct DbPoolStats pool;
+    db_get_pool_stats(&pool);
+    rc |= buffer_appendf(&out,
+                         ",\"read_pool\":{\"size\":%u,\"in_use\":%u,\"acquires\":%llu,\"waits\":%llu,"
+                         "\"wait_us_avg\":%.1f,\"wait_us_max\":%.1f}}",
+                         pool.size,
+                         pool.in_use,
+                         pool.acquires,
+                         pool.waits,
+                         pool.waits > 0 ? pool.wait_us_total / (double)pool.waits : 0.0,
+                         pool.wait_us_max);
+    if (rc != 0) {
+        free(out.data);
+        return MHD_NO;
     }
 
-    size_t remaining = client->pending_len - client->pending_off;
-    size_t n = remaining < max ? remaining : max;
-    memcpy(buf, client->pending + client->pending_off, n);
-    client->pending_off += n;
-    return (ssize_t)n;
+    return queue_text_response(connection, MHD_HTTP_OK, "application/json; charset=utf-8", out.data);
 }
 
-static int handle_get_events(struct MHD_Connection *connection)
+/* Prometheus text format: the sharded metrics plus the subsystems' own counters. */
+static int handle_get_metrics(struct MHD_Connection *connection)
 {
-    struct SseClient *client = calloc(1, sizeof(*client));
-    if (client == NULL) {
+    struct Buffer out = {0};
+    int rc = metrics_append(&out);
+
+    struct HotStats hot;
+    hot_get_stats(&hot);
+    rc |= buffer_appendf(&out,
+                         "# HELP message_board_hot_window_messages Messages held in the hot window.\n"
+                         "# TYPE message_board_hot_window_messages gauge\n"
+                         "message_board_hot_window_messages %zu\n"
+                         "# HELP message_board_hot_window_publishes_total Hot window snapshots published.\n"
+                         "# TYPE message_board_hot_window_publishes_total counter\n"
+                         "message_board_hot_window_publishes_total %llu\n"
+                         "# HELP message_board_hot_window_cold_pages_total since=/before= pages read from SQLite.\n"
+                         "# TYPE message_board_hot_window_cold_pages_total counter\n"
+                         "message_board_hot_window_cold_pages_total %llu\n",
+                         hot.messages,
+                         hot.publishes,
+                         hot.cold_pages);
+    struct DbPoolStats pool;
+    db_get_pool_stats(&pool);
+    rc |= buffer_appendf(&out,
+                         "# HELP message_board_db_read_pool_waits_total Reader checkouts that found no free connection.\n"
+                         "# TYPE message_board_db_read_pool_waits_total counter\n"
+                         "message_board_db_read_pool_waits_total %llu\n"
+                         "# HELP message_board_db_read_pool_wait_seconds_total Time spent waiting for a reader.\n"
+                         "# TYPE message_board_db_read_pool_wait_seconds_total counter\n"
+                         "message_board_db_read_pool_wait_seconds_total %.6f\n",
+                         pool.waits,
+                         pool.wait_us_total / 1e6);
+    struct LogStats log_stats;
+    log_get_stats(&log_stats);
+    rc |= buffer_appendf(&out,
+                         "# HELP message_board_log_records_dropped_total Log records dropped on a full ring.\n"
+                         "# TYPE message_board_log_records_dropped_total counter\n"
+                         "message_board_log_records_dropped_total %llu\n",
+                         log_stats.dropped);
+    if (rc != 0) {
+        free(out.data);
         return MHD_NO;
     }
 
-    pthread_mutex_lock(&sse_mutex);
-    client->seen_version = sse_version;
-    pthread_mutex_unlock(&sse_mutex);
-    client->pending_len = (size_t)snprintf(client->pending, sizeof(client->pending), ": connected\n\n");
-    client->pending_off = 0;
+    return queue_text_response(connection, MHD_HTTP_OK, "text/plain; version=0.0.4; charset=utf-8", out.data);
+}
 
-    struct MHD_Response *response = MHD_create_response_from_callback(
-        MHD_SIZE_UNKNOWN,
-        256,
-        &sse_reader,
-        client,
-        &sse_free_callback);
-    if (response == NULL) {
-        free(client);
+/* Chrome trace-event JSON: load it in chrome://tracing or ui.perfetto.dev. */
+static int handle_get_trace(struct MHD_Connection *connection)
+{
+    struct Buffer out = {0};
+    if (trace_append_json(&out) != 0) {
+        free(out.data);
         return MHD_NO;
     }
 
-    MHD_add_response_header(response, "Content-Type", "text/event-stream");
-    MHD_add_response_header(response, "Cache-Control", "no-cache");
-    MHD_add_response_header(response, "Connection", "keep-alive");
-    MHD_add_response_header(response, "X-Accel-Buffering", "no");
-
-    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
-    MHD_destroy_response(response);
-    return ret;
+    return queue_text_response(connection, MHD_HTTP_OK, "application/json; charset=utf-8", out.data);
 }
 
-static char *read_file_to_string(const char *path)
+static int handle_get_favicon(struct MHD_Connection *connection)
 {
-    FILE *f = fopen(path, "rb");
-    if (f == NULL) {
-        return NULL;
+    char *body = strdup("");
+    if (body == NULL) {
+        return MHD_NO;
     }
+    return queue_text_response(connection, MHD_HTTP_NO_CONTENT, "image/x-icon", body);
+}
 
-    if (fseek(f, 0, SEEK_END) != 0) {
-        fclose(f);
-        return NULL;
+static int queue_not_found(struct MHD_Connection *connection, unsigned int *status)
+{
+    *status = MHD_HTTP_NOT_FOUND;
+    char *body = strdup("Not found");
+    if (body == NULL) {
+        return MHD_NO;
     }
+    return queue_text_response(connection, MHD_HTTP_NOT_FOUND, "text/plain; charset=utf-8", body);
+}
 
-    long size = ftell(f);
-    if (size < 0) {
-        fclose(f);
-        return NULL;
+static int handle_get_asset(struct MHD_Connection *connection, const char *url, unsigned int *status)
+{
+    int fingerprinted = 0;
+    const struct Asset *asset = assets_lookup(url, &fingerprinted);
+    if (asset == NULL) {
+        return queue_not_found(connection, status);
     }
 
-    rewind(f);
-
-    char *buf = malloc((size_t)size + 1);
-    if (buf == NULL) {
-        fclose(f);
-        return NULL;
+    /* A fingerprinted URL names exact bytes, so it never needs revalidating;
+     * the plain URL must be revalidated but usually ends in a 304. */
+    const char *cache_control = fingerprinted ? "public, max-age=31536000, immutable" : "no-cache";
+
+    enum Encoding encoding = compress_negotiate(connection);
+    const struct AssetVariant *variant = &asset->compressed[encoding];
+    const char *data = asset->data;
+    size_t len = asset->len;
+    const char *etag = asset->etag;
+    if (variant->data != NULL) {
+        data = variant->data;
+        len = variant->len;
+        etag = variant->etag;
+    } else {
+        encoding = ENCODING_IDENTITY;
     }
 
-    size_t read_n = fread(buf, 1, (size_t)size, f);
-    fclose(f);
-    if (read_n != (size_t)size) {
-        free(buf);
-        return NULL;
+    const char *if_none_match = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "If-None-Match");
+    if (etag_matches(if_none_match, etag)) {
+        *status = MHD_HTTP_NOT_MODIFIED;
+        return queue_not_modified_response(connection, etag, cache_control);
     }
 
-    buf[size] = '\0';
-    return buf;
-}
-
-static int handle_get_asset(struct MHD_Connection *connection, const char *url)
-{
-    const char *path = NULL;
-    const char *content_type = NULL;
-
-    if (strcmp(url, "/assets/styles.css") == 0) {
-        path = "assets/styles.css";
-        content_type = "text/css; charset=utf-8";
-    } else if (strcmp(url, "/assets/app.js") == 0) {
-        path = "assets/app.js";
-        content_type = "application/javascript; charset=utf-8";
-    } else {
+    struct MHD_Response *response = MHD_create_response_from_buffer(len, (void *)data, MHD_RESPMEM_PERSISTENT);
+    if (response == NULL) {
         return MHD_NO;
     }
-
-    char *body = read_file_to_string(path);
-    if (body == NULL) {
-        return MHD_NO;
+    metrics_add(METRIC_BODY_BYTES, len);
+
+    MHD_add_response_header(response, "Content-Type", asset->content_type);
+    MHD_add_response_header(response, "ETag", etag);
+    MHD_add_response_header(response, "Cache-Control", cache_control);
+    MHD_add_response_header(response, "Vary", "Accept-Encoding");
+    if (encoding != ENCODING_IDENTITY) {
+        MHD_add_response_header(response, "Content-Encoding", compress_encoding_name(encoding));
     }
-
-    return queue_text_response(connection, MHD_HTTP_OK, content_type, body);
+    unsigned long long span = trace_begin();
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    trace_end("MHD_queue_response", span);
+    MHD_destroy_response(response);
+    return ret;
 }
 
-static int handle_post_submit(struct MHD_Connection *connection, const struct ConnectionInfo *ci)
+static int handle_post_submit(struct MHD_Connection *connection, struct ConnectionInfo *ci)
 {
-    char nickname[MAX_NICKNAME] = {0};
-    char client_id[MAX_CLIENT_ID] = {0};
-    char message[MAX_MESSAGE] = {0};
-    char ajax[8] = {0};
-
-    if (!form_get_value(ci->body ? ci->body : "", "nickname", nickname, sizeof(nickname)) ||
-        !form_get_value(ci->body ? ci->body : "", "client_id", client_id, sizeof(client_id)) ||
-        !form_get_value(ci->body ? ci->body : "", "message", message, sizeof(message))) {
+    form_parser_finish(&ci->form);
+    if (!ci->fields[POST_NICKNAME].found || !ci->fields[POST_CLIENT_ID].found || !ci->fields[POST_MESSAGE].found) {
+        ci->status = MHD_HTTP_BAD_REQUEST;
         char *body = strdup("Bad request");
         if (body == NULL) {
             return MHD_NO;
@@ -262,9 +410,9 @@ static int handle_post_submit(struct MHD_Connection *connection, const struct Co
         return queue_text_response(connection, MHD_HTTP_BAD_REQUEST, "text/plain; charset=utf-8", body);
     }
 
-    form_get_value(ci->body ? ci->body : "", "ajax", ajax, sizeof(ajax));
-
-    if (nickname[0] == '\0' || client_id[0] == '\0' || message[0] == '\0') {
+    struct WriteRequest *req = &ci->write;
+    if (req->nickname[0] == '\0' || req->client_id[0] == '\0' || req->message[0] == '\0') {
+        ci->status = MHD_HTTP_BAD_REQUEST;
         char *body = strdup("Missing nickname, client_id, or message");
         if (body == NULL) {
             return MHD_NO;
@@ -272,8 +420,32 @@ static int handle_post_submit(struct MHD_Connection *connection, const struct Co
         return queue_text_response(connection, MHD_HTTP_BAD_REQUEST, "text/plain; charset=utf-8", body);
     }
 
-    if (db_insert_message(nickname, client_id, message) != 0) {
+    req->connection = connection;
+    ci->ajax = strcmp(ci->ajax_value, "1") == 0;
+    ci->queued = 1;
+    if (writer_submit(req) != 0) {
+        ci->queued = 0;
+        ci->status = MHD_HTTP_SERVICE_UNAVAILABLE;
+        char *body = strdup("Server is shutting down");
+        if (body == NULL) {
+            return MHD_NO;
+        }
+        return queue_text_response(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "text/plain; charset=utf-8", body);
+    }
+
+    /* Suspended; finish_post_submit answers once the batch commits. */
+    return MHD_YES;
+}
+
+static int finish_post_submit(struct MHD_Connection *connection, struct ConnectionInfo *ci)
+{
+    const struct WriteRequest *req = &ci->write;
+    trace_add(req->trace,
+              "group commit wait",
+              (unsigned long long)req->queued_at.tv_sec * 1000000000ull + (unsigned long long)req->queued_at.tv_nsec);
+    if (!req->ok) {
         log_error("Failed inserting message");
+        ci->status = MHD_HTTP_INTERNAL_SERVER_ERROR;
         char *body = strdup("Failed to save message");
         if (body == NULL) {
             return MHD_NO;
@@ -281,11 +453,8 @@ static int handle_post_submit(struct MHD_Connection *connection, const struct Co
         return queue_text_response(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "text/plain; charset=utf-8", body);
     }
 
-    sse_notify_message();
-
-    log_info("POST /post\tuser=%s\tclient=%s\tlen=%zu", nickname, client_id, strlen(message));
-
-    if (strcmp(ajax, "1") == 0) {
+    if (ci->ajax) {
+        ci->status = MHD_HTTP_OK;
         char *body = strdup("{\"ok\":true}");
         if (body == NULL) {
             return MHD_NO;
@@ -293,6 +462,7 @@ static int handle_post_submit(struct MHD_Connection *connection, const struct Co
         return queue_text_response(connection, MHD_HTTP_OK, "application/json; charset=utf-8", body);
     }
 
+    ci->status = MHD_HTTP_SEE_OTHER;
     return queue_redirect_response(connection, "/");
 }
 
@@ -309,79 +479,123 @@ enum MHD_Result answer_to_connection(void *cls,
     (void)version;
 
     if (*con_cls == NULL) {
+        if (strcmp(method, "POST") != 0) {
+            *con_cls = &get_request;
+            return MHD_YES;
+        }
+        if (post_declared_too_large(connection)) {
+            metrics_request(METRIC_ROUTE_POST, 0);
+            return queue_too_large(connection, url);
+        }
+
         struct ConnectionInfo *ci = calloc(1, sizeof(*ci));
         if (ci == NULL) {
             return MHD_NO;
         }
+        ci->started_ns = metrics_now_ns();
+        ci->write.trace = trace_sample();
+        post_begin(ci);
         *con_cls = ci;
         return MHD_YES;
     }
 
-    struct ConnectionInfo *ci = (struct ConnectionInfo *)*con_cls;
-
     if (strcmp(method, "POST") == 0) {
+        struct ConnectionInfo *ci = (struct ConnectionInfo *)*con_cls;
+        struct Trace *trace = ci->write.trace;
+        trace_attach(trace);
         if (*upload_data_size != 0) {
-            if (append_upload_data(ci, upload_data, *upload_data_size) != 0) {
-                free(ci->body);
+            int ret = MHD_YES;
+            unsigned long long span = trace_begin();
+            int too_large = form_parser_feed(&ci->form, upload_data, *upload_data_size) != 0;
+            trace_end("form decode", span);
+            if (too_large) {
+                /* Answered mid-upload; MHD closes the connection after sending it. */
+                ret = queue_too_large(connection, url);
+                metrics_request(METRIC_ROUTE_POST, metrics_now_ns() - ci->started_ns);
+                trace_finish(trace, route_spans[METRIC_ROUTE_POST]);
                 free(ci);
                 *con_cls = NULL;
-                return MHD_NO;
             }
+            trace_attach(NULL);
             *upload_data_size = 0;
-            return MHD_YES;
+            return ret;
         }
 
         int ret = MHD_NO;
-        if (strcmp(url, "/post") == 0) {
+        enum MetricRoute route = METRIC_ROUTE_POST;
+        if (ci->queued && ci->write.done) {
+            ret = finish_post_submit(connection, ci);
+        } else if (strcmp(url, "/post") == 0) {
             ret = handle_post_submit(connection, ci);
-        } else {
-            char *body = strdup("Not found");
-            if (body != NULL) {
-                ret = queue_text_response(connection, MHD_HTTP_NOT_FOUND, "text/plain; charset=utf-8", body);
+            if (ci->queued) {
+                trace_attach(NULL);
+                return ret;
             }
+        } else {
+            ret = queue_not_found(connection, &ci->status);
+            route = METRIC_ROUTE_NOT_FOUND;
         }
 
-        free(ci->body);
+        /* Same shape as the GET line, plus the post's fields (empty when absent). */
+        const struct WriteRequest *req = &ci->write;
+        log_access("POST %s\tstatus=%u\tuser=%s\tclient=%s\tlen=%zu",
+                   url,
+                   ret == MHD_NO ? MHD_HTTP_INTERNAL_SERVER_ERROR : ci->status,
+                   req->nickname,
+                   req->client_id,
+                   strlen(req->message));
+        metrics_request(route, metrics_now_ns() - ci->started_ns);
+        trace_finish(trace, route_spans[route]);
         free(ci);
         *con_cls = NULL;
+        arena_thread_reset();
         return ret;
     }
 
     int ret = MHD_NO;
+    unsigned int status = MHD_HTTP_OK;
+    unsigned long long start = metrics_now_ns();
+    struct Trace *trace = trace_sample();
+    trace_attach(trace);
+    enum MetricRoute route = METRIC_ROUTE_NOT_FOUND;
     if (strcmp(method, "GET") == 0 && strcmp(url, "/") == 0) {
-        ret = handle_get_home(connection);
-        log_info("GET /\t200");
+        ret = handle_get_home(connection, &status);
+        route = METRIC_ROUTE_HOME;
     } else if (strcmp(method, "GET") == 0 && strcmp(url, "/events") == 0) {
-        ret = handle_get_events(connection);
-        log_info("GET /events\t%s", ret == MHD_NO ? "500" : "200");
+        ret = sse_open(connection);
+        route = METRIC_ROUTE_EVENTS;
     } else if (strcmp(method, "GET") == 0 && strcmp(url, "/messages") == 0) {
-        ret = handle_get_messages(connection);
-        log_info("GET /messages\t200");
+        ret = handle_get_messages(connection, 0, &status);
+        route = METRIC_ROUTE_MESSAGES;
     } else if (strcmp(method, "GET") == 0 && strcmp(url, "/messages.json") == 0) {
-        ret = handle_get_messages_json(connection);
-        log_info("GET /messages.json\t200");
+        ret = handle_get_messages(connection, 1, &status);
+        route = METRIC_ROUTE_MESSAGES_JSON;
+    } else if (strcmp(method, "GET") == 0 && strcmp(url, "/debug/cache") == 0) {
+        ret = handle_get_cache_stats(connection);
+        route = METRIC_ROUTE_DEBUG_CACHE;
+    } else if (strcmp(method, "GET") == 0 && strcmp(url, "/debug/trace") == 0) {
+        ret = handle_get_trace(connection);
+        route = METRIC_ROUTE_DEBUG_TRACE;
+    } else if (strcmp(method, "GET") == 0 && strcmp(url, "/metrics") == 0) {
+        ret = handle_get_metrics(connection);
+        route = METRIC_ROUTE_METRICS;
     } else if (strcmp(method, "GET") == 0 && strcmp(url, "/favicon.ico") == 0) {
         ret = handle_get_favicon(connection);
-        log_info("GET /favicon.ico\t204");
+        route = METRIC_ROUTE_FAVICON;
+        status = MHD_HTTP_NO_CONTENT;
     } else if (strcmp(method, "GET") == 0 && strncmp(url, "/assets/", 8) == 0) {
-        ret = handle_get_asset(connection, url);
-        if (ret == MHD_NO) {
-            char *body = strdup("Not found");
-            if (body != NULL) {
-                ret = queue_text_response(connection, MHD_HTTP_NOT_FOUND, "text/plain; charset=utf-8", body);
-            }
-        }
-        log_info("GET %s\t%s", url, ret == MHD_NO ? "404" : "200");
+        ret = handle_get_asset(connection, url, &status);
+        route = METRIC_ROUTE_ASSETS;
     } else {
-        char *body = strdup("Not found");
-        if (body != NULL) {
-            ret = queue_text_response(connection, MHD_HTTP_NOT_FOUND, "text/plain; charset=utf-8", body);
-        }
-        log_info("%s %s\t404", method, url);
+        ret = queue_not_found(connection, &status);
     }
+    /* MHD_NO means nothing was queued and MHD drops the connection. */
+    log_access("%s %s\tstatus=%u", method, url, ret == MHD_NO ? MHD_HTTP_INTERNAL_SERVER_ERROR : status);
+    metrics_request(route, metrics_now_ns() - start);
+    trace_finish(trace, route_spans[route]);
 
-    free(ci->body);
-    free(ci);
+    /* Bodies rendered into this thread's arena were copied out; drop them all. */
+    arena_thread_reset();
     *con_cls = NULL;
     return ret;
 }
@@ -1,15 +1,448 @@
 #include "logging.h"
 
+#include "config.h"
+
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Callers format a record into a slot of a bounded lock-free ring and return;
+ * one flusher thread turns slots into lines and writes them. Each slot carries
+ * a sequence number (Vyukov's bounded queue), so producers only contend on the
+ * tail counter and never wait on the terminal or pipe. When the ring is full
+ * the record is dropped and counted, and the flusher reports the drops in the
+ * stream. The flusher sleeps only when the ring is empty; a producer takes the
+ * mutex just to wake it.
+ */
+
+_Static_assert((LOG_RING_RECORDS & (LOG_RING_RECORDS - 1)) == 0, "LOG_RING_RECORDS must be a power of two");
+
+struct LogRecord {
+    atomic_size_t seq;
+    enum LogLevel level;
+    unsigned int sample;
+    struct timespec ts;
+    size_t len;
+    char text[LOG_RECORD_MAX];
+};
+
+/* Worst case is every byte of a record escaped as \u00XX, plus the envelope. */
+struct LogLine {
+    size_t len;
+    char data[LOG_RECORD_MAX * 6 + 256];
+};
+
+static struct LogRecord ring[LOG_RING_RECORDS];
+static _Alignas(64) atomic_size_t ring_tail;
+static _Alignas(64) size_t ring_head;
+
+static atomic_int running;
+static atomic_int flusher_sleeping;
+static pthread_mutex_t flusher_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flusher_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t flusher_thread;
+static int flusher_stopping;
+
+static atomic_int min_level = LOG_INFO;
+static enum LogFormat log_format = LOG_FORMAT_TEXT;
+static unsigned int access_sample = 1;
+static _Thread_local unsigned int access_seen;
+
+static atomic_ullong written;
+static atomic_ullong dropped;
+static unsigned long long dropped_reported;
+
+static const char *level_names[] = {"debug", "info", "warn", "error"};
+static const char *level_tags[] = {"[DEBUG]\t", "[INFO]\t", "[WARN]\t", "[ERROR]\t"};
+
+static void put(struct LogLine *line, const char *s, size_t n)
+{
+    size_t room = sizeof(line->data) - line->len;
+    if (n > room) {
+        n = room;
+    }
+    memcpy(line->data + line->len, s, n);
+    line->len += n;
+}
+
+static void put_str(struct LogLine *line, const char *s)
+{
+    put(line, s, strlen(s));
+}
+
+/* Escapes for a double-quoted JSON string or key=value value. */
+static void put_escaped(struct LogLine *line, const char *s, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        char esc[8];
+        if (c == '"' || c == '\\') {
+            esc[0] = '\\';
+            esc[1] = (char)c;
+            put(line, esc, 2);
+        } else if (c < 0x20) {
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            put(line, esc, 6);
+        } else {
+            put(line, (const char *)&c, 1);
+        }
+    }
+}
+
+static int kv_needs_quotes(const char *s, size_t n)
+{
+    if (n == 0) {
+        return 1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (c <= ' ' || c == '"' || c == '=' || c == '\\') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int is_integer(const char *s, size_t n)
+{
+    size_t i = n > 0 && s[0] == '-' ? 1 : 0;
+    if (n == i || n - i > 18) {
+        return 0;
+    }
+    for (; i < n; ++i) {
+        if (s[i] < '0' || s[i] > '9') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void put_timestamp(struct LogLine *line, const struct timespec *ts)
+{
+    struct tm tm;
+    char buf[40];
+    gmtime_r(&ts->tv_sec, &tm);
+    size_t n = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    n += (size_t)snprintf(buf + n, sizeof(buf) - n, ".%03ldZ", ts->tv_nsec / 1000000L);
+    put(line, buf, n);
+}
+
+/* One key=value field of a record, in the structured formats. */
+static void put_field(struct LogLine *line, const char *key, size_t key_len, const char *value, size_t value_len)
+{
+    if (log_format == LOG_FORMAT_JSON) {
+        put(line, ",\"", 2);
+        put_escaped(line, key, key_len);
+        put(line, "\":", 2);
+        if (is_integer(value, value_len)) {
+            put(line, value, value_len);
+        } else {
+            put(line, "\"", 1);
+            put_escaped(line, value, value_len);
+            put(line, "\"", 1);
+        }
+        return;
+    }
+
+    put(line, " ", 1);
+    put(line, key, key_len);
+    put(line, "=", 1);
+    if (kv_needs_quotes(value, value_len)) {
+        put(line, "\"", 1);
+        put_escaped(line, value, value_len);
+        put(line, "\"", 1);
+    } else {
+        put(line, value, value_len);
+    }
+}
+
+static void format_record(const struct LogRecord *rec, struct LogLine *line)
+{
+    line->len = 0;
+    if (log_format == LOG_FORMAT_TEXT) {
+        put_str(line, level_tags[rec->level]);
+        put(line, rec->text, rec->len);
+        if (rec->sample > 1) {
+            char sample[24];
+            put(line, sample, (size_t)snprintf(sample, sizeof(sample), "\tsample=%u", rec->sample));
+        }
+        put(line, "\n", 1);
+        return;
+    }
+
+    int json = log_format == LOG_FORMAT_JSON;
+    put_str(line, json ? "{\"ts\":\"" : "ts=");
+    put_timestamp(line, &rec->ts);
+    put_str(line, json ? "\",\"level\":\"" : " level=");
+    put_str(line, level_names[rec->level]);
+    put_str(line, json ? "\",\"msg\":\"" : " msg=\"");
+
+    /* The message is the first segment; stray segments without '=' join it. */
+    const char *end = rec->text + rec->len;
+    int first = 1;
+    for (const char *seg = rec->text; seg <= end;) {
+        const char *stop = memchr(seg, '\t', (size_t)(end - seg));
+        stop = stop != NULL ? stop : end;
+        if (first || memchr(seg, '=', (size_t)(stop - seg)) == NULL) {
+            if (!first) {
+                put(line, " ", 1);
+            }
+            put_escaped(line, seg, (size_t)(stop - seg));
+            first = 0;
+        }
+        seg = stop + 1;
+    }
+    put(line, "\"", 1);
+
+    const char *fields = memchr(rec->text, '\t', rec->len);
+    for (const char *seg = fields != NULL ? fields + 1 : end + 1; seg <= end;) {
+        const char *stop = memchr(seg, '\t', (size_t)(end - seg));
+        stop = stop != NULL ? stop : end;
+        const char *eq = memchr(seg, '=', (size_t)(stop - seg));
+        if (eq != NULL) {
+            put_field(line, seg, (size_t)(eq - seg), eq + 1, (size_t)(stop - eq - 1));
+        }
+        seg = stop + 1;
+    }
+    if (rec->sample > 1) {
+        char sample[16];
+        put_field(line, "sample", 6, sample, (size_t)snprintf(sample, sizeof(sample), "%u", rec->sample));
+    }
+    put_str(line, json ? "}\n" : "\n");
+}
+
+static void write_record(const struct LogRecord *rec)
+{
+    static struct LogLine line;
+    format_record(rec, &line);
+    fwrite(line.data, 1, line.len, rec->level >= LOG_WARN ? stderr : stdout);
+}
+
+static void fill_record(struct LogRecord *rec, enum LogLevel level, unsigned int sample, const char *fmt, va_list args)
+{
+    rec->level = level;
+    rec->sample = sample;
+    clock_gettime(CLOCK_REALTIME, &rec->ts);
+    int n = vsnprintf(rec->text, sizeof(rec->text), fmt, args);
+    rec->len = n < 0 ? 0 : (size_t)n < sizeof(rec->text) ? (size_t)n : sizeof(rec->text) - 1;
+}
+
+static void enqueue(enum LogLevel level, unsigned int sample, const char *fmt, va_list args)
+{
+    size_t pos = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    struct LogRecord *rec = NULL;
+    for (;;) {
+        rec = &ring[pos & (LOG_RING_RECORDS - 1)];
+        size_t seq = atomic_load_explicit(&rec->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring_tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+        }
+    }
+
+    fill_record(rec, level, sample, fmt, args);
+    /* Sequentially consistent, paired with the flusher's sleeping flag. */
+    atomic_store(&rec->seq, pos + 1);
+    if (atomic_load(&flusher_sleeping)) {
+        pthread_mutex_lock(&flusher_mutex);
+        pthread_cond_signal(&flusher_cond);
+        pthread_mutex_unlock(&flusher_mutex);
+    }
+}
+
+static void log_write(enum LogLevel level, unsigned int sample, const char *fmt, va_list args)
+{
+    if (atomic_load_explicit(&running, memory_order_acquire)) {
+        enqueue(level, sample, fmt, args);
+        return;
+    }
+
+    struct LogRecord rec;
+    struct LogLine line;
+    fill_record(&rec, level, sample, fmt, args);
+    format_record(&rec, &line);
+    fwrite(line.data, 1, line.len, level >= LOG_WARN ? stderr : stdout);
+    atomic_fetch_add_explicit(&written, 1, memory_order_relaxed);
+}
+
+static int ring_ready(void)
+{
+    const struct LogRecord *rec = &ring[ring_head & (LOG_RING_RECORDS - 1)];
+    return atomic_load(&rec->seq) == ring_head + 1;
+}
+
+/* Flusher side: writes every published record; returns how many. */
+static size_t drain(void)
+{
+    size_t n = 0;
+    while (ring_ready()) {
+        struct LogRecord *rec = &ring[ring_head & (LOG_RING_RECORDS - 1)];
+        write_record(rec);
+        atomic_store_explicit(&rec->seq, ring_head + LOG_RING_RECORDS, memory_order_release);
+        ring_head++;
+        n++;
+    }
+
+    unsigned long long lost = atomic_load_explicit(&dropped, memory_order_relaxed);
+    if (lost != dropped_reported) {
+        struct LogRecord rec = {.level = LOG_WARN, .sample = 1};
+        clock_gettime(CLOCK_REALTIME, &rec.ts);
+        rec.len = (size_t)snprintf(rec.text, sizeof(rec.text), "Log records dropped\tcount=%llu", lost - dropped_reported);
+        write_record(&rec);
+        dropped_reported = lost;
+        n++;
+    }
+    if (n > 0) {
+        atomic_fetch_add_explicit(&written, n, memory_order_relaxed);
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return n;
+}
+
+static void *flusher_main(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        if (drain() > 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&flusher_mutex);
+        atomic_store(&flusher_sleeping, 1);
+        while (!flusher_stopping && !ring_ready()) {
+            pthread_cond_wait(&flusher_cond, &flusher_mutex);
+        }
+        atomic_store(&flusher_sleeping, 0);
+        int stopping = flusher_stopping;
+        pthread_mutex_unlock(&flusher_mutex);
+
+        if (stopping) {
+            drain();
+            return NULL;
+        }
+    }
+}
+
+int log_start(const struct LogOptions *opts)
+{
+    atomic_store(&min_level, (int)opts->level);
+    log_format = opts->format;
+    access_sample = opts->access_sample > 0 ? opts->access_sample : 1;
+
+    for (size_t i = 0; i < LOG_RING_RECORDS; ++i) {
+        atomic_init(&ring[i].seq, i);
+    }
+    atomic_store(&ring_tail, 0);
+    ring_head = 0;
+    flusher_stopping = 0;
+
+    if (pthread_create(&flusher_thread, NULL, flusher_main, NULL) != 0) {
+        log_error("Failed starting log flusher, logging synchronously");
+        return -1;
+    }
+    atomic_store_explicit(&running, 1, memory_order_release);
+    return 0;
+}
+
+void log_stop(void)
+{
+    if (!atomic_load(&running)) {
+        return;
+    }
+    atomic_store(&running, 0);
+
+    pthread_mutex_lock(&flusher_mutex);
+    flusher_stopping = 1;
+    pthread_cond_signal(&flusher_cond);
+    pthread_mutex_unlock(&flusher_mutex);
+    pthread_join(flusher_thread, NULL);
+
+    /* Records that landed after the flusher's last pass. */
+    drain();
+}
+
+void log_set_level(enum LogLevel level)
+{
+    atomic_store_explicit(&min_level, (int)level, memory_order_relaxed);
+}
+
+int log_parse_level(const char *s, enum LogLevel *out)
+{
+    for (int i = LOG_DEBUG; i <= LOG_ERROR; ++i) {
+        if (strcmp(s, level_names[i]) == 0) {
+            *out = (enum LogLevel)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int log_parse_format(const char *s, enum LogFormat *out)
+{
+    static const char *names[] = {"text", "kv", "json"};
+    for (int i = LOG_FORMAT_TEXT; i <= LOG_FORMAT_JSON; ++i) {
+        if (strcmp(s, names[i]) == 0) {
+            *out = (enum LogFormat)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void log_get_stats(struct LogStats *out)
+{
+    out->written = atomic_load_explicit(&written, memory_order_relaxed);
+    out->dropped = atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+static int enabled(enum LogLevel level)
+{
+    return (int)level >= atomic_load_explicit(&min_level, memory_order_relaxed);
+}
+
+void log_debug(const char *fmt, ...)
+{
+    if (!enabled(LOG_DEBUG)) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    log_write(LOG_DEBUG, 1, fmt, args);
+    va_end(args);
+}
 
 void log_info(const char *fmt, ...)
 {
+    if (!enabled(LOG_INFO)) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    log_write(LOG_INFO, 1, fmt, args);
+    va_end(args);
+}
+
+void log_warn(const char *fmt, ...)
+{
+    if (!enabled(LOG_WARN)) {
+        return;
+    }
     va_list args;
     va_start(args, fmt);
-    fputs("[INFO]\t", stdout);
-    vfprintf(stdout, fmt, args);
-    fputc('\n', stdout);
+    log_write(LOG_WARN, 1, fmt, args);
     va_end(args);
 }
 
@@ -17,8 +450,17 @@ void log_error(const char *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    fputs("[ERROR]\t", stderr);
-    vfprintf(stderr, fmt, args);
-    fputc('\n', stderr);
+    log_write(LOG_ERROR, 1, fmt, args);
+    va_end(args);
+}
+
+void log_access(const char *fmt, ...)
+{
+    if (!enabled(LOG_INFO) || (access_sample > 1 && access_seen++ % access_sample != 0)) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    log_write(LOG_INFO, access_sample, fmt, args);
     va_end(args);
 }
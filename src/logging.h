@@ -1,7 +1,49 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
+enum LogLevel {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+};
+
+enum LogFormat {
+    LOG_FORMAT_TEXT,
+    LOG_FORMAT_KV,
+    LOG_FORMAT_JSON,
+};
+
+struct LogOptions {
+    enum LogLevel level;
+    enum LogFormat format;
+    /* Keep one access line in this many, per thread; 1 keeps them all. */
+    unsigned int access_sample;
+};
+
+struct LogStats {
+    unsigned long long written;
+    unsigned long long dropped;
+};
+
+/*
+ * A record is "message\tkey=value\tkey=value"; the formatter turns the
+ * fields into key=value pairs or JSON members. Until log_start (and after
+ * log_stop) records are written synchronously by the caller.
+ */
+int log_start(const struct LogOptions *opts);
+/* Writes every queued record, then stops the flusher. */
+void log_stop(void);
+void log_set_level(enum LogLevel level);
+int log_parse_level(const char *s, enum LogLevel *out);
+int log_parse_format(const char *s, enum LogFormat *out);
+void log_get_stats(struct LogStats *out);
+
+void log_debug(const char *fmt, ...);
 void log_info(const char *fmt, ...);
+void log_warn(const char *fmt, ...);
 void log_error(const char *fmt, ...);
+/* One per request, at info level; sampled and tagged sample=N when N > 1. */
+void log_access(const char *fmt, ...);
 
 #endif
@@ -1,44 +1,70 @@
+#include "assets.h"
 #include "config.h"
 #include "db.h"
-#include "http.h"
 #include "logging.h"
+#include "render.h"
+#include "server.h"
 
 #include <microhttpd.h>
 #include <stdio.h>
 
-int main(void)
+int main(int argc, char **argv)
 {
+    struct ServerOptions opts;
+    if (server_parse_args(argc, argv, &opts) != 0) {
+        return 2;
+    }
+
+    /* On failure records are written synchronously instead. */
+    log_start(&opts.log);
     log_info("Program started");
 
-    if (db_init() != 0) {
+    if (db_init(opts.db_readers) != 0) {
         log_error("Database initialization failed");
+        log_stop();
+        return 1;
+    }
+
+    if (assets_init() != 0 || render_init() != 0) {
+        log_error("Asset loading failed");
+        assets_free();
+        db_close();
+        log_stop();
         return 1;
     }
 
-    struct MHD_Daemon *daemon = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION,
-                                                 PORT,
-                                                 NULL,
-                                                 NULL,
-                                                 &answer_to_connection,
-                                                 NULL,
-                                                 MHD_OPTION_END);
+    struct MHD_Daemon *daemon = server_start(&opts);
     if (daemon == NULL) {
         log_error("Failed to start MHD daemon");
+        render_free();
+        assets_free();
         db_close();
+        log_stop();
         return 1;
     }
 
-    log_info("MHD daemon started successfully");
+    if (opts.mode == SERVER_MODE_POOL) {
+        log_info("MHD daemon started successfully\tmode=%s\tworkers=%u\tdb_readers=%u",
+                 server_mode_name(opts.mode),
+                 opts.workers,
+                 opts.db_readers);
+    } else {
+        log_info("MHD daemon started successfully\tmode=%s\tdb_readers=%u", server_mode_name(opts.mode), opts.db_readers);
+    }
     log_info("Server running on port %d. Press enter to stop.", PORT);
     printf("Open in browser: http://127.0.0.1:%d/\n", PORT);
     getchar();
 
     log_info("Stopping MHD daemon");
-    MHD_stop_daemon(daemon);
+    server_stop(daemon);
+
+    render_free();
+    assets_free();
 
     log_info("Closing database");
     db_close();
 
     log_info("Program ending");
+    log_stop();
     return 0;
 }
@@ -0,0 +1,207 @@
+#include "metrics.h"
+
+#include "config.h"
+#include "util.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Upper bounds in ns; the last bucket is +Inf. */
+static const unsigned long long bucket_bounds[] = {
+    50000ull,
+    100000ull,
+    250000ull,
+    500000ull,
+    1000000ull,
+    2500000ull,
+    5000000ull,
+    10000000ull,
+    25000000ull,
+    50000000ull,
+    100000000ull,
+    250000000ull,
+    500000000ull,
+    1000000000ull,
+    2500000000ull,
+};
+static const char *bucket_labels[] = {
+    "5e-05", "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01",
+    "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5", "+Inf",
+};
+
+#define BUCKET_COUNT (sizeof(bucket_bounds) / sizeof(bucket_bounds[0]) + 1)
+#define HISTOGRAM_SLOTS (METRIC_ROUTE_COUNT + METRIC_HISTOGRAM_COUNT)
+
+struct Histogram {
+    atomic_ullong buckets[BUCKET_COUNT];
+    atomic_ullong sum_ns;
+};
+
+/* Aligned so no two shards share a cache line. */
+struct MetricsShard {
+    _Alignas(64) atomic_ullong counters[METRIC_COUNTER_COUNT];
+    struct Histogram histograms[HISTOGRAM_SLOTS];
+};
+
+static struct MetricsShard shards[METRICS_SHARDS];
+static atomic_uint next_shard;
+static _Thread_local struct MetricsShard *thread_shard;
+
+static const char *route_names[] = {
+    "home", "events", "messages", "messages_json", "post", "debug_cache", "debug_trace", "metrics", "favicon", "assets", "not_found",
+};
+static const char *cache_endpoints[] = {"home", "messages_html", "messages_json"};
+static const char *render_names[] = {"snapshot", "page"};
+
+static struct MetricsShard *shard_get(void)
+{
+    if (thread_shard == NULL) {
+        unsigned int i = atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed);
+        thread_shard = &shards[i % METRICS_SHARDS];
+    }
+    return thread_shard;
+}
+
+unsigned long long metrics_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+void metrics_add(enum MetricCounter counter, unsigned long long n)
+{
+    atomic_fetch_add_explicit(&shard_get()->counters[counter], n, memory_order_relaxed);
+}
+
+static void observe(size_t slot, unsigned long long ns)
+{
+    size_t bucket = 0;
+    while (bucket < BUCKET_COUNT - 1 && ns > bucket_bounds[bucket]) {
+        bucket++;
+    }
+    struct Histogram *h = &shard_get()->histograms[slot];
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+}
+
+void metrics_observe(enum MetricHistogram histogram, unsigned long long ns)
+{
+    observe(METRIC_ROUTE_COUNT + (size_t)histogram, ns);
+}
+
+void metrics_request(enum MetricRoute route, unsigned long long ns)
+{
+    observe((size_t)route, ns);
+}
+
+unsigned long long metrics_counter(enum MetricCounter counter)
+{
+    unsigned long long total = 0;
+    for (size_t i = 0; i < METRICS_SHARDS; ++i) {
+        total += atomic_load_explicit(&shards[i].counters[counter], memory_order_relaxed);
+    }
+    return total;
+}
+
+struct HistogramTotals {
+    unsigned long long buckets[BUCKET_COUNT];
+    unsigned long long count;
+    unsigned long long sum_ns;
+};
+
+static void histogram_totals(size_t slot, struct HistogramTotals *out)
+{
+    *out = (struct HistogramTotals){{0}, 0, 0};
+    for (size_t i = 0; i < METRICS_SHARDS; ++i) {
+        const struct Histogram *h = &shards[i].histograms[slot];
+        for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+            out->buckets[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        }
+        out->sum_ns += atomic_load_explicit(&h->sum_ns, memory_order_relaxed);
+    }
+    for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+        out->count += out->buckets[b];
+    }
+}
+
+/* One histogram's series; label is `key="value"` or empty. */
+static int append_histogram(struct Buffer *out, const char *name, const char *label, const struct HistogramTotals *t)
+{
+    const char *sep = label[0] != '\0' ? "," : "";
+    const char *open = label[0] != '\0' ? "{" : "";
+    const char *close = label[0] != '\0' ? "}" : "";
+    int rc = 0;
+    unsigned long long cumulative = 0;
+    for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+        cumulative += t->buckets[b];
+        rc |= buffer_appendf(out, "%s_bucket{%s%sle=\"%s\"} %llu\n", name, label, sep, bucket_labels[b], cumulative);
+    }
+    rc |= buffer_appendf(out, "%s_sum%s%s%s %.9f\n", name, open, label, close, (double)t->sum_ns / 1e9);
+    rc |= buffer_appendf(out, "%s_count%s%s%s %llu\n", name, open, label, close, t->count);
+    return rc;
+}
+
+static int append_header(struct Buffer *out, const char *name, const char *type, const char *help)
+{
+    return buffer_appendf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+int metrics_append(struct Buffer *out)
+{
+    struct HistogramTotals routes[METRIC_ROUTE_COUNT];
+    for (size_t r = 0; r < METRIC_ROUTE_COUNT; ++r) {
+        histogram_totals(r, &routes[r]);
+    }
+
+    char label[64];
+    int rc = append_header(out, "message_board_http_requests_total", "counter", "Requests answered, by route.");
+    for (size_t r = 0; r < METRIC_ROUTE_COUNT; ++r) {
+        rc |= buffer_appendf(out, "message_board_http_requests_total{route=\"%s\"} %llu\n", route_names[r], routes[r].count);
+    }
+    rc |= append_header(out,
+                        "message_board_http_request_duration_seconds",
+                        "histogram",
+                        "Time from the first request callback to the queued response, by route.");
+    for (size_t r = 0; r < METRIC_ROUTE_COUNT; ++r) {
+        snprintf(label, sizeof(label), "route=\"%s\"", route_names[r]);
+        rc |= append_histogram(out, "message_board_http_request_duration_seconds", label, &routes[r]);
+    }
+
+    rc |= append_header(out, "message_board_http_response_body_bytes_total", "counter", "Response body bytes queued, SSE included.");
+    rc |= buffer_appendf(out, "message_board_http_response_body_bytes_total %llu\n", metrics_counter(METRIC_BODY_BYTES));
+
+    unsigned long long opened = metrics_counter(METRIC_SSE_OPENED);
+    unsigned long long closed = metrics_counter(METRIC_SSE_CLOSED);
+    rc |= append_header(out, "message_board_sse_clients", "gauge", "Connected /events streams.");
+    rc |= buffer_appendf(out, "message_board_sse_clients %llu\n", opened > closed ? opened - closed : 0);
+    rc |= append_header(out, "message_board_sse_broadcasts_total", "counter", "Published batches that woke the parked streams.");
+    rc |= buffer_appendf(out, "message_board_sse_broadcasts_total %llu\n", metrics_counter(METRIC_SSE_BROADCASTS));
+    rc |= append_header(out, "message_board_sse_events_sent_total", "counter", "Message events handed to /events streams.");
+    rc |= buffer_appendf(out, "message_board_sse_events_sent_total %llu\n", metrics_counter(METRIC_SSE_EVENTS));
+
+    rc |= append_header(out, "message_board_cache_hits_total", "counter", "Newest-page bodies served from the hot window.");
+    for (size_t k = 0; k < sizeof(cache_endpoints) / sizeof(cache_endpoints[0]); ++k) {
+        rc |= buffer_appendf(out,
+                             "message_board_cache_hits_total{endpoint=\"%s\"} %llu\n",
+                             cache_endpoints[k],
+                             metrics_counter((enum MetricCounter)(METRIC_CACHE_HITS_HOME + k)));
+    }
+
+    struct HistogramTotals t;
+    rc |= append_header(out, "message_board_db_insert_batch_duration_seconds", "histogram", "Writer transactions, insert to commit.");
+    histogram_totals(METRIC_ROUTE_COUNT + METRIC_DB_INSERT_BATCH, &t);
+    rc |= append_histogram(out, "message_board_db_insert_batch_duration_seconds", "", &t);
+
+    rc |= append_header(out,
+                        "message_board_render_duration_seconds",
+                        "histogram",
+                        "Rendering: hot window snapshot bodies, and since=/before= pages.");
+    for (size_t i = 0; i < sizeof(render_names) / sizeof(render_names[0]); ++i) {
+        histogram_totals(METRIC_ROUTE_COUNT + METRIC_RENDER_SNAPSHOT + i, &t);
+        snprintf(label, sizeof(label), "what=\"%s\"", render_names[i]);
+        rc |= append_histogram(out, "message_board_render_duration_seconds", label, &t);
+    }
+    return rc;
+}
@@ -0,0 +1,53 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+struct Buffer;
+
+enum MetricRoute {
+    METRIC_ROUTE_HOME,
+    METRIC_ROUTE_EVENTS,
+    METRIC_ROUTE_MESSAGES,
+    METRIC_ROUTE_MESSAGES_JSON,
+    METRIC_ROUTE_POST,
+    METRIC_ROUTE_DEBUG_CACHE,
+    METRIC_ROUTE_DEBUG_TRACE,
+    METRIC_ROUTE_METRICS,
+    METRIC_ROUTE_FAVICON,
+    METRIC_ROUTE_ASSETS,
+    METRIC_ROUTE_NOT_FOUND,
+    METRIC_ROUTE_COUNT,
+};
+
+enum MetricCounter {
+    METRIC_SSE_OPENED,
+    METRIC_SSE_CLOSED,
+    METRIC_SSE_BROADCASTS,
+    METRIC_SSE_EVENTS,
+    METRIC_BODY_BYTES,
+    /* One per CacheKind, in the same order. */
+    METRIC_CACHE_HITS_HOME,
+    METRIC_CACHE_HITS_MESSAGES_HTML,
+    METRIC_CACHE_HITS_MESSAGES_JSON,
+    METRIC_COUNTER_COUNT,
+};
+
+enum MetricHistogram {
+    METRIC_DB_INSERT_BATCH,
+    METRIC_RENDER_SNAPSHOT,
+    METRIC_RENDER_PAGE,
+    METRIC_HISTOGRAM_COUNT,
+};
+
+/*
+ * Counters and histograms are sharded by thread: each thread adds to its own
+ * cache line and a scrape sums the shards, so recording never contends.
+ */
+unsigned long long metrics_now_ns(void);
+void metrics_add(enum MetricCounter counter, unsigned long long n);
+void metrics_observe(enum MetricHistogram histogram, unsigned long long ns);
+void metrics_request(enum MetricRoute route, unsigned long long ns);
+unsigned long long metrics_counter(enum MetricCounter counter);
+/* Appends every series above in the Prometheus text format. */
+int metrics_append(struct Buffer *out);
+
+#endif
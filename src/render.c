@@ -1,102 +1,187 @@
 #include "render.h"
 
+#include "assets.h"
 #include "db.h"
+#include "escape.h"
+#include "logging.h"
+#include "template.h"
+#include "trace.h"
 #include "util.h"
 
+#ifndef MESSAGE_BOARD_DEV_ASSETS
+#include "embedded.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define TEMPLATE_MARKER "{{MESSAGES}}"
-
-static char *read_file_to_string(const char *path)
+/*
+ * The page is built once at startup from the pre-split template: everything
+ * before {{MESSAGES}} becomes page_head and everything after page_tail, with
+ * {{ASSET:name}} already expanded to fingerprinted URLs. Serving a page is
+ * then two memcpys around the message list.
+ */
+static char *page_head;
+static size_t page_head_len;
+static char *page_tail;
+static size_t page_tail_len;
+
+const char render_no_messages_html[] =
+    "<li class=\"rounded-lg border border-dashed border-slate-300 bg-white px-3 py-4 text-center text-sm text-slate-500 dark:border-slate-700 dark:bg-slate-900 dark:text-slate-300\">No messages yet.</li>";
+
+static unsigned int nickname_hue(const char *nickname)
 {
-    FILE *f = fopen(path, "rb");
-    if (f == NULL) {
-        return NULL;
+    unsigned int hash = 5381u;
+    for (const unsigned char *p = (const unsigned char *)nickname; *p != '\0'; ++p) {
+        hash = ((hash << 5) + hash) ^ (unsigned int)(*p);
     }
+    return hash % 360u;
+}
 
-    if (fseek(f, 0, SEEK_END) != 0) {
-        fclose(f);
-        return NULL;
-    }
+int render_message_html(struct Buffer *out, const struct MessageRecord *m)
+{
+    unsigned int hue = nickname_hue(m->nickname);
+
+    int rc = buffer_appendf(
+        out,
+        "<li data-id=\"%lld\" class=\"msg-item mb-2 rounded-lg border border-slate-200 bg-white px-3 py-2 shadow-sm last:mb-0 dark:border-slate-700 dark:bg-slate-900\" style=\"border-left:4px solid hsl(%u 72%% 46%%)\">"
+        "<div class=\"mb-1 grid grid-cols-[1fr_auto] items-center gap-x-2 text-xs\">"
+        "<span class=\"font-semibold\" style=\"color:hsl(%u 75%% 30%%)\">",
+        m->id,
+        hue,
+        hue);
+    rc |= escape_html(out, m->nickname, strlen(m->nickname));
+    rc |= buffer_appendf(
+        out,
+        "</span>"
+        "<span class=\"msg-tag rounded bg-slate-100 px-2 py-0.5 font-mono text-[11px] tracking-wide text-slate-700 dark:bg-slate-800 dark:text-slate-200\">#%04d</span>"
+        "<span class=\"msg-time col-span-2 text-[11px] text-slate-500 dark:text-slate-400\">",
+        m->tag);
+    rc |= escape_html(out, m->timestamp, strlen(m->timestamp));
+    rc |= buffer_append(
+        out,
+        "</span>"
+        "</div>"
+        "<div class=\"msg-content whitespace-pre-wrap break-words text-sm text-slate-800 dark:text-slate-200\">");
+    rc |= escape_html(out, m->content, strlen(m->content));
+    rc |= buffer_append(out, "</div></li>");
+    return rc;
+}
 
-    long size = ftell(f);
-    if (size < 0) {
-        fclose(f);
-        return NULL;
-    }
+int render_message_json(struct Buffer *out, const struct MessageRecord *m)
+{
+    int rc = buffer_appendf(out, "{\"id\":%lld,\"nickname\":\"", m->id);
+    rc |= escape_json(out, m->nickname, strlen(m->nickname));
+    rc |= buffer_appendf(out, "\",\"tag\":%d,\"timestamp\":\"", m->tag);
+    rc |= escape_json(out, m->timestamp, strlen(m->timestamp));
+    rc |= buffer_append(out, "\",\"content\":\"");
+    rc |= escape_json(out, m->content, strlen(m->content));
+    rc |= buffer_append(out, "\"}");
+    return rc;
+}
 
-    rewind(f);
+static int append_asset_url(struct Buffer *out, const struct TemplateSegment *segment)
+{
+    char asset_name[64];
+    snprintf(asset_name, sizeof(asset_name), "%.*s", (int)segment->len, segment->text);
+    const struct Asset *asset = assets_find(asset_name);
+    if (asset != NULL) {
+        return buffer_append(out, asset->fingerprinted_url);
+    }
+    return buffer_appendf(out, "/assets/%s", asset_name);
+}
 
-    char *buf = malloc((size_t)size + 1);
-    if (buf == NULL) {
-        fclose(f);
-        return NULL;
+static int build_page(const struct TemplateSegment *segments, size_t count)
+{
+    struct Buffer head = {0};
+    struct Buffer tail = {0};
+    struct Buffer *out = &head;
+    int rc = buffer_append(&head, "") | buffer_append(&tail, "");
+
+    for (size_t i = 0; rc == 0 && i < count; ++i) {
+        switch (segments[i].kind) {
+        case TEMPLATE_MESSAGES:
+            if (out == &tail) {
+                log_error("Page template has more than one messages marker");
+                rc = -1;
+            }
+            out = &tail;
+            break;
+        case TEMPLATE_ASSET:
+            rc |= append_asset_url(out, &segments[i]);
+            break;
+        default:
+            rc |= buffer_appendf(out, "%.*s", (int)segments[i].len, segments[i].text);
+            break;
+        }
     }
 
-    size_t read_n = fread(buf, 1, (size_t)size, f);
-    fclose(f);
-    if (read_n != (size_t)size) {
-        free(buf);
-        return NULL;
+    if (rc == 0 && out != &tail) {
+        log_error("Page template has no messages marker");
+        rc = -1;
+    }
+    if (rc != 0) {
+        free(head.data);
+        free(tail.data);
+        return -1;
     }
 
-    buf[size] = '\0';
-    return buf;
+    page_head = head.data;
+    page_head_len = head.len;
+    page_tail = tail.data;
+    page_tail_len = tail.len;
+    return 0;
 }
 
-static char *load_page_template(void)
+int render_init(void)
 {
-    char *tmpl = read_file_to_string("assets/index.html");
-    if (tmpl != NULL) {
-        return tmpl;
+#ifdef MESSAGE_BOARD_DEV_ASSETS
+    size_t len = 0;
+    char *tmpl = assets_read_file("index.html", &len);
+    if (tmpl == NULL) {
+        log_error("Failed loading page template");
+        return -1;
     }
 
-    return read_file_to_string("build/assets/index.html");
+    size_t count = 0;
+    struct TemplateSegment *segments = template_split(tmpl, &count);
+    int rc = segments != NULL ? build_page(segments, count) : -1;
+    free(segments);
+    free(tmpl);
+    return rc;
+#else
+    return build_page(embedded_page_segments, embedded_page_segment_count);
+#endif
 }
 
-char *render_home_page(void)
+void render_free(void)
 {
-    char *messages = db_render_messages_html();
-    if (messages == NULL) {
-        return NULL;
-    }
-
-    char *tmpl = load_page_template();
-    if (tmpl == NULL) {
-        free(messages);
-        return NULL;
-    }
+    free(page_head);
+    free(page_tail);
+    page_head = NULL;
+    page_tail = NULL;
+    page_head_len = 0;
+    page_tail_len = 0;
+}
 
-    char *marker = strstr(tmpl, TEMPLATE_MARKER);
-    if (marker == NULL) {
-        free(messages);
-        free(tmpl);
+char *render_home_page(const char *messages)
+{
+    if (page_head == NULL) {
         return NULL;
     }
 
-    size_t before_len = (size_t)(marker - tmpl);
-    size_t marker_len = strlen(TEMPLATE_MARKER);
-
-    struct Buffer out = {0};
-    int rc = 0;
-
-    char saved = tmpl[before_len];
-    tmpl[before_len] = '\0';
-    rc |= buffer_append(&out, tmpl);
-    tmpl[before_len] = saved;
-
-    rc |= buffer_append(&out, messages);
-    rc |= buffer_append(&out, marker + marker_len);
-
-    free(messages);
-    free(tmpl);
-
-    if (rc != 0) {
-        free(out.data);
+    unsigned long long span = trace_begin();
+    size_t messages_len = strlen(messages);
+    char *page = malloc(page_head_len + messages_len + page_tail_len + 1);
+    if (page == NULL) {
         return NULL;
     }
 
-    return out.data;
+    memcpy(page, page_head, page_head_len);
+    memcpy(page + page_head_len, messages, messages_len);
+    memcpy(page + page_head_len + messages_len, page_tail, page_tail_len);
+    page[page_head_len + messages_len + page_tail_len] = '\0';
+    trace_end("render home page", span);
+    return page;
 }
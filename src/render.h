@@ -1,6 +1,21 @@
 #ifndef RENDER_H
 #define RENDER_H
 
-char *render_home_page(void);
+#include "db.h"
+#include "util.h"
+
+/* Stored with each message's pre-rendered fragments. Bump it whenever
+ * render_message_html or render_message_json output changes: older rows are
+ * then rendered live until the writer has re-rendered them. */
+#define RENDER_FRAGMENT_VERSION 1
+
+/* The message list when there are no messages. */
+extern const char render_no_messages_html[];
+
+int render_init(void);
+void render_free(void);
+char *render_home_page(const char *messages);
+int render_message_html(struct Buffer *out, const struct MessageRecord *m);
+int render_message_json(struct Buffer *out, const struct MessageRecord *m);
 
 #endif
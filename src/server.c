@@ -0,0 +1,219 @@
+#include "server.h"
+
+#include "cache.h"
+#include "config.h"
+#include "db.h"
+#include "hot.h"
+#include "http.h"
+#include "logging.h"
+#include "sse.h"
+#include "trace.h"
+#include "writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--mode=pool|thread] [--workers=N] [--max-connections=N]\n"
+            "          [--write-batch=N] [--write-delay-ms=N] [--db-readers=N]\n"
+            "          [--log-level=L] [--log-format=F] [--log-access-sample=N]\n"
+            "          [--trace-sample=N]\n"
+            "  --mode=pool            epoll event loop with a fixed worker pool (default)\n"
+            "  --mode=thread          one thread per connection\n"
+            "  --workers=N            pool size for --mode=pool (default: online cores)\n"
+            "  --write-batch=N        most posts committed in one transaction (default: %d)\n"
+            "  --write-delay-ms=N     longest a post waits for its batch to fill (default: %d)\n"
+            "  --db-readers=N         read-only SQLite connections (default: online cores)\n"
+            "  --log-level=L          debug, info, warn or error (default: info)\n"
+            "  --log-format=F         text, kv (key=value) or json (default: text)\n"
+            "  --log-access-sample=N  log one request line in N (default: 1)\n"
+            "  --trace-sample=N       trace one request in N per thread (default: 0, off)\n",
+            prog,
+            WRITE_BATCH_MAX,
+            WRITE_BATCH_DELAY_MS);
+}
+
+static int parse_uint(const char *s, unsigned int *out)
+{
+    char *end = NULL;
+    unsigned long v = strtoul(s, &end, 10);
+    if (end == s || *end != '\0' || v > 1000000ul) {
+        return -1;
+    }
+
+    *out = (unsigned int)v;
+    return 0;
+}
+
+int server_parse_args(int argc, char **argv, struct ServerOptions *opts)
+{
+    opts->mode = SERVER_MODE_POOL;
+    opts->workers = 0;
+    opts->max_connections = MAX_CONNECTIONS;
+    opts->write_batch = WRITE_BATCH_MAX;
+    opts->write_delay_ms = WRITE_BATCH_DELAY_MS;
+    opts->db_readers = 0;
+    opts->log.level = LOG_INFO;
+    opts->log.format = LOG_FORMAT_TEXT;
+    opts->log.access_sample = 1;
+    opts->trace_sample = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--mode=pool") == 0) {
+            opts->mode = SERVER_MODE_POOL;
+        } else if (strcmp(arg, "--mode=thread") == 0) {
+            opts->mode = SERVER_MODE_THREAD;
+        } else if (strncmp(arg, "--workers=", 10) == 0) {
+            if (parse_uint(arg + 10, &opts->workers) != 0) {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else if (strncmp(arg, "--max-connections=", 18) == 0) {
+            if (parse_uint(arg + 18, &opts->max_connections) != 0 || opts->max_connections == 0) {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else if (strncmp(arg, "--db-readers=", 13) == 0) {
+            if (parse_uint(arg + 13, &opts->db_readers) != 0 || opts->db_readers == 0) {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else if (strncmp(arg, "--write-batch=", 14) == 0) {
+            if (parse_uint(arg + 14, &opts->write_batch) != 0 || opts->write_batch == 0) {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else if (strncmp(arg, "--write-delay-ms=", 17) == 0) {
+            if (parse_uint(arg + 17, &opts->write_delay_ms) != 0) {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else if (strncmp(arg, "--log-level=", 12) == 0) {
+            if (log_parse_level(arg + 12, &opts->log.level) != 0) {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else if (strncmp(arg, "--log-format=", 13) == 0) {
+            if (log_parse_format(arg + 13, &opts->log.format) != 0) {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else if (strncmp(arg, "--log-access-sample=", 20) == 0) {
+            if (parse_uint(arg + 20, &opts->log.access_sample) != 0 || opts->log.access_sample == 0) {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else if (strncmp(arg, "--trace-sample=", 15) == 0) {
+            if (parse_uint(arg + 15, &opts->trace_sample) != 0) {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (opts->workers == 0) {
+        opts->workers = cores > 0 ? (unsigned int)cores : 1;
+    }
+    if (opts->db_readers == 0) {
+        opts->db_readers = cores > 0 ? (unsigned int)cores : 1;
+    }
+
+    return 0;
+}
+
+const char *server_mode_name(enum ServerMode mode)
+{
+    return mode == SERVER_MODE_THREAD ? "thread" : "pool";
+}
+
+static void raise_fd_limit(unsigned int wanted)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+        return;
+    }
+
+    rlim_t target = (rlim_t)wanted + 64;
+    if (rl.rlim_cur >= target) {
+        return;
+    }
+
+    rl.rlim_cur = target < rl.rlim_max ? target : rl.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rl) != 0) {
+        log_error("Failed raising RLIMIT_NOFILE to %lu", (unsigned long)rl.rlim_cur);
+    }
+}
+
+struct MHD_Daemon *server_start(const struct ServerOptions *opts)
+{
+    raise_fd_limit(opts->max_connections);
+    trace_set_sample(opts->trace_sample);
+    cache_init();
+    if (hot_init() != 0) {
+        return NULL;
+    }
+    if (sse_init() != 0) {
+        hot_shutdown();
+        return NULL;
+    }
+
+    struct WriterOptions writer_opts = {opts->write_batch, opts->write_delay_ms};
+    if (writer_start(&writer_opts) != 0) {
+        sse_shutdown();
+        hot_shutdown();
+        return NULL;
+    }
+
+    struct MHD_Daemon *daemon = NULL;
+    if (opts->mode == SERVER_MODE_THREAD) {
+        daemon = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION | MHD_ALLOW_SUSPEND_RESUME,
+                                  PORT,
+                                  NULL,
+                                  NULL,
+                                  &answer_to_connection,
+                                  NULL,
+                                  MHD_OPTION_CONNECTION_LIMIT,
+                                  opts->max_connections,
+                                  MHD_OPTION_END);
+    } else {
+        /* Idle /events streams are suspended instead of blocking a worker, so
+         * the pool only needs as many threads as there are cores. */
+        daemon = MHD_start_daemon(MHD_USE_EPOLL_INTERNAL_THREAD | MHD_ALLOW_SUSPEND_RESUME,
+                                  PORT,
+                                  NULL,
+                                  NULL,
+                                  &answer_to_connection,
+                                  NULL,
+                                  MHD_OPTION_THREAD_POOL_SIZE,
+                                  opts->workers,
+                                  MHD_OPTION_CONNECTION_LIMIT,
+                                  opts->max_connections,
+                                  MHD_OPTION_END);
+    }
+
+    if (daemon == NULL) {
+        writer_stop();
+        sse_shutdown();
+        hot_shutdown();
+    }
+    return daemon;
+}
+
+void server_stop(struct MHD_Daemon *daemon)
+{
+    /* Queued posts commit and publish before SSE streams are closed. */
+    writer_stop();
+    sse_shutdown();
+    MHD_stop_daemon(daemon);
+    hot_shutdown();
+}
@@ -0,0 +1,29 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "logging.h"
+
+#include <microhttpd.h>
+
+enum ServerMode {
+    SERVER_MODE_POOL,
+    SERVER_MODE_THREAD,
+};
+
+struct ServerOptions {
+    enum ServerMode mode;
+    unsigned int workers;
+    unsigned int max_connections;
+    unsigned int write_batch;
+    unsigned int write_delay_ms;
+    unsigned int db_readers;
+    unsigned int trace_sample;
+    struct LogOptions log;
+};
+
+int server_parse_args(int argc, char **argv, struct ServerOptions *opts);
+struct MHD_Daemon *server_start(const struct ServerOptions *opts);
+void server_stop(struct MHD_Daemon *daemon);
+const char *server_mode_name(enum ServerMode mode);
+
+#endif
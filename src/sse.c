@@ -0,0 +1,389 @@
+#include "sse.h"
+
+#include "config.h"
+#include "escape.h"
+#include "hot.h"
+#include "logging.h"
+#include "metrics.h"
+#include "render.h"
+#include "trace.h"
+#include "util.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Idle streams never block a thread. When a client has nothing to send, its
+ * reader suspends the connection and parks the client on a timer wheel with
+ * one slot per second of the heartbeat interval. A post resumes every parked
+ * client (each one has an event to send); the ticker only resumes the slot
+ * whose heartbeat is due. Clients that are mid-write are never touched.
+ *
+ * Each post becomes one immutable, reference-counted event that carries the
+ * message itself, built once when the message enters the hot window. A
+ * stream with something to send finds its next event in the window's
+ * snapshot without taking sse_mutex, so a post fans out to every client
+ * without them queueing on one lock. The window doubles as the replay log:
+ * a client reconnecting with Last-Event-ID gets exactly what it missed, or
+ * a "reset" event, to refetch the list, once the gap has left the window.
+ */
+
+enum { SSE_WHEEL_SLOTS = SSE_HEARTBEAT_SECONDS };
+
+struct SseEvent {
+    atomic_int refs;
+    long long id;
+    size_t len;
+    char data[];
+};
+
+struct SseClient {
+    struct MHD_Connection *connection;
+    long long last_id;
+    int ping_due;
+    struct SseClient *next_parked;
+    struct SseEvent *event;
+    const char *pending;
+    size_t pending_len;
+    size_t pending_off;
+};
+
+static const char SSE_CONNECTED[] = ": connected\n\n";
+static const char SSE_PING[] = ": ping\n\n";
+static const char SSE_RESET[] = "event: reset\ndata: \n\n";
+
+static pthread_mutex_t sse_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int sse_stopping = 0;
+
+static struct SseClient *sse_wheel[SSE_WHEEL_SLOTS];
+static unsigned long sse_tick = 0;
+
+static pthread_cond_t sse_ticker_cond;
+static pthread_t sse_ticker_thread;
+static int sse_ticker_running = 0;
+
+static void sse_resume_list(struct SseClient *client)
+{
+    while (client != NULL) {
+        struct SseClient *next = client->next_parked;
+        client->next_parked = NULL;
+        MHD_resume_connection(client->connection);
+        client = next;
+    }
+}
+
+/* Caller holds sse_mutex. Detaches every parked client into one list. */
+static struct SseClient *sse_take_all_parked(void)
+{
+    struct SseClient *all = NULL;
+    for (size_t i = 0; i < SSE_WHEEL_SLOTS; ++i) {
+        struct SseClient *c = sse_wheel[i];
+        while (c != NULL) {
+            struct SseClient *next = c->next_parked;
+            c->next_parked = all;
+            all = c;
+            c = next;
+        }
+        sse_wheel[i] = NULL;
+    }
+    return all;
+}
+
+void sse_event_release(struct SseEvent *event)
+{
+    if (event != NULL && atomic_fetch_sub_explicit(&event->refs, 1, memory_order_acq_rel) == 1) {
+        free(event);
+    }
+}
+
+struct SseEvent *sse_event_new(const struct MessageRecord *msg)
+{
+    /* Window messages carry their fragments; render only without them. */
+    struct Buffer payload = {0};
+    struct Buffer html = {0};
+    const char *json_text = msg->json_fragment;
+    size_t json_len = msg->json_len;
+    const char *html_text = msg->html_fragment;
+    size_t html_len = msg->html_len;
+    int rc = 0;
+    if (json_text == NULL || html_text == NULL) {
+        rc = render_message_json(&payload, msg) | render_message_html(&html, msg);
+        json_text = payload.data;
+        json_len = payload.len;
+        html_text = html.data;
+        html_len = html.len;
+    }
+
+    struct Buffer out = {0};
+    if (rc == 0) {
+        rc = buffer_appendf(&out, "id: %lld\nevent: message\ndata: {\"message\":", msg->id);
+        rc |= buffer_append_len(&out, json_text, json_len);
+        rc |= buffer_append(&out, ",\"html\":\"");
+        rc |= escape_json(&out, html_text, html_len);
+        rc |= buffer_append(&out, "\"}\n\n");
+    }
+    free(payload.data);
+    free(html.data);
+    if (rc != 0) {
+        free(out.data);
+        return NULL;
+    }
+
+    struct SseEvent *event = malloc(sizeof(*event) + out.len + 1);
+    if (event == NULL) {
+        free(out.data);
+        return NULL;
+    }
+
+    atomic_init(&event->refs, 1);
+    event->id = msg->id;
+    event->len = out.len;
+    memcpy(event->data, out.data, out.len + 1);
+    free(out.data);
+    return event;
+}
+
+/* Wakes every parked stream once the hot window has the new messages. */
+void sse_wake(void)
+{
+    pthread_mutex_lock(&sse_mutex);
+    struct SseClient *parked = sse_take_all_parked();
+    pthread_mutex_unlock(&sse_mutex);
+    sse_resume_list(parked);
+    metrics_add(METRIC_SSE_BROADCASTS, 1);
+}
+
+static void *sse_ticker_main(void *arg)
+{
+    (void)arg;
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    pthread_mutex_lock(&sse_mutex);
+    while (!sse_stopping) {
+        next.tv_sec += 1;
+
+        int wait_rc = 0;
+        while (!sse_stopping && wait_rc != ETIMEDOUT) {
+            wait_rc = pthread_cond_timedwait(&sse_ticker_cond, &sse_mutex, &next);
+        }
+        if (sse_stopping) {
+            break;
+        }
+
+        sse_tick++;
+        size_t slot = (size_t)(sse_tick % SSE_WHEEL_SLOTS);
+        struct SseClient *due = sse_wheel[slot];
+        sse_wheel[slot] = NULL;
+        for (struct SseClient *c = due; c != NULL; c = c->next_parked) {
+            c->ping_due = 1;
+        }
+        pthread_mutex_unlock(&sse_mutex);
+
+        sse_resume_list(due);
+
+        pthread_mutex_lock(&sse_mutex);
+    }
+    pthread_mutex_unlock(&sse_mutex);
+    return NULL;
+}
+
+int sse_init(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sse_ticker_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    atomic_store(&sse_stopping, 0);
+    if (pthread_create(&sse_ticker_thread, NULL, &sse_ticker_main, NULL) != 0) {
+        log_error("Failed starting SSE heartbeat ticker");
+        pthread_cond_destroy(&sse_ticker_cond);
+        return -1;
+    }
+
+    sse_ticker_running = 1;
+    return 0;
+}
+
+void sse_shutdown(void)
+{
+    pthread_mutex_lock(&sse_mutex);
+    atomic_store(&sse_stopping, 1);
+    pthread_cond_broadcast(&sse_ticker_cond);
+    struct SseClient *parked = sse_take_all_parked();
+    pthread_mutex_unlock(&sse_mutex);
+
+    /* MHD refuses to stop with suspended connections; wake them so their
+     * readers can end the stream. */
+    sse_resume_list(parked);
+
+    if (sse_ticker_running) {
+        pthread_join(sse_ticker_thread, NULL);
+        pthread_cond_destroy(&sse_ticker_cond);
+        sse_ticker_running = 0;
+    }
+}
+
+static void sse_free_callback(void *cls)
+{
+    struct SseClient *client = (struct SseClient *)cls;
+    sse_event_release(client->event);
+    free(client);
+    metrics_add(METRIC_SSE_CLOSED, 1);
+}
+
+/* Sets up the client's next event from the hot window; 0 if caught up. */
+static int sse_next_event(struct SseClient *client)
+{
+    struct EpochRecord *guard = NULL;
+    const struct HotSnapshot *snap = hot_enter(&guard);
+    if (snap == NULL || client->last_id >= snap->latest_id) {
+        hot_exit(guard);
+        return 0;
+    }
+
+    const struct HotMessage *next = hot_find_after(snap, client->last_id);
+    if (next == NULL || next->event == NULL) {
+        client->pending = SSE_RESET;
+        client->pending_len = sizeof(SSE_RESET) - 1;
+        client->last_id = snap->latest_id;
+    } else {
+        /* The window holds a reference until hot_exit; take our own. */
+        atomic_fetch_add_explicit(&next->event->refs, 1, memory_order_relaxed);
+        client->event = next->event;
+        metrics_add(METRIC_SSE_EVENTS, 1);
+        client->pending = next->event->data;
+        client->pending_len = next->event->len;
+        client->last_id = next->record.id;
+    }
+    hot_exit(guard);
+    return 1;
+}
+
+static ssize_t sse_reader(void *cls, uint64_t pos, char *buf, size_t max)
+{
+    (void)pos;
+
+    struct SseClient *client = (struct SseClient *)cls;
+    if (client == NULL || max == 0) {
+        return 0;
+    }
+
+    while (client->pending_off >= client->pending_len) {
+        sse_event_release(client->event);
+        client->event = NULL;
+        if (atomic_load(&sse_stopping)) {
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        }
+        if (sse_next_event(client)) {
+            client->ping_due = 0;
+            client->pending_off = 0;
+            break;
+        }
+
+        pthread_mutex_lock(&sse_mutex);
+        if (atomic_load(&sse_stopping)) {
+            pthread_mutex_unlock(&sse_mutex);
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        }
+        if (client->last_id < hot_latest_id()) {
+            /* Published since the lookup above; go fetch it. */
+            pthread_mutex_unlock(&sse_mutex);
+            continue;
+        }
+        if (client->ping_due) {
+            client->ping_due = 0;
+            client->pending = SSE_PING;
+            client->pending_len = sizeof(SSE_PING) - 1;
+            client->pending_off = 0;
+            pthread_mutex_unlock(&sse_mutex);
+            break;
+        }
+
+        /* Parking under the lock closes the gap with sse_wake: the writer
+         * swaps the snapshot before taking the lock, so a post either shows
+         * in the id check above or finds this client on the wheel. */
+        size_t slot = (size_t)(sse_tick % SSE_WHEEL_SLOTS);
+        client->next_parked = sse_wheel[slot];
+        sse_wheel[slot] = client;
+        MHD_suspend_connection(client->connection);
+        pthread_mutex_unlock(&sse_mutex);
+        return 0;
+    }
+
+    size_t remaining = client->pending_len - client->pending_off;
+    size_t n = remaining < max ? remaining : max;
+    memcpy(buf, client->pending + client->pending_off, n);
+    client->pending_off += n;
+    metrics_add(METRIC_BODY_BYTES, n);
+    return (ssize_t)n;
+}
+
+static int parse_event_id(const char *s, long long *out)
+{
+    if (s == NULL || *s == '\0') {
+        return -1;
+    }
+
+    char *end = NULL;
+    long long v = strtoll(s, &end, 10);
+    if (*end != '\0' || v < 0) {
+        return -1;
+    }
+
+    *out = v;
+    return 0;
+}
+
+int sse_open(struct MHD_Connection *connection)
+{
+    struct SseClient *client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        return MHD_NO;
+    }
+
+    /* The browser sends Last-Event-ID on reconnect; the page passes the
+     * newest id it rendered as a query argument on first connect. */
+    long long resume_id = -1;
+    if (parse_event_id(MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Last-Event-ID"), &resume_id) != 0) {
+        parse_event_id(MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "last_event_id"), &resume_id);
+    }
+
+    client->connection = connection;
+    long long latest_id = hot_latest_id();
+    client->last_id = resume_id >= 0 && resume_id <= latest_id ? resume_id : latest_id;
+    client->pending = SSE_CONNECTED;
+    client->pending_len = sizeof(SSE_CONNECTED) - 1;
+    client->pending_off = 0;
+
+    struct MHD_Response *response = MHD_create_response_from_callback(
+        MHD_SIZE_UNKNOWN,
+        1024,
+        &sse_reader,
+        client,
+        &sse_free_callback);
+    if (response == NULL) {
+        free(client);
+        return MHD_NO;
+    }
+    metrics_add(METRIC_SSE_OPENED, 1);
+
+    MHD_add_response_header(response, "Content-Type", "text/event-stream");
+    MHD_add_response_header(response, "Cache-Control", "no-cache");
+    MHD_add_response_header(response, "Connection", "keep-alive");
+    MHD_add_response_header(response, "X-Accel-Buffering", "no");
+
+    unsigned long long span = trace_begin();
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    trace_end("MHD_queue_response", span);
+    MHD_destroy_response(response);
+    return ret;
+}
@@ -0,0 +1,18 @@
+#ifndef SSE_H
+#define SSE_H
+
+#include "db.h"
+
+#include <microhttpd.h>
+#include <stddef.h>
+
+struct SseEvent;
+
+int sse_init(void);
+void sse_shutdown(void);
+int sse_open(struct MHD_Connection *connection);
+struct SseEvent *sse_event_new(const struct MessageRecord *msg);
+void sse_event_release(struct SseEvent *event);
+void sse_wake(void);
+
+#endif
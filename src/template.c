@@ -0,0 +1,78 @@
+#include "template.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Splits the page template into literal runs and {{MESSAGES}} /
+ * {{ASSET:name}} placeholders. Segments point into tmpl, which must outlive
+ * them. Used by tools/embed_assets at build time and by dev builds, which
+ * read the template from disk at startup.
+ */
+
+static int push_segment(struct TemplateSegment **segments,
+                        size_t *count,
+                        size_t *cap,
+                        enum TemplateSegmentKind kind,
+                        const char *text,
+                        size_t len)
+{
+    if (kind == TEMPLATE_TEXT && len == 0) {
+        return 0;
+    }
+
+    if (*count == *cap) {
+        size_t new_cap = *cap == 0 ? 8 : *cap * 2;
+        struct TemplateSegment *grown = realloc(*segments, new_cap * sizeof(**segments));
+        if (grown == NULL) {
+            return -1;
+        }
+        *segments = grown;
+        *cap = new_cap;
+    }
+
+    (*segments)[*count].kind = kind;
+    (*segments)[*count].text = text;
+    (*segments)[*count].len = len;
+    (*count)++;
+    return 0;
+}
+
+struct TemplateSegment *template_split(const char *tmpl, size_t *count)
+{
+    struct TemplateSegment *segments = NULL;
+    size_t cap = 0;
+    const char *p = tmpl;
+    int rc = 0;
+
+    *count = 0;
+    for (const char *open = strstr(p, "{{"); rc == 0 && open != NULL; open = strstr(p, "{{")) {
+        if (strncmp(open, TEMPLATE_MESSAGES_MARKER, strlen(TEMPLATE_MESSAGES_MARKER)) == 0) {
+            rc |= push_segment(&segments, count, &cap, TEMPLATE_TEXT, p, (size_t)(open - p));
+            rc |= push_segment(&segments, count, &cap, TEMPLATE_MESSAGES, NULL, 0);
+            p = open + strlen(TEMPLATE_MESSAGES_MARKER);
+            continue;
+        }
+
+        const char *end = strstr(open, "}}");
+        if (strncmp(open, TEMPLATE_ASSET_MARKER, strlen(TEMPLATE_ASSET_MARKER)) == 0 && end != NULL) {
+            const char *name = open + strlen(TEMPLATE_ASSET_MARKER);
+            rc |= push_segment(&segments, count, &cap, TEMPLATE_TEXT, p, (size_t)(open - p));
+            rc |= push_segment(&segments, count, &cap, TEMPLATE_ASSET, name, (size_t)(end - name));
+            p = end + 2;
+            continue;
+        }
+
+        /* Not a placeholder; keep the braces as literal text. */
+        rc |= push_segment(&segments, count, &cap, TEMPLATE_TEXT, p, (size_t)(open + 2 - p));
+        p = open + 2;
+    }
+    rc |= push_segment(&segments, count, &cap, TEMPLATE_TEXT, p, strlen(p));
+
+    if (rc != 0) {
+        free(segments);
+        *count = 0;
+        return NULL;
+    }
+    return segments;
+}
@@ -0,0 +1,24 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stddef.h>
+
+#define TEMPLATE_MESSAGES_MARKER "{{MESSAGES}}"
+#define TEMPLATE_ASSET_MARKER "{{ASSET:"
+
+enum TemplateSegmentKind {
+    TEMPLATE_TEXT,
+    TEMPLATE_ASSET,
+    TEMPLATE_MESSAGES,
+};
+
+/* A run of the page template; for TEMPLATE_ASSET, text/len is the asset name. */
+struct TemplateSegment {
+    enum TemplateSegmentKind kind;
+    const char *text;
+    size_t len;
+};
+
+struct TemplateSegment *template_split(const char *tmpl, size_t *count);
+
+#endif
@@ -0,0 +1,169 @@
+#include "trace.h"
+
+#include "config.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * A Trace is filled by one thread at a time (a POST hands its connection's
+ * Trace across callbacks, never between threads at once), so spans are
+ * plain stores. Only finishing takes a lock, to swap the Trace into the
+ * ring of kept ones; unsampled requests never reach it.
+ */
+
+struct TraceEvent {
+    const char *name;
+    unsigned long long start_ns;
+    unsigned long long dur_ns;
+    long tid;
+};
+
+struct Trace {
+    unsigned long long id;
+    unsigned long long start_ns;
+    size_t count;
+    struct TraceEvent events[TRACE_MAX_EVENTS];
+};
+
+static atomic_uint sample_every;
+static atomic_ullong next_id;
+static _Thread_local unsigned int sample_seen;
+static _Thread_local struct Trace *current;
+static _Thread_local long thread_tid;
+
+static pthread_mutex_t kept_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct Trace *kept[TRACE_KEEP];
+static size_t kept_next;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+static long tid(void)
+{
+    if (thread_tid == 0) {
+        thread_tid = (long)syscall(SYS_gettid);
+    }
+    return thread_tid;
+}
+
+/* Spans past TRACE_MAX_EVENTS are dropped; the root span always fits. */
+static void record(struct Trace *trace, const char *name, unsigned long long start_ns, unsigned long long end_ns)
+{
+    if (trace->count >= TRACE_MAX_EVENTS - 1) {
+        return;
+    }
+    trace->events[trace->count++] = (struct TraceEvent){name, start_ns, end_ns - start_ns, tid()};
+}
+
+void trace_set_sample(unsigned int n)
+{
+    atomic_store_explicit(&sample_every, n, memory_order_relaxed);
+}
+
+struct Trace *trace_sample(void)
+{
+    unsigned int n = atomic_load_explicit(&sample_every, memory_order_relaxed);
+    if (n == 0 || sample_seen++ % n != 0) {
+        return NULL;
+    }
+    return trace_new();
+}
+
+struct Trace *trace_new(void)
+{
+    struct Trace *trace = malloc(sizeof(*trace));
+    if (trace != NULL) {
+        trace->id = atomic_fetch_add_explicit(&next_id, 1, memory_order_relaxed) + 1;
+        trace->start_ns = now_ns();
+        trace->count = 0;
+    }
+    return trace;
+}
+
+void trace_attach(struct Trace *trace)
+{
+    current = trace;
+}
+
+unsigned long long trace_begin(void)
+{
+    return current != NULL ? now_ns() : 0;
+}
+
+void trace_end(const char *name, unsigned long long start_ns)
+{
+    if (start_ns != 0 && current != NULL) {
+        record(current, name, start_ns, now_ns());
+    }
+}
+
+void trace_add(struct Trace *trace, const char *name, unsigned long long start_ns)
+{
+    if (trace != NULL) {
+        record(trace, name, start_ns, now_ns());
+    }
+}
+
+void trace_finish(struct Trace *trace, const char *name)
+{
+    if (trace == NULL) {
+        return;
+    }
+    if (current == trace) {
+        current = NULL;
+    }
+    unsigned long long end_ns = now_ns();
+    trace->events[trace->count++] = (struct TraceEvent){name, trace->start_ns, end_ns - trace->start_ns, tid()};
+
+    pthread_mutex_lock(&kept_lock);
+    struct Trace *old = kept[kept_next];
+    kept[kept_next] = trace;
+    kept_next = (kept_next + 1) % TRACE_KEEP;
+    pthread_mutex_unlock(&kept_lock);
+    free(old);
+}
+
+int trace_append_json(struct Buffer *out)
+{
+    int pid = (int)getpid();
+    int rc = buffer_append(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    int first = 1;
+
+    pthread_mutex_lock(&kept_lock);
+    for (size_t i = 0; rc == 0 && i < TRACE_KEEP; ++i) {
+        const struct Trace *trace = kept[(kept_next + i) % TRACE_KEEP];
+        if (trace == NULL) {
+            continue;
+        }
+        /* The root span was recorded last; emit it first so viewers nest the rest. */
+        for (size_t n = 0; rc == 0 && n < trace->count; ++n) {
+            const struct TraceEvent *e = &trace->events[(n + trace->count - 1) % trace->count];
+            rc |= buffer_appendf(out,
+                                 "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%ld,"
+                                 "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"trace\":%llu}}",
+                                 first ? "" : ",",
+                                 e->name,
+                                 n == 0 ? "request" : "span",
+                                 pid,
+                                 e->tid,
+                                 (double)e->start_ns / 1e3,
+                                 (double)e->dur_ns / 1e3,
+                                 trace->id);
+            first = 0;
+        }
+    }
+    pthread_mutex_unlock(&kept_lock);
+
+    rc |= buffer_append(out, "]}");
+    return rc;
+}
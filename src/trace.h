@@ -0,0 +1,33 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+struct Buffer;
+struct Trace;
+
+/*
+ * Request tracing. A sampled request gets a Trace; code running for it
+ * brackets work with trace_begin/trace_end, which record onto the Trace
+ * attached to the calling thread. With no Trace attached, trace_begin is a
+ * thread-local load and trace_end returns at once. Finished traces are kept
+ * in a ring and exported in Chrome trace-event JSON.
+ */
+/* Keep one request in n per thread; 0 turns tracing off. */
+void trace_set_sample(unsigned int n);
+/* A new Trace if this request is sampled, else NULL. */
+struct Trace *trace_sample(void);
+/* A new Trace regardless of sampling, e.g. for a batch serving traced requests. */
+struct Trace *trace_new(void);
+/* Makes trace the calling thread's current one; NULL detaches. */
+void trace_attach(struct Trace *trace);
+/* Start time for trace_end, or 0 when the thread has no Trace. */
+unsigned long long trace_begin(void);
+/* name must outlive the trace: a string literal. */
+void trace_end(const char *name, unsigned long long start_ns);
+/* Records a span measured elsewhere, from start_ns until now. */
+void trace_add(struct Trace *trace, const char *name, unsigned long long start_ns);
+/* Closes the root span, from trace creation until now, and keeps the trace. */
+void trace_finish(struct Trace *trace, const char *name);
+/* Appends the kept traces as a Chrome trace-event JSON object. */
+int trace_append_json(struct Buffer *out);
+
+#endif
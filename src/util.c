@@ -1,11 +1,15 @@
 #include "util.h"
 
+#include "arena.h"
+#include "metrics.h"
+#include "trace.h"
+
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static int buffer_ensure(struct Buffer *b, size_t extra)
+int buffer_reserve(struct Buffer *b, size_t extra)
 {
     size_t needed = b->len + extra + 1;
     if (needed <= b->cap) {
@@ -17,7 +21,7 @@ static int buffer_ensure(struct Buffer *b, size_t extra)
         new_cap *= 2;
     }
 
-    char *new_data = realloc(b->data, new_cap);
+    char *new_data = b->arena != NULL ? arena_grow(b->arena, b->data, b->cap, new_cap) : realloc(b->data, new_cap);
     if (new_data == NULL) {
         return -1;
     }
@@ -27,10 +31,9 @@ static int buffer_ensure(struct Buffer *b, size_t extra)
     return 0;
 }
 
-int buffer_append(struct Buffer *b, const char *s)
+int buffer_append_len(struct Buffer *b, const char *s, size_t n)
 {
-    size_t n = strlen(s);
-    if (buffer_ensure(b, n) != 0) {
+    if (buffer_reserve(b, n) != 0) {
         return -1;
     }
 
@@ -40,6 +43,11 @@ int buffer_append(struct Buffer *b, const char *s)
     return 0;
 }
 
+int buffer_append(struct Buffer *b, const char *s)
+{
+    return buffer_append_len(b, s, strlen(s));
+}
+
 int buffer_appendf(struct Buffer *b, const char *fmt, ...)
 {
     va_list args;
@@ -54,7 +62,7 @@ int buffer_appendf(struct Buffer *b, const char *fmt, ...)
         return -1;
     }
 
-    if (buffer_ensure(b, (size_t)needed) != 0) {
+    if (buffer_reserve(b, (size_t)needed) != 0) {
         va_end(args);
         return -1;
     }
@@ -65,147 +73,118 @@ int buffer_appendf(struct Buffer *b, const char *fmt, ...)
     return 0;
 }
 
-char *html_escape(const char *src)
+char *buffer_detach(struct Buffer *b)
 {
-    struct Buffer out = {0};
-
-    for (const unsigned char *p = (const unsigned char *)src; *p != '\0'; ++p) {
-        int rc = 0;
-        switch (*p) {
-        case '&':
-            rc = buffer_append(&out, "&amp;");
-            break;
-        case '<':
-            rc = buffer_append(&out, "&lt;");
-            break;
-        case '>':
-            rc = buffer_append(&out, "&gt;");
-            break;
-        case '"':
-            rc = buffer_append(&out, "&quot;");
-            break;
-        default:
-            rc = buffer_ensure(&out, 1);
-            if (rc == 0) {
-                out.data[out.len++] = (char)*p;
-                out.data[out.len] = '\0';
-            }
-            break;
-        }
-
-        if (rc != 0) {
-            free(out.data);
-            return NULL;
-        }
+    if (b->arena == NULL || b->data == NULL) {
+        char *data = b->data;
+        b->data = NULL;
+        b->len = b->cap = 0;
+        return data;
     }
 
-    if (out.data == NULL) {
-        out.data = strdup("");
+    char *data = malloc(b->len + 1);
+    if (data != NULL) {
+        memcpy(data, b->data, b->len + 1);
     }
-    return out.data;
+    b->data = NULL;
+    b->len = b->cap = 0;
+    return data;
 }
 
-static int hex_value(char c)
+void buffer_free(struct Buffer *b)
 {
-    if (c >= '0' && c <= '9') {
-        return c - '0';
-    }
-    if (c >= 'a' && c <= 'f') {
-        return c - 'a' + 10;
+    if (b->arena == NULL) {
+        free(b->data);
     }
-    if (c >= 'A' && c <= 'F') {
-        return c - 'A' + 10;
+    b->data = NULL;
+    b->len = b->cap = 0;
+}
+
+int queue_text_response(struct MHD_Connection *connection, unsigned int status, const char *content_type, char *body)
+{
+    size_t len = strlen(body);
+    struct MHD_Response *response = MHD_create_response_from_buffer(len, body, MHD_RESPMEM_MUST_FREE);
+    if (response == NULL) {
+        free(body);
+        return MHD_NO;
     }
-    return -1;
+    metrics_add(METRIC_BODY_BYTES, len);
+
+    MHD_add_response_header(response, "Content-Type", content_type);
+    unsigned long long span = trace_begin();
+    int ret = MHD_queue_response(connection, status, response);
+    trace_end("MHD_queue_response", span);
+    MHD_destroy_response(response);
+    return ret;
 }
 
-static void url_decode_inplace(char *s)
+int queue_redirect_response(struct MHD_Connection *connection, const char *location)
 {
-    char *src = s;
-    char *dst = s;
-
-    while (*src != '\0') {
-        if (*src == '+') {
-            *dst++ = ' ';
-            src++;
-        } else if (*src == '%' && src[1] != '\0' && src[2] != '\0') {
-            int hi = hex_value(src[1]);
-            int lo = hex_value(src[2]);
-            if (hi >= 0 && lo >= 0) {
-                *dst++ = (char)((hi << 4) | lo);
-                src += 3;
-            } else {
-                *dst++ = *src++;
-            }
-        } else {
-            *dst++ = *src++;
-        }
+    const char *body = "<html><body>Redirecting...</body></html>";
+    struct MHD_Response *response = MHD_create_response_from_buffer(strlen(body), (void *)body, MHD_RESPMEM_PERSISTENT);
+    if (response == NULL) {
+        return MHD_NO;
     }
 
-    *dst = '\0';
+    MHD_add_response_header(response, "Location", location);
+    unsigned long long span = trace_begin();
+    int ret = MHD_queue_response(connection, MHD_HTTP_SEE_OTHER, response);
+    trace_end("MHD_queue_response", span);
+    MHD_destroy_response(response);
+    return ret;
 }
 
-int form_get_value(const char *form_body, const char *key, char *out, size_t out_size)
+int etag_matches(const char *if_none_match, const char *etag)
 {
-    if (out_size == 0) {
+    if (if_none_match == NULL) {
         return 0;
     }
 
-    char *copy = strdup(form_body);
-    if (copy == NULL) {
-        return 0;
+    /* If-None-Match uses weak comparison: ignore W/ on either side. */
+    if (strncmp(etag, "W/", 2) == 0) {
+        etag += 2;
     }
+    size_t etag_len = strlen(etag);
 
-    int found = 0;
-    char *saveptr = NULL;
-    for (char *token = strtok_r(copy, "&", &saveptr); token != NULL; token = strtok_r(NULL, "&", &saveptr)) {
-        char *eq = strchr(token, '=');
-        if (eq == NULL) {
-            continue;
+    const char *p = if_none_match;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+        if (*p == '*') {
+            return 1;
+        }
+        if (strncmp(p, "W/", 2) == 0) {
+            p += 2;
         }
 
-        *eq = '\0';
-        char *k = token;
-        char *v = eq + 1;
-
-        url_decode_inplace(k);
-        url_decode_inplace(v);
-
-        if (strcmp(k, key) == 0) {
-            snprintf(out, out_size, "%s", v);
-            found = 1;
-            break;
+        size_t tok_len = strcspn(p, ",");
+        while (tok_len > 0 && (p[tok_len - 1] == ' ' || p[tok_len - 1] == '\t')) {
+            tok_len--;
+        }
+        if (tok_len == etag_len && strncmp(p, etag, etag_len) == 0) {
+            return 1;
         }
+        p += strcspn(p, ",");
     }
-
-    free(copy);
-    return found;
+    return 0;
 }
 
-int queue_text_response(struct MHD_Connection *connection, unsigned int status, const char *content_type, char *body)
+int queue_not_modified_response(struct MHD_Connection *connection, const char *etag, const char *cache_control)
 {
-    struct MHD_Response *response = MHD_create_response_from_buffer(strlen(body), body, MHD_RESPMEM_MUST_FREE);
+    struct MHD_Response *response = MHD_create_response_from_buffer(0, (void *)"", MHD_RESPMEM_PERSISTENT);
     if (response == NULL) {
-        free(body);
         return MHD_NO;
     }
 
-    MHD_add_response_header(response, "Content-Type", content_type);
-    int ret = MHD_queue_response(connection, status, response);
-    MHD_destroy_response(response);
-    return ret;
-}
-
-int queue_redirect_response(struct MHD_Connection *connection, const char *location)
-{
-    const char *body = "<html><body>Redirecting...</body></html>";
-    struct MHD_Response *response = MHD_create_response_from_buffer(strlen(body), (void *)body, MHD_RESPMEM_PERSISTENT);
-    if (response == NULL) {
-        return MHD_NO;
+    MHD_add_response_header(response, "ETag", etag);
+    MHD_add_response_header(response, "Vary", "Accept-Encoding");
+    if (cache_control != NULL) {
+        MHD_add_response_header(response, "Cache-Control", cache_control);
     }
-
-    MHD_add_response_header(response, "Location", location);
-    int ret = MHD_queue_response(connection, MHD_HTTP_SEE_OTHER, response);
+    unsigned long long span = trace_begin();
+    int ret = MHD_queue_response(connection, MHD_HTTP_NOT_MODIFIED, response);
+    trace_end("MHD_queue_response", span);
     MHD_destroy_response(response);
     return ret;
 }
@@ -6,17 +6,27 @@
 
 enum { BUFFER_INITIAL_CAPACITY = 1024 };
 
+struct Arena;
+
+/* Heap-backed unless arena is set, in which case data lives in the arena. */
 struct Buffer {
     char *data;
     size_t len;
     size_t cap;
+    struct Arena *arena;
 };
 
+/* Ensures room for extra more bytes plus the terminating NUL. */
+int buffer_reserve(struct Buffer *b, size_t extra);
+int buffer_append_len(struct Buffer *b, const char *s, size_t n);
 int buffer_append(struct Buffer *b, const char *s);
 int buffer_appendf(struct Buffer *b, const char *fmt, ...);
-char *html_escape(const char *src);
-int form_get_value(const char *form_body, const char *key, char *out, size_t out_size);
+/* Hands back heap-owned contents: arena data is copied out at its exact size. */
+char *buffer_detach(struct Buffer *b);
+void buffer_free(struct Buffer *b);
 int queue_text_response(struct MHD_Connection *connection, unsigned int status, const char *content_type, char *body);
 int queue_redirect_response(struct MHD_Connection *connection, const char *location);
+int etag_matches(const char *if_none_match, const char *etag);
+int queue_not_modified_response(struct MHD_Connection *connection, const char *etag, const char *cache_control);
 
 #endif
@@ -0,0 +1,262 @@
+#include "writer.h"
+
+#include "config.h"
+#include "db.h"
+#include "hot.h"
+#include "logging.h"
+#include "metrics.h"
+#include "sse.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * Group commit: POST handlers queue a WriteRequest and suspend their
+ * connection; one writer thread takes up to batch_max queued posts, inserts
+ * them in a single transaction, publishes the batch to the hot window and
+ * SSE once and resumes every connection in it. When fewer than batch_max are queued it waits up
+ * to delay_ms after the oldest one arrived for more to join. While the queue
+ * is empty it re-renders stale message fragments, one short transaction at
+ * a time, so a post waits for at most one refresh step. A failed step is
+ * retried on the next idle pass, after at most FRAGMENT_REFRESH_RETRY_MS.
+ */
+
+static pthread_mutex_t writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond;
+static pthread_t writer_thread;
+static int writer_running;
+static int writer_stopping;
+
+static struct WriterOptions writer_opts;
+static struct WriteRequest *queue_head;
+static struct WriteRequest *queue_tail;
+static unsigned int queue_len;
+
+static struct MessageInsert *batch_inserts;
+static struct MessageRecord *batch_records;
+
+static void add_ms(struct timespec *ts, unsigned int ms)
+{
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Detaches up to batch_max requests from the queue; caller holds the lock. */
+static struct WriteRequest *take_batch(size_t *count)
+{
+    struct WriteRequest *batch = queue_head;
+    struct WriteRequest *last = NULL;
+    size_t n = 0;
+    for (struct WriteRequest *r = queue_head; r != NULL && n < writer_opts.batch_max; r = r->next) {
+        last = r;
+        n++;
+    }
+
+    queue_head = last->next;
+    if (queue_head == NULL) {
+        queue_tail = NULL;
+    }
+    last->next = NULL;
+    queue_len -= (unsigned int)n;
+    *count = n;
+    return batch;
+}
+
+/*
+ * A batch serving any sampled POST is traced on its own, on the writer's
+ * lane: its spans cover every post in it, so they belong to none of them.
+ */
+static void commit_batch(struct WriteRequest *batch, size_t count)
+{
+    struct Trace *trace = NULL;
+    size_t i = 0;
+    for (struct WriteRequest *r = batch; r != NULL; r = r->next, ++i) {
+        batch_inserts[i].nickname = r->nickname;
+        batch_inserts[i].client_id = r->client_id;
+        batch_inserts[i].content = r->message;
+        if (r->trace != NULL && trace == NULL) {
+            trace = trace_new();
+        }
+    }
+    trace_attach(trace);
+
+    unsigned long long start = metrics_now_ns();
+    if (db_insert_messages(batch_inserts, count) < 0) {
+        log_error("Failed committing batch of %zu messages", count);
+    }
+    metrics_observe(METRIC_DB_INSERT_BATCH, metrics_now_ns() - start);
+
+    size_t published = 0;
+    for (i = 0; i < count; ++i) {
+        if (batch_inserts[i].ok) {
+            batch_records[published++] = batch_inserts[i].record;
+        }
+    }
+    if (published > 0) {
+        unsigned long long span = trace_begin();
+        if (hot_publish(batch_records, published) != 0) {
+            log_error("Failed publishing batch of %zu messages to the hot window", published);
+        }
+        trace_end("hot window publish", span);
+        span = trace_begin();
+        sse_wake();
+        trace_end("sse wake", span);
+    }
+    trace_finish(trace, "write batch");
+
+    /* Record text points into the requests, so resume only once published. */
+    i = 0;
+    struct WriteRequest *next = NULL;
+    for (struct WriteRequest *r = batch; r != NULL; r = next, ++i) {
+        next = r->next;
+        r->ok = batch_inserts[i].ok;
+        r->done = 1;
+        MHD_resume_connection(r->connection);
+    }
+}
+
+static void *writer_main(void *arg)
+{
+    (void)arg;
+
+    int refresh = db_fragments_stale();
+    int refresh_failed = 0;
+    pthread_mutex_lock(&writer_mutex);
+    for (;;) {
+        while (queue_head == NULL && !writer_stopping) {
+            if (!refresh) {
+                pthread_cond_wait(&writer_cond, &writer_mutex);
+                continue;
+            }
+            if (refresh_failed) {
+                struct timespec deadline;
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+                add_ms(&deadline, FRAGMENT_REFRESH_RETRY_MS);
+                refresh_failed = 0;
+                pthread_cond_timedwait(&writer_cond, &writer_mutex, &deadline);
+                continue;
+            }
+            pthread_mutex_unlock(&writer_mutex);
+            int rc = db_refresh_fragments(FRAGMENT_REFRESH_BATCH);
+            pthread_mutex_lock(&writer_mutex);
+            refresh = rc != 0;
+            refresh_failed = rc < 0;
+        }
+        if (queue_head == NULL) {
+            break;
+        }
+
+        if (queue_len < writer_opts.batch_max && writer_opts.delay_ms > 0 && !writer_stopping) {
+            struct timespec deadline = queue_head->queued_at;
+            add_ms(&deadline, writer_opts.delay_ms);
+            int wait_rc = 0;
+            while (queue_len < writer_opts.batch_max && !writer_stopping && wait_rc != ETIMEDOUT) {
+                wait_rc = pthread_cond_timedwait(&writer_cond, &writer_mutex, &deadline);
+            }
+        }
+
+        size_t count = 0;
+        struct WriteRequest *batch = take_batch(&count);
+        pthread_mutex_unlock(&writer_mutex);
+
+        commit_batch(batch, count);
+
+        pthread_mutex_lock(&writer_mutex);
+    }
+    pthread_mutex_unlock(&writer_mutex);
+    return NULL;
+}
+
+int writer_start(const struct WriterOptions *opts)
+{
+    writer_opts = *opts;
+    if (writer_opts.batch_max == 0) {
+        writer_opts.batch_max = 1;
+    }
+
+    batch_inserts = calloc(writer_opts.batch_max, sizeof(*batch_inserts));
+    batch_records = calloc(writer_opts.batch_max, sizeof(*batch_records));
+    if (batch_inserts == NULL || batch_records == NULL) {
+        free(batch_inserts);
+        free(batch_records);
+        return -1;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&writer_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    writer_stopping = 0;
+    if (pthread_create(&writer_thread, NULL, &writer_main, NULL) != 0) {
+        log_error("Failed starting writer thread");
+        pthread_cond_destroy(&writer_cond);
+        free(batch_inserts);
+        free(batch_records);
+        return -1;
+    }
+    writer_running = 1;
+    return 0;
+}
+
+/* Stops taking posts, commits everything already queued and resumes it. */
+void writer_stop(void)
+{
+    if (!writer_running) {
+        return;
+    }
+
+    pthread_mutex_lock(&writer_mutex);
+    writer_stopping = 1;
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_mutex);
+
+    pthread_join(writer_thread, NULL);
+    writer_running = 0;
+
+    pthread_cond_destroy(&writer_cond);
+    free(batch_inserts);
+    free(batch_records);
+    batch_inserts = NULL;
+    batch_records = NULL;
+}
+
+/*
+ * Queues req and suspends its connection. Suspending under the lock means
+ * the writer cannot resume the connection before it is suspended.
+ */
+int writer_submit(struct WriteRequest *req)
+{
+    req->done = 0;
+    req->ok = 0;
+    req->next = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &req->queued_at);
+
+    pthread_mutex_lock(&writer_mutex);
+    if (writer_stopping || !writer_running) {
+        pthread_mutex_unlock(&writer_mutex);
+        return -1;
+    }
+
+    if (queue_tail != NULL) {
+        queue_tail->next = req;
+    } else {
+        queue_head = req;
+    }
+    queue_tail = req;
+    queue_len++;
+
+    MHD_suspend_connection(req->connection);
+    if (queue_len == 1 || queue_len >= writer_opts.batch_max) {
+        pthread_cond_signal(&writer_cond);
+    }
+    pthread_mutex_unlock(&writer_mutex);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include "config.h"
+
+#include <microhttpd.h>
+#include <time.h>
+
+struct Trace;
+
+struct WriterOptions {
+    unsigned int batch_max;
+    unsigned int delay_ms;
+};
+
+/* A POST waiting on its batch. The connection stays suspended until done. */
+struct WriteRequest {
+    struct MHD_Connection *connection;
+    char nickname[MAX_NICKNAME];
+    char client_id[MAX_CLIENT_ID];
+    char message[MAX_MESSAGE];
+    int done;
+    int ok;
+    struct timespec queued_at;
+    /* The POST's trace when it was sampled; the writer only tests it. */
+    struct Trace *trace;
+    struct WriteRequest *next;
+};
+
+int writer_start(const struct WriterOptions *opts);
+void writer_stop(void);
+int writer_submit(struct WriteRequest *req);
+
+#endif
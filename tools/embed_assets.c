@@ -0,0 +1,166 @@
+/*
+ * Build-time generator for embedded_assets.c. Writes each file as a const
+ * byte array plus an EmbeddedFile table, and the page template pre-split
+ * into TemplateSegments that point into its array, so the server does no
+ * file I/O or marker scanning when it builds the page.
+ *
+ * usage: embed_assets OUT.c TEMPLATE FILE...
+ */
+#include "template.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *read_file(const char *path, size_t *out_len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    long size = ftell(f);
+    if (size < 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    rewind(f);
+
+    char *buf = malloc((size_t)size + 1);
+    if (buf == NULL) {
+        fclose(f);
+        return NULL;
+    }
+
+    size_t read_n = fread(buf, 1, (size_t)size, f);
+    fclose(f);
+    if (read_n != (size_t)size) {
+        free(buf);
+        return NULL;
+    }
+
+    buf[size] = '\0';
+    *out_len = (size_t)size;
+    return buf;
+}
+
+static const char *base_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+static void write_array(FILE *out, int index, const char *data, size_t len)
+{
+    fprintf(out, "static const unsigned char embedded_data_%d[] = {", index);
+    for (size_t i = 0; i <= len; ++i) {
+        fprintf(out, "%s0x%02x,", i % 16 == 0 ? "\n    " : " ", i < len ? (unsigned char)data[i] : 0u);
+    }
+    fprintf(out, "\n};\n\n");
+}
+
+static const char *segment_kind_name(enum TemplateSegmentKind kind)
+{
+    switch (kind) {
+    case TEMPLATE_ASSET:
+        return "TEMPLATE_ASSET";
+    case TEMPLATE_MESSAGES:
+        return "TEMPLATE_MESSAGES";
+    default:
+        return "TEMPLATE_TEXT";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s OUT.c TEMPLATE FILE...\n", argv[0]);
+        return 2;
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    if (out == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fprintf(out, "/* Generated by tools/embed_assets. Do not edit. */\n");
+    fprintf(out, "#include \"embedded.h\"\n\n");
+
+    size_t tmpl_len = 0;
+    char *tmpl = read_file(argv[2], &tmpl_len);
+    if (tmpl == NULL) {
+        perror(argv[2]);
+        fclose(out);
+        return 1;
+    }
+
+    size_t segment_count = 0;
+    struct TemplateSegment *segments = template_split(tmpl, &segment_count);
+    if (segments == NULL) {
+        fprintf(stderr, "failed splitting %s\n", argv[2]);
+        free(tmpl);
+        fclose(out);
+        return 1;
+    }
+    write_array(out, 0, tmpl, tmpl_len);
+
+    size_t *lens = calloc((size_t)argc, sizeof(*lens));
+    if (lens == NULL) {
+        free(segments);
+        free(tmpl);
+        fclose(out);
+        return 1;
+    }
+
+    for (int i = 3; i < argc; ++i) {
+        char *data = read_file(argv[i], &lens[i]);
+        if (data == NULL) {
+            perror(argv[i]);
+            free(lens);
+            free(segments);
+            free(tmpl);
+            fclose(out);
+            return 1;
+        }
+        write_array(out, i - 2, data, lens[i]);
+        free(data);
+    }
+
+    fprintf(out, "const struct EmbeddedFile embedded_files[] = {\n");
+    for (int i = 3; i < argc; ++i) {
+        fprintf(out,
+                "    {\"%s\", (const char *)embedded_data_%d, %zu},\n",
+                base_name(argv[i]),
+                i - 2,
+                lens[i]);
+    }
+    fprintf(out, "};\n\n");
+    fprintf(out, "const size_t embedded_file_count = %d;\n\n", argc - 3);
+
+    fprintf(out, "const struct TemplateSegment embedded_page_segments[] = {\n");
+    for (size_t i = 0; i < segment_count; ++i) {
+        if (segments[i].kind == TEMPLATE_MESSAGES) {
+            fprintf(out, "    {TEMPLATE_MESSAGES, NULL, 0},\n");
+            continue;
+        }
+        fprintf(out,
+                "    {%s, (const char *)embedded_data_0 + %zu, %zu},\n",
+                segment_kind_name(segments[i].kind),
+                (size_t)(segments[i].text - tmpl),
+                segments[i].len);
+    }
+    fprintf(out, "};\n\n");
+    fprintf(out, "const size_t embedded_page_segment_count = %zu;\n", segment_count);
+
+    free(lens);
+    free(segments);
+    free(tmpl);
+    return fclose(out) == 0 ? 0 : 1;
+}